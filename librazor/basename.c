@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The basename index maps every name in the file string pool to the
+ * entries in the file tree with that name.  The basename table is
+ * sorted by name and each record points to a run of entry indices,
+ * in index order, in the basename entries section.  Names in the file
+ * string pool are unique, so a name is identified by its offset. */
+
+static int
+compare_uint64(const void *p1, const void *p2)
+{
+	const uint64_t *u1 = p1, *u2 = p2;
+
+	return *u1 < *u2 ? -1 : *u1 > *u2;
+}
+
+static int
+compare_basenames(const void *p1, const void *p2, void *data)
+{
+	const struct razor_basename *b1 = p1, *b2 = p2;
+	const char *pool = data;
+
+	return strcmp(&pool[b1->name], &pool[b2->name]);
+}
+
+void
+razor_set_build_basename_index(struct razor_set *set)
+{
+	struct razor_entry *entries;
+	struct razor_basename *basename;
+	struct array keys;
+	uint64_t *k, *kend;
+	uint32_t i, count, *entry;
+
+	array_release(&set->basenames);
+	array_release(&set->basename_entries);
+
+	entries = set->files.data;
+	count = set->files.size / sizeof *entries;
+
+	/* Sorting (name, entry) keys groups the entries by name, with
+	 * the entries of each name in index order.  The root entry has
+	 * no name and is left out. */
+	array_init(&keys);
+	for (i = 1; i < count; i++) {
+		k = array_add(&keys, sizeof *k);
+		*k = (uint64_t) entries[i].name << 32 | i;
+	}
+	qsort(keys.data, keys.size / sizeof *k, sizeof *k, compare_uint64);
+
+	basename = NULL;
+	kend = keys.data + keys.size;
+	for (k = keys.data; k < kend; k++) {
+		if (basename == NULL || basename->name != (*k >> 32)) {
+			basename = array_add(&set->basenames,
+					     sizeof *basename);
+			basename->name = *k >> 32;
+			basename->entries =
+				set->basename_entries.size / sizeof *entry;
+			basename->count = 0;
+		}
+		entry = array_add(&set->basename_entries, sizeof *entry);
+		*entry = *k & 0xffffffff;
+		basename->count++;
+	}
+	array_release(&keys);
+
+	free(razor_qsort_with_data(set->basenames.data,
+				   set->basenames.size / sizeof *basename,
+				   sizeof *basename, compare_basenames,
+				   set->file_string_pool.data));
+}
+
+/* Look up a base name in the basename index, which must be present.
+ * Returns NULL if no entry has that name. */
+struct razor_basename *
+razor_set_find_basename_entries(struct razor_set *set, const char *name)
+{
+	struct razor_basename *basenames;
+	const char *pool;
+	int lo, hi, mid, cmp;
+
+	basenames = set->basenames.data;
+	pool = set->file_string_pool.data;
+	lo = 0;
+	hi = set->basenames.size / sizeof *basenames;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		cmp = strcmp(&pool[basenames[mid].name], name);
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return &basenames[mid];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,219 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* A repository publishes its current set along with one file of
+ * concatenated deltas to it, one from each of a number of older sets,
+ * and an index of them.  The index is little endian: a header with
+ * the magic, the version, the number of entries and the size of an
+ * entry, followed by an entry for each delta with the digest of the
+ * packages of the set it applies to, and its offset and size in the
+ * delta file.  A client looks up the digest of the set it has and
+ * fetches just that range, which is a delta file of its own. */
+
+#define RAZOR_DELTA_INDEX_MAGIC		0x525a4449
+#define RAZOR_DELTA_INDEX_VERSION	1
+
+/* Entries may grow, but not past this; a larger entry size means the
+ * index is corrupt. */
+#define RAZOR_DELTA_INDEX_MAX_ENTRY_SIZE	4096
+
+struct razor_delta_index_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t count;
+	uint32_t entry_size;
+};
+
+struct razor_delta_index_entry {
+	unsigned char digest[RAZOR_DIGEST_SIZE];
+	uint32_t offset;
+	uint32_t size;
+};
+
+/**
+ * razor_set_write_deltas:
+ * @set: the current %razor_set
+ * @old: older sets to write deltas from
+ * @count: the number of sets in @old
+ * @filename: the file to write the concatenated deltas to
+ * @index: the file to write the index of the deltas to
+ *
+ * Write a delta from each of the sets in @old to @set, one after the
+ * other, to @filename, and an index of them to @index for
+ * razor_delta_index_lookup().
+ *
+ * Returns: 0 on success, -1 if a delta can't be created or a file
+ * can't be written.
+ **/
+RAZOR_EXPORT int
+razor_set_write_deltas(struct razor_set *set, struct razor_set **old,
+		       int count, const char *filename, const char *index)
+{
+	struct razor_delta_index_header header;
+	struct razor_delta_index_entry *entries;
+	struct razor_set *delta;
+	off_t start, end;
+	int fd, i, status;
+
+	assert (set != NULL);
+	assert (old != NULL);
+	assert (filename != NULL);
+	assert (index != NULL);
+
+	fd = open(filename, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "failed to create %s: %m\n", filename);
+		return -1;
+	}
+
+	entries = zalloc(count * sizeof *entries);
+	status = 0;
+	for (i = 0; i < count; i++) {
+		start = lseek(fd, 0, SEEK_CUR);
+		delta = razor_set_create_delta(old[i], set);
+		if (delta == NULL) {
+			status = -1;
+			break;
+		}
+		status = razor_set_write_to_fd(delta, fd, RAZOR_SECTION_ALL |
+					       RAZOR_SECTION_DELTA);
+		razor_set_destroy(delta);
+		end = lseek(fd, 0, SEEK_CUR);
+		if (status < 0 || start < 0 || end < 0)
+			break;
+
+		razor_set_digest_packages(old[i], entries[i].digest);
+		store32(&entries[i].offset, start, 0);
+		store32(&entries[i].size, end - start, 0);
+	}
+
+	if (close(fd) < 0 || status < 0 || i < count) {
+		fprintf(stderr, "failed to write %s: %m\n", filename);
+		free(entries);
+		return -1;
+	}
+
+	fd = open(index, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+	if (fd < 0) {
+		fprintf(stderr, "failed to create %s: %m\n", index);
+		free(entries);
+		return -1;
+	}
+
+	store32(&header.magic, RAZOR_DELTA_INDEX_MAGIC, 0);
+	store32(&header.version, RAZOR_DELTA_INDEX_VERSION, 0);
+	store32(&header.count, count, 0);
+	store32(&header.entry_size, sizeof *entries, 0);
+	status = razor_write(fd, &header, sizeof header);
+	if (status == 0)
+		status = razor_write(fd, entries, count * sizeof *entries);
+	if (close(fd) < 0 || status < 0) {
+		fprintf(stderr, "failed to write %s: %m\n", index);
+		status = -1;
+	}
+	free(entries);
+
+	return status;
+}
+
+/**
+ * razor_delta_index_lookup:
+ * @index: a delta index written by razor_set_write_deltas()
+ * @set: the %razor_set to find a delta from
+ * @offset: returns the offset of the delta in the delta file
+ * @size: returns the size of the delta
+ *
+ * Find the delta that applies to @set in a delta index.  The range
+ * given by @offset and @size of the delta file is a delta file of its
+ * own for razor_set_apply_delta().
+ *
+ * Returns: 0 if there is a delta for @set, -1 if there isn't or
+ * @index can't be read.
+ **/
+RAZOR_EXPORT int
+razor_delta_index_lookup(const char *index, struct razor_set *set,
+			 uint32_t *offset, uint32_t *size)
+{
+	struct razor_delta_index_header header;
+	unsigned char digest[RAZOR_DIGEST_SIZE], *entry;
+	uint32_t count, entry_size, i;
+	FILE *fp;
+	int status;
+
+	assert (index != NULL);
+	assert (set != NULL);
+	assert (offset != NULL);
+	assert (size != NULL);
+
+	fp = fopen(index, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "failed to open %s: %m\n", index);
+		return -1;
+	}
+
+	/* Entries may grow fields at the end in later versions. */
+	if (fread(&header, sizeof header, 1, fp) != 1 ||
+	    load32(&header.magic, 0) != RAZOR_DELTA_INDEX_MAGIC ||
+	    load32(&header.version, 0) != RAZOR_DELTA_INDEX_VERSION ||
+	    load32(&header.entry_size, 0) <
+	    sizeof (struct razor_delta_index_entry) ||
+	    load32(&header.entry_size, 0) >
+	    RAZOR_DELTA_INDEX_MAX_ENTRY_SIZE) {
+		fprintf(stderr, "%s is not a delta index\n", index);
+		fclose(fp);
+		return -1;
+	}
+
+	razor_set_digest_packages(set, digest);
+	count = load32(&header.count, 0);
+	entry_size = load32(&header.entry_size, 0);
+	entry = malloc(entry_size);
+	if (entry == NULL) {
+		fprintf(stderr, "failed to read %s: %m\n", index);
+		fclose(fp);
+		return -1;
+	}
+
+	status = -1;
+	for (i = 0; i < count; i++) {
+		if (fread(entry, entry_size, 1, fp) != 1)
+			break;
+		if (memcmp(entry, digest, sizeof digest) != 0)
+			continue;
+
+		*offset = load32(entry + RAZOR_DIGEST_SIZE, 0);
+		*size = load32(entry + RAZOR_DIGEST_SIZE + 4, 0);
+		status = 0;
+		break;
+	}
+	free(entry);
+	fclose(fp);
+
+	return status;
+}
@@ -0,0 +1,225 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The dependency graph resolves the requires of every package against
+ * the provides within the same set.  Each direction is stored in
+ * compressed sparse row form: for a set of n packages, the first n + 1
+ * words are offsets into the edge list that follows them, and the
+ * edges of package i are the package indices between offset i and
+ * offset i + 1.  The requires graph has an edge from a package to each
+ * package that satisfies one of its requires, the required-by graph
+ * has the same edges reversed. */
+
+static void
+add_edges(struct array *edges, struct razor_set *set,
+	  struct razor_property *requires, struct razor_property *provides)
+{
+	struct list *r, *p;
+	uint64_t *e;
+
+	r = list_first(&requires->packages, &set->package_pool);
+	for (; r; r = list_next(r)) {
+		p = list_first(&provides->packages, &set->package_pool);
+		for (; p; p = list_next(p)) {
+			if (r->data == p->data)
+				continue;
+			e = array_add(edges, sizeof *e);
+			*e = (uint64_t) r->data << 32 | p->data;
+		}
+	}
+}
+
+static int
+compare_edges(const void *p1, const void *p2)
+{
+	const uint64_t *e1 = p1, *e2 = p2;
+
+	return *e1 < *e2 ? -1 : *e1 > *e2;
+}
+
+static void
+build_csr(struct array *graph, struct array *edges, int count)
+{
+	uint64_t *e, *end, *unique;
+	uint32_t *offsets, *targets;
+	int i;
+
+	qsort(edges->data, edges->size / sizeof *e, sizeof *e, compare_edges);
+
+	end = edges->data + edges->size;
+	unique = edges->data;
+	for (e = edges->data; e < end; e++)
+		if (e == edges->data || *e != unique[-1])
+			*unique++ = *e;
+	end = unique;
+
+	offsets = array_add(graph, (count + 1 + (end - (uint64_t *) edges->data)) *
+			    sizeof *offsets);
+	targets = offsets + count + 1;
+
+	i = 0;
+	for (e = edges->data; e < end; e++) {
+		while (i <= (*e >> 32))
+			offsets[i++] = e - (uint64_t *) edges->data;
+		targets[e - (uint64_t *) edges->data] = *e & 0xffffffff;
+	}
+	while (i <= count)
+		offsets[i++] = end - (uint64_t *) edges->data;
+}
+
+/* Build both directions of the graph into the given arrays. */
+static void
+build_graph(struct razor_set *set,
+	    struct array *requires_graph, struct array *required_by_graph)
+{
+	struct razor_property *r, *p, *q, *start, *end;
+	struct array edges;
+	uint64_t *e, *eend;
+	const char *pool;
+	int count;
+
+	end = set->properties.data + set->properties.size;
+	pool = set->string_pool.data;
+	count = set->packages.size / sizeof (struct razor_package);
+
+	/* Properties are sorted by name, so all the requires and
+	 * provides for a name are in one run. */
+	array_init(&edges);
+	for (start = set->properties.data; start < end; start = p) {
+		for (p = start; p < end && p->name == start->name; p++)
+			;
+
+		for (r = start; r < p; r++) {
+			if ((r->flags & RAZOR_PROPERTY_TYPE_MASK) !=
+			    RAZOR_PROPERTY_REQUIRES)
+				continue;
+			for (q = start; q < p; q++) {
+				if ((q->flags & RAZOR_PROPERTY_TYPE_MASK) !=
+				    RAZOR_PROPERTY_PROVIDES)
+					continue;
+				if (!provider_satisfies_requirement(q, pool,
+								    r->flags,
+								    &pool[r->version]))
+					continue;
+				add_edges(&edges, set, r, q);
+			}
+		}
+	}
+
+	build_csr(requires_graph, &edges, count);
+
+	eend = edges.data + edges.size;
+	for (e = edges.data; e < eend; e++)
+		*e = *e << 32 | *e >> 32;
+	build_csr(required_by_graph, &edges, count);
+
+	array_release(&edges);
+}
+
+void
+razor_set_build_dependency_graph(struct razor_set *set)
+{
+	array_release(&set->requires_graph);
+	array_release(&set->required_by_graph);
+	build_graph(set, &set->requires_graph, &set->required_by_graph);
+}
+
+/**
+ * razor_set_reverse_closure:
+ * @set: a %razor_set
+ * @pi: an iterator for the packages to start from
+ * @callback: called for each package in the closure
+ * @data: user data passed to @callback
+ *
+ * Find all packages that directly or indirectly require one of the
+ * packages from @pi, that is, the packages that may break if the
+ * packages from @pi are removed.  The packages are reported in
+ * breadth first order, so direct requirers come first.  The packages
+ * from @pi themselves are not reported.  If the set doesn't have a
+ * dependency graph, a temporary one is built.
+ *
+ * Returns: the number of packages in the closure.
+ **/
+RAZOR_EXPORT int
+razor_set_reverse_closure(struct razor_set *set,
+			  struct razor_package_iterator *pi,
+			  razor_package_callback_t callback, void *data)
+{
+	struct razor_package *packages, *package;
+	struct array requires_graph, required_by_graph, *graph;
+	uint32_t *offsets, *targets, *queue, *t, *tend;
+	uint64_t *visited;
+	int count, head, tail, seeds;
+
+	assert (set != NULL);
+	assert (pi != NULL);
+
+	packages = set->packages.data;
+	count = set->packages.size / sizeof *packages;
+
+	array_init(&requires_graph);
+	array_init(&required_by_graph);
+	if (set->required_by_graph.size > 0) {
+		graph = &set->required_by_graph;
+	} else {
+		build_graph(set, &requires_graph, &required_by_graph);
+		graph = &required_by_graph;
+	}
+	offsets = graph->data;
+	targets = offsets + count + 1;
+
+	visited = zalloc(BITSET_WORDS(count) * sizeof *visited);
+	queue = malloc(count * sizeof *queue);
+	head = 0;
+	tail = 0;
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST)) {
+		if (bitset_test(visited, package - packages))
+			continue;
+		bitset_set(visited, package - packages);
+		queue[tail++] = package - packages;
+	}
+	seeds = tail;
+
+	while (head < tail) {
+		t = targets + offsets[queue[head]];
+		tend = targets + offsets[queue[head] + 1];
+		head++;
+		for (; t < tend; t++) {
+			if (bitset_test(visited, *t) ||
+			    !razor_set_package_visible(set, &packages[*t]))
+				continue;
+			bitset_set(visited, *t);
+			queue[tail++] = *t;
+			callback(&packages[*t], data);
+		}
+	}
+
+	free(visited);
+	free(queue);
+	array_release(&requires_graph);
+	array_release(&required_by_graph);
+
+	return tail - seeds;
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The file details are stored as one column section per field, each
+ * with one element per entry in the file tree, in entry order.  A set
+ * either has all the columns for every entry or none of them.  Entries
+ * nobody gave details for, such as the directories implied by a path,
+ * have all fields zero; an all-zero digest means no digest. */
+
+int
+razor_set_has_file_details(struct razor_set *set)
+{
+	return set->files.size > 0 &&
+		set->file_modes.size / sizeof (uint16_t) ==
+		set->files.size / sizeof (struct razor_entry);
+}
+
+void
+razor_set_add_file_details(struct razor_set *set,
+			   const struct razor_file_details *details)
+{
+	uint32_t *size, *mtime;
+	uint16_t *mode;
+	uint8_t *flags;
+	unsigned char *digest;
+
+	size = array_add(&set->file_sizes, sizeof *size);
+	*size = details->size;
+	mode = array_add(&set->file_modes, sizeof *mode);
+	*mode = details->mode;
+	mtime = array_add(&set->file_mtimes, sizeof *mtime);
+	*mtime = details->mtime;
+	digest = array_add(&set->file_digests, RAZOR_DIGEST_SIZE);
+	memcpy(digest, details->digest, RAZOR_DIGEST_SIZE);
+	flags = array_add(&set->file_flags, sizeof *flags);
+	*flags = details->flags;
+}
+
+/* Fill in the details of an entry.  Returns 0 and zeroes details if
+ * the set has no file details. */
+int
+razor_set_get_file_details(struct razor_set *set, uint32_t entry,
+			   struct razor_file_details *details)
+{
+	if (!razor_set_has_file_details(set)) {
+		memset(details, 0, sizeof *details);
+		return 0;
+	}
+
+	details->size = ((uint32_t *) set->file_sizes.data)[entry];
+	details->mode = ((uint16_t *) set->file_modes.data)[entry];
+	details->mtime = ((uint32_t *) set->file_mtimes.data)[entry];
+	memcpy(details->digest,
+	       (unsigned char *) set->file_digests.data +
+	       entry * RAZOR_DIGEST_SIZE, RAZOR_DIGEST_SIZE);
+	details->flags = ((uint8_t *) set->file_flags.data)[entry];
+
+	return 1;
+}
+
+void
+razor_set_release_file_details(struct razor_set *set)
+{
+	struct array *columns[] = {
+		&set->file_sizes, &set->file_modes, &set->file_mtimes,
+		&set->file_digests, &set->file_flags
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(columns); i++) {
+		array_release(columns[i]);
+		array_init(columns[i]);
+	}
+}
+
+static int
+hex_value(char c)
+{
+	if ('0' <= c && c <= '9')
+		return c - '0';
+	if ('a' <= c && c <= 'f')
+		return c - 'a' + 10;
+	if ('A' <= c && c <= 'F')
+		return c - 'A' + 10;
+
+	return -1;
+}
+
+/* Parse a hex encoded digest.  Anything but exactly
+ * RAZOR_DIGEST_SIZE hex encoded bytes leaves an all-zero digest and
+ * returns -1. */
+int
+razor_parse_digest(const char *hex, unsigned char *digest)
+{
+	int i, high, low;
+
+	memset(digest, 0, RAZOR_DIGEST_SIZE);
+	if (hex == NULL || strlen(hex) != 2 * RAZOR_DIGEST_SIZE)
+		return -1;
+
+	for (i = 0; i < RAZOR_DIGEST_SIZE; i++) {
+		high = hex_value(hex[2 * i]);
+		low = hex_value(hex[2 * i + 1]);
+		if (high < 0 || low < 0) {
+			memset(digest, 0, RAZOR_DIGEST_SIZE);
+			return -1;
+		}
+		digest[i] = high << 4 | low;
+	}
+
+	return 0;
+}
+
+static const unsigned char *
+entry_digest(struct razor_set *set, uint32_t entry)
+{
+	static const unsigned char zero[RAZOR_DIGEST_SIZE];
+	const unsigned char *digest;
+
+	if (!razor_set_has_file_details(set))
+		return NULL;
+
+	digest = (unsigned char *) set->file_digests.data +
+		entry * RAZOR_DIGEST_SIZE;
+	if (memcmp(digest, zero, RAZOR_DIGEST_SIZE) == 0)
+		return NULL;
+
+	return digest;
+}
+
+/**
+ * razor_entry_get_details:
+ * @set: a %razor_set
+ * @entry: a %razor_entry from @set
+ *
+ * Gets the size, mode, modification time, digest or flags of a file
+ * using a varg interface like razor_package_get_details().  The
+ * %RAZOR_FILE_DETAIL_DIGEST value is a pointer to %RAZOR_DIGEST_SIZE
+ * bytes of MD5 digest, or %NULL if the digest isn't known; the other
+ * values are #uint32_t.  All values are zero if the set has no file
+ * details.  The vararg must be terminated with
+ * %RAZOR_FILE_DETAIL_LAST.
+ *
+ * Example: razor_entry_get_details (set, entry,
+ *				     RAZOR_FILE_DETAIL_SIZE, &size,
+ *				     RAZOR_FILE_DETAIL_DIGEST, &digest,
+ *				     RAZOR_FILE_DETAIL_LAST);
+ **/
+RAZOR_EXPORT void
+razor_entry_get_details(struct razor_set *set, struct razor_entry *entry, ...)
+{
+	struct razor_file_details details;
+	enum razor_file_detail_type type;
+	const unsigned char **digest;
+	uint32_t index, *value;
+	va_list args;
+
+	assert (set != NULL);
+	assert (entry != NULL);
+
+	index = entry - (struct razor_entry *) set->files.data;
+	razor_set_get_file_details(set, index, &details);
+
+	va_start(args, entry);
+	while (1) {
+		type = va_arg(args, enum razor_file_detail_type);
+		if (type == RAZOR_FILE_DETAIL_LAST)
+			break;
+
+		if (type == RAZOR_FILE_DETAIL_DIGEST) {
+			digest = va_arg(args, const unsigned char **);
+			*digest = entry_digest(set, index);
+			continue;
+		}
+
+		value = va_arg(args, uint32_t *);
+		switch (type) {
+		case RAZOR_FILE_DETAIL_SIZE:
+			*value = details.size;
+			break;
+		case RAZOR_FILE_DETAIL_MODE:
+			*value = details.mode;
+			break;
+		case RAZOR_FILE_DETAIL_MTIME:
+			*value = details.mtime;
+			break;
+		case RAZOR_FILE_DETAIL_FLAGS:
+			*value = details.flags;
+			break;
+		default:
+			fprintf(stderr, "type %u not found\n", type);
+			break;
+		}
+	}
+	va_end(args);
+}
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The file hash maps the FNV-1a hash of the full path of every entry
+ * in the file tree to the entry.  It's an open addressing table with
+ * linear probing, at most half full, and a hit is confirmed by
+ * comparing the full 64-bit hash and the base name of the entry.
+ * FNV-1a hashes a byte at a time, so the hash of a path is built from
+ * the hash of its directory while walking the tree. */
+
+#define FNV_OFFSET_BASIS	0xcbf29ce484222325ULL
+#define FNV_PRIME		0x100000001b3ULL
+
+static inline uint64_t
+hash_byte(uint64_t hash, unsigned char c)
+{
+	return (hash ^ c) * FNV_PRIME;
+}
+
+static uint64_t
+hash_string(uint64_t hash, const char *s)
+{
+	while (*s)
+		hash = hash_byte(hash, *s++);
+
+	return hash;
+}
+
+static void
+insert_entries(struct razor_set *set, struct razor_file_slot *slots,
+	       uint32_t mask, struct razor_entry *dir, uint64_t hash)
+{
+	struct razor_entry *entries, *e;
+	const char *pool;
+	uint64_t h;
+	uint32_t i;
+
+	entries = set->files.data;
+	pool = set->file_string_pool.data;
+
+	e = entries + dir->start;
+	do {
+		h = hash_string(hash_byte(hash, '/'), &pool[e->name]);
+		for (i = h & mask; slots[i].entry != 0; i = (i + 1) & mask)
+			;
+		slots[i].hash_low = h;
+		slots[i].hash_high = h >> 32;
+		slots[i].entry = e - entries;
+
+		if (e->start != 0)
+			insert_entries(set, slots, mask, e, h);
+	} while (!((e++)->flags & RAZOR_ENTRY_LAST));
+}
+
+void
+razor_set_build_file_hash(struct razor_set *set)
+{
+	struct razor_entry *root;
+	struct razor_file_slot *slots;
+	uint32_t count, size;
+
+	array_release(&set->file_hash);
+
+	root = set->files.data;
+	count = set->files.size / sizeof *root;
+	if (root == NULL || root->start == 0)
+		return;
+
+	for (size = 2; size < 2 * count; size *= 2)
+		;
+	slots = array_add(&set->file_hash, size * sizeof *slots);
+	memset(slots, 0, size * sizeof *slots);
+	insert_entries(set, slots, size - 1, root, FNV_OFFSET_BASIS);
+}
+
+/* Look up an absolute path in the file hash, which must be present.
+ * Returns NULL if there is no such file. */
+struct razor_entry *
+razor_set_find_hashed_entry(struct razor_set *set, const char *path)
+{
+	struct razor_file_slot *slots;
+	struct razor_entry *entries;
+	const char *pool, *base;
+	uint64_t hash;
+	uint32_t i, mask;
+
+	slots = set->file_hash.data;
+	mask = set->file_hash.size / sizeof *slots - 1;
+	entries = set->files.data;
+	pool = set->file_string_pool.data;
+
+	hash = hash_string(FNV_OFFSET_BASIS, path);
+	base = strrchr(path, '/') + 1;
+	for (i = hash & mask; slots[i].entry != 0; i = (i + 1) & mask) {
+		if (slots[i].hash_low == (uint32_t) hash &&
+		    slots[i].hash_high == (uint32_t) (hash >> 32) &&
+		    strcmp(&pool[entries[slots[i].entry].name], base) == 0)
+			return &entries[slots[i].entry];
+	}
+
+	return NULL;
+}
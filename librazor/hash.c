@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "razor-internal.h"
+
+/* The 128-bit x64 variant of Austin Appleby's public domain
+ * MurmurHash3.  It isn't cryptographic, but it runs at several bytes
+ * a cycle, which is what hashing every section of a set on write and
+ * optionally on open needs.  Input is read as little endian words, so
+ * a buffer hashes the same on all hosts. */
+
+static inline uint64_t
+rotl64(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t
+fmix64(uint64_t k)
+{
+	k ^= k >> 33;
+	k *= 0xff51afd7ed558ccdULL;
+	k ^= k >> 33;
+	k *= 0xc4ceb9fe1a85ec53ULL;
+	k ^= k >> 33;
+
+	return k;
+}
+
+static inline uint64_t
+load64(const unsigned char *p)
+{
+	uint64_t v;
+
+	memcpy(&v, p, sizeof v);
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64(v);
+#endif
+
+	return v;
+}
+
+static void
+store64(unsigned char *p, uint64_t v)
+{
+	int i;
+
+	for (i = 0; i < 8; i++)
+		p[i] = v >> (i * 8);
+}
+
+void
+razor_hash128(const void *data, size_t size, unsigned char *hash)
+{
+	const uint64_t c1 = 0x87c37b91114253d5ULL;
+	const uint64_t c2 = 0x4cf5ad432745937fULL;
+	const unsigned char *p = data, *tail;
+	uint64_t h1 = 0, h2 = 0, k1, k2;
+	size_t i, blocks;
+
+	blocks = size / 16;
+	for (i = 0; i < blocks; i++, p += 16) {
+		k1 = load64(p);
+		k2 = load64(p + 8);
+
+		k1 *= c1;
+		k1 = rotl64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+		h1 = rotl64(h1, 27);
+		h1 += h2;
+		h1 = h1 * 5 + 0x52dce729;
+
+		k2 *= c2;
+		k2 = rotl64(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+		h2 = rotl64(h2, 31);
+		h2 += h1;
+		h2 = h2 * 5 + 0x38495ab5;
+	}
+
+	tail = p;
+	k1 = 0;
+	k2 = 0;
+	switch (size & 15) {
+	case 15: k2 ^= (uint64_t) tail[14] << 48;
+	case 14: k2 ^= (uint64_t) tail[13] << 40;
+	case 13: k2 ^= (uint64_t) tail[12] << 32;
+	case 12: k2 ^= (uint64_t) tail[11] << 24;
+	case 11: k2 ^= (uint64_t) tail[10] << 16;
+	case 10: k2 ^= (uint64_t) tail[9] << 8;
+	case 9:
+		k2 ^= (uint64_t) tail[8];
+		k2 *= c2;
+		k2 = rotl64(k2, 33);
+		k2 *= c1;
+		h2 ^= k2;
+	case 8: k1 ^= (uint64_t) tail[7] << 56;
+	case 7: k1 ^= (uint64_t) tail[6] << 48;
+	case 6: k1 ^= (uint64_t) tail[5] << 40;
+	case 5: k1 ^= (uint64_t) tail[4] << 32;
+	case 4: k1 ^= (uint64_t) tail[3] << 24;
+	case 3: k1 ^= (uint64_t) tail[2] << 16;
+	case 2: k1 ^= (uint64_t) tail[1] << 8;
+	case 1:
+		k1 ^= (uint64_t) tail[0];
+		k1 *= c1;
+		k1 = rotl64(k1, 31);
+		k1 *= c2;
+		h1 ^= k1;
+	}
+
+	h1 ^= size;
+	h2 ^= size;
+	h1 += h2;
+	h2 += h1;
+	h1 = fmix64(h1);
+	h2 = fmix64(h2);
+	h1 += h2;
+	h2 += h1;
+
+	store64(hash, h1);
+	store64(hash + 8, h2);
+}
@@ -19,6 +19,7 @@
 
 #define _GNU_SOURCE
 
+#include <stdio.h>
 #include <string.h>
 #include "razor-internal.h"
 #include "razor.h"
@@ -62,6 +63,20 @@ razor_importer_destroy(struct razor_importer *importer)
 }
 
 
+/**
+ * razor_importer_set_indexes:
+ * @importer: the %razor_importer
+ * @indexes: a mask of %razor_index_type values
+ *
+ * Select the optional indexes that %razor_importer_finish builds for
+ * the new set, in addition to the package, property and file data.
+ **/
+RAZOR_EXPORT void
+razor_importer_set_indexes(struct razor_importer *importer, uint32_t indexes)
+{
+	importer->indexes = indexes;
+}
+
 /**
  * razor_importer_begin_package:
  * @importer: the %razor_importer
@@ -89,6 +104,10 @@ razor_importer_begin_package(struct razor_importer *importer,
 	p->flags = 0;
 	p->version = hashtable_tokenize(&importer->table, version);
 	p->arch = hashtable_tokenize(&importer->table, arch);
+	p->summary = hashtable_tokenize(&importer->details_table, NULL);
+	p->description = p->summary;
+	p->url = p->summary;
+	p->license = p->summary;
 
 	importer->package = p;
 	array_init(&importer->properties);
@@ -190,6 +209,48 @@ razor_importer_add_file(struct razor_importer *importer, const char *name)
 	e->package = importer->package -
 		(struct razor_package *) importer->set->packages.data;
 	e->name = strdup(name);
+	memset(&e->details, 0, sizeof e->details);
+	e->has_details = 0;
+}
+
+/**
+ * razor_importer_add_file_full:
+ * @importer: the %razor_importer
+ * @name: name of the file
+ * @size: size of the file in bytes
+ * @mode: the file type and permissions, as in st_mode
+ * @mtime: modification time of the file
+ * @digest: hex encoded MD5 digest of the file contents, or %NULL
+ * @flags: a mask of %razor_file_flags values
+ *
+ * Add a file and its details to the current package.  The details are
+ * stored in the set and can be read back with
+ * razor_entry_get_details().  If several packages own a file, the
+ * details given by only one of them are kept.  Digests that aren't
+ * MD5, such as the SHA-256 digests of newer rpms, are not stored and
+ * the file is left without a digest; razor_importer_finish() reports
+ * how many were dropped.
+ **/
+RAZOR_EXPORT void
+razor_importer_add_file_full(struct razor_importer *importer,
+			     const char *name, uint32_t size,
+			     uint32_t mode, uint32_t mtime,
+			     const char *digest, uint32_t flags)
+{
+	struct import_entry *e;
+
+	razor_importer_add_file(importer, name);
+
+	e = importer->files.data + importer->files.size - sizeof *e;
+	e->details.size = size;
+	e->details.mode = mode;
+	e->details.mtime = mtime;
+	e->details.flags = flags;
+	if (razor_parse_digest(digest, e->details.digest) < 0 &&
+	    digest != NULL && digest[0] != '\0')
+		importer->ignored_digests++;
+	e->has_details = 1;
+	importer->has_file_details = 1;
 }
 
 static int
@@ -198,12 +259,19 @@ compare_packages(const void *p1, const void *p2, void *data)
 	const struct razor_package *pkg1 = p1, *pkg2 = p2;
 	struct razor_set *set = data;
 	char *pool = set->string_pool.data;
+	int cmp;
 
 	/* FIXME: what if the flags are different? */
-	if (pkg1->name == pkg2->name)
-		return razor_versioncmp(&pool[pkg1->version], &pool[pkg2->version]);
-	else
+	if (pkg1->name != pkg2->name)
 		return strcmp(&pool[pkg1->name], &pool[pkg2->name]);
+
+	/* Order by arch last, so the same packages always come out in
+	 * the same order; deltas depend on that. */
+	cmp = razor_versioncmp(&pool[pkg1->version], &pool[pkg2->version]);
+	if (cmp != 0)
+		return cmp;
+
+	return strcmp(&pool[pkg1->arch], &pool[pkg2->arch]);
 }
 
 static int
@@ -228,8 +296,7 @@ uniqueify_properties(struct razor_set *set)
 {
 	struct razor_property *rp, *up, *rp_end;
 	struct array *pkgs, *p;
-	struct list_head *r;
-	uint32_t *map, *rmap;
+	uint32_t *map, *rmap, *r;
 	int i, count, unique;
 
 	count = set->properties.size / sizeof(struct razor_property);
@@ -255,7 +322,7 @@ uniqueify_properties(struct razor_set *set)
 		unique = up - (struct razor_property *) set->properties.data;
 		rmap[map[i]] = unique;
 		r = array_add(&pkgs[unique], sizeof *r);
-		*r = rp->packages;
+		*r = rp->packages.list_ptr;
 	}
 	free(map);
 
@@ -278,29 +345,8 @@ compare_filenames(const void *p1, const void *p2, void *data)
 {
 	const struct import_entry *e1 = p1;
 	const struct import_entry *e2 = p2;
-	const char *n1 = e1->name;
-	const char *n2 = e2->name;
-
-	/* Need to make sure that the contents of a directory
-	 * are sorted immediately after it. So "foo/bar" has to
-	 * sort before "foo.conf"
-	 *
-	 * FIXME: this is about 60% slower than strcmp
-	 */
-	while (*n1 && *n2) {
-		if (*n1 < *n2)
-			return *n2 == '/' ? 1 : -1;
-		else if (*n1 > *n2)
-			return *n1 == '/' ? -1 : 1;
-		n1++;
-		n2++;
-	}
-	if (*n1)
-		return 1;
-	else if (*n2)
-		return -1;
-	else
-		return 0;
+
+	return razor_compare_filenames(e1->name, e2->name);
 }
 
 static void
@@ -318,19 +364,26 @@ count_entries(struct import_directory *d)
 	}
 }
 
+/* Write out the entries of directory d, which is entry dir, followed
+ * by the entries of its subdirectories, and record dir as the parent
+ * of each entry. */
 static void
-serialize_files(struct razor_set *set,
-		struct import_directory *d, struct array *array)
+serialize_files(struct razor_set *set, struct import_directory *d,
+		uint32_t dir, struct array *array)
 {
 	struct import_directory *p, *end;
 	struct razor_entry *e = NULL;
-	uint32_t s;
+	uint32_t s, first, *parent;
 
 	p = d->files.data;
 	end = d->files.data + d->files.size;
-	s = array->size / sizeof *e + d->files.size / sizeof *p;
+	first = array->size / sizeof *e;
+	s = first + d->files.size / sizeof *p;
 	while (p < end) {
 		e = array_add(array, sizeof *e);
+		parent = array_add(&set->file_parents, sizeof *parent);
+		*parent = dir;
+		razor_set_add_file_details(set, &p->details);
 		e->name = p->name;
 		e->flags = 0;
 		e->start = p->count > 0 ? s : 0;
@@ -346,7 +399,7 @@ serialize_files(struct razor_set *set,
 	p = d->files.data;
 	end = d->files.data + d->files.size;
 	while (p < end) {
-		serialize_files(set, p, array);
+		serialize_files(set, p, first++, array);
 		p++;
 	}
 }
@@ -382,6 +435,8 @@ build_file_tree(struct razor_importer *importer)
 	root.name = hashtable_tokenize(&importer->file_table, "");
 	array_init(&root.files);
 	array_init(&root.packages);
+	memset(&root.details, 0, sizeof root.details);
+	root.has_details = 0;
 	root.last = NULL;
 
 	filenames = importer->files.data;
@@ -407,6 +462,9 @@ build_file_tree(struct razor_importer *importer)
 				d->last->last = NULL;
 				array_init(&d->last->files);
 				array_init(&d->last->packages);
+				memset(&d->last->details, 0,
+				       sizeof d->last->details);
+				d->last->has_details = 0;
 			}
 			d = d->last;
 			f = end + 1;
@@ -416,6 +474,10 @@ build_file_tree(struct razor_importer *importer)
 
 		r = array_add(&d->packages, sizeof *r);
 		*r = filenames[i].package;
+		if (!d->has_details && filenames[i].has_details) {
+			d->details = filenames[i].details;
+			d->has_details = 1;
+		}
 		free(filenames[i].name);
 	}
 
@@ -426,7 +488,10 @@ build_file_tree(struct razor_importer *importer)
 	e->start = importer->files.size ? 1 : 0;
 	list_set_empty(&e->packages);
 
-	serialize_files(importer->set, &root, &importer->set->files);
+	razor_set_add_file_details(importer->set, &root.details);
+	serialize_files(importer->set, &root, 0, &importer->set->files);
+	if (!importer->has_file_details)
+		razor_set_release_file_details(importer->set);
 
 	array_release(&importer->files);
 }
@@ -543,7 +608,8 @@ build_package_file_lists(struct razor_set *set, uint32_t *rmap)
  * and creates a new %razor_set.  After creating the new package set,
  * the importer is destroyed.
  *
- * Returns: the new %razor_set
+ * Returns: the new %razor_set, or %NULL if it has more packages,
+ * properties or files than the library can index.
  **/
 RAZOR_EXPORT struct razor_set *
 razor_importer_finish(struct razor_importer *importer)
@@ -576,11 +642,23 @@ razor_importer_finish(struct razor_importer *importer)
 	remap_property_package_links(&importer->set->properties, rmap);
 	free(rmap);
 
+	razor_set_build_package_sizes(importer->set);
+	razor_set_build_indexes(importer->set, importer->indexes);
+
+	if (importer->ignored_digests > 0)
+		fprintf(stderr, "ignored %u file digests that are not MD5\n",
+			importer->ignored_digests);
+
 	set = importer->set;
 	hashtable_release(&importer->table);
 	hashtable_release(&importer->details_table);
 	hashtable_release(&importer->file_table);
 	free(importer);
 
+	if (razor_set_check_limits(set) < 0) {
+		razor_set_destroy(set);
+		return NULL;
+	}
+
 	return set;
 }
@@ -21,31 +21,12 @@
 
 #include <stdarg.h>
 #include <string.h>
+#include <fnmatch.h>
 #include <assert.h>
 
 #include "razor-internal.h"
 #include "razor.h"
 
-static struct razor_package_iterator *
-razor_package_iterator_create_with_index(struct razor_set *set,
-					 struct list *index)
-{
-	struct razor_package_iterator *pi;
-
-	pi = zalloc(sizeof *pi);
-	pi->set = set;
-	pi->index = index;
-
-	return pi;
-}
-
-static struct razor_package_iterator *
-razor_package_iterator_create_empty(struct razor_set *set)
-{
-	struct razor_package_iterator *pi;
-	return zalloc(sizeof *pi);
-}
-
 RAZOR_EXPORT struct razor_package_iterator *
 razor_package_iterator_create(struct razor_set *set)
 {
@@ -53,10 +34,25 @@ razor_package_iterator_create(struct razor_set *set)
 
 	assert (set != NULL);
 
+	razor_set_enter_phase(set, RAZOR_PHASE_SCAN);
+
 	pi = zalloc(sizeof *pi);
 	pi->set = set;
-	pi->end = set->packages.data + set->packages.size;
-	pi->package = set->packages.data;
+	if (set->view) {
+		pi->count = set->packages.size / sizeof (struct razor_package);
+		pi->bits = malloc(BITSET_WORDS(pi->count) * sizeof *pi->bits);
+		memcpy(pi->bits, set->view->packages,
+		       BITSET_WORDS(pi->count) * sizeof *pi->bits);
+		if (set->view->added) {
+			pi->added = set->view->added;
+			pi->added_package = pi->added->packages.data;
+			pi->added_end = pi->added->packages.data +
+				pi->added->packages.size;
+		}
+	} else {
+		pi->end = set->packages.data + set->packages.size;
+		pi->package = set->packages.data;
+	}
 
 	return pi;
 }
@@ -66,44 +62,129 @@ razor_package_iterator_init_for_property(struct razor_package_iterator *pi,
 					 struct razor_set *set,
 					 struct razor_property *property)
 {
+	struct razor_property *base_property, *added_property;
+	struct razor_set *added;
+
 	assert (pi != NULL);
 	assert (set != NULL);
 	assert (property != NULL);
 
 	memset(pi, 0, sizeof *pi);
 	pi->set = set;
-	pi->index = list_first(&property->packages, &set->package_pool);
+	if (set->view == NULL || set->view->added == NULL) {
+		pi->index = list_first(&property->packages,
+				       &set->package_pool);
+		return;
+	}
+
+	/* The packages of a layer with a property are those of the
+	 * base and the added ones with the same property. */
+	added = set->view->added;
+	if (razor_set_property_owner(set, property) == added) {
+		base_property = razor_set_find_same_property(set, added,
+							     property);
+		added_property = property;
+	} else {
+		base_property = property;
+		added_property = razor_set_find_same_property(added, set,
+							      property);
+	}
+
+	pi->added = added;
+	if (base_property)
+		pi->index = list_first(&base_property->packages,
+				       &set->package_pool);
+	if (added_property)
+		pi->added_index = list_first(&added_property->packages,
+					     &added->package_pool);
 }
 
 RAZOR_EXPORT struct razor_package_iterator *
 razor_package_iterator_create_for_property(struct razor_set *set,
 					   struct razor_property *property)
 {
-	struct list *index;
+	struct razor_package_iterator *pi;
 
 	assert (set != NULL);
 	assert (property != NULL);
 
-	index = list_first(&property->packages, &set->package_pool);
-	return razor_package_iterator_create_with_index(set, index);
+	pi = zalloc(sizeof *pi);
+	razor_package_iterator_init_for_property(pi, set, property);
+
+	return pi;
+}
+
+/* The packages added to a layer that own filename. */
+static void
+add_added_file_owners(struct razor_package_iterator *pi,
+		      struct razor_set *set, const char *filename)
+{
+	struct razor_set *added;
+	struct razor_entry *entry;
+
+	if (set->view == NULL || set->view->added == NULL)
+		return;
+
+	added = set->view->added;
+	if (added->files.size == 0)
+		return;
+
+	entry = razor_set_find_entry(added, added->files.data, filename);
+	if (entry == NULL)
+		return;
+
+	pi->added = added;
+	pi->added_index = list_first(&entry->packages, &added->package_pool);
 }
 
 RAZOR_EXPORT struct razor_package_iterator *
 razor_package_iterator_create_for_file(struct razor_set *set,
 				       const char *filename)
 {
+	struct razor_package_iterator *pi;
 	struct razor_entry *entry;
-	struct list *index;
 
 	assert (set != NULL);
 	assert (filename != NULL);
 
-	entry = razor_set_find_entry(set, set->files.data, filename);
-	if (entry == NULL)
-		return razor_package_iterator_create_empty(set);
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
 
-	index = list_first(&entry->packages, &set->package_pool);
-	return razor_package_iterator_create_with_index(set, index);
+	pi = zalloc(sizeof *pi);
+	pi->set = set;
+	if (set->files.size > 0) {
+		entry = razor_set_find_entry(set, set->files.data, filename);
+		if (entry)
+			pi->index = list_first(&entry->packages,
+					       &set->package_pool);
+	}
+	add_added_file_owners(pi, set, filename);
+
+	return pi;
+}
+
+/* The added packages of a layer are merged in by name and version. */
+static int
+added_package_first(struct razor_package_iterator *pi,
+		    struct razor_package *p, int valid)
+{
+	const char *pool, *added_pool;
+	struct razor_package *a;
+	int cmp;
+
+	if (pi->added_package >= pi->added_end)
+		return 0;
+	if (!valid)
+		return 1;
+
+	a = pi->added_package;
+	pool = pi->set->string_pool.data;
+	added_pool = pi->added->string_pool.data;
+	cmp = strcmp(&added_pool[a->name], &pool[p->name]);
+	if (cmp == 0)
+		cmp = razor_versioncmp(&added_pool[a->version],
+				       &pool[p->version]);
+
+	return cmp < 0;
 }
 
 /**
@@ -131,11 +212,32 @@ razor_package_iterator_next(struct razor_package_iterator *pi,
 	if (pi->package) {
 		p = pi->package++;
 		valid = p < pi->end;
-	} else if (pi->index) {
+	} else if (pi->index || pi->added_index) {
+		/* The owners in the base, then those added to a layer. */
+		do {
+			if (pi->index) {
+				packages = pi->set->packages.data;
+				p = &packages[pi->index->data];
+				pi->index = list_next(pi->index);
+				valid = razor_set_package_visible(pi->set, p);
+			} else {
+				packages = pi->added->packages.data;
+				p = &packages[pi->added_index->data];
+				pi->added_index = list_next(pi->added_index);
+				valid = 1;
+			}
+		} while (!valid && (pi->index || pi->added_index));
+	} else if (pi->bits) {
+		pi->bit = bitset_next(pi->bits, pi->bit, pi->count);
 		packages = pi->set->packages.data;
-		p = &packages[pi->index->data];
-		pi->index = list_next(pi->index);
-		valid = 1;
+		p = &packages[pi->bit];
+		valid = pi->bit < pi->count;
+		if (added_package_first(pi, p, valid)) {
+			p = pi->added_package++;
+			valid = 1;
+		} else {
+			pi->bit++;
+		}
 	} else
 		valid = 0;
 
@@ -158,8 +260,7 @@ razor_package_iterator_destroy(struct razor_package_iterator *pi)
 {
 	assert (pi != NULL);
 
-	if (pi->free_index)
-		free(pi->index);
+	free(pi->bits);
 
 	free(pi);
 }
@@ -172,6 +273,9 @@ razor_property_iterator_create(struct razor_set *set,
 
 	assert (set != NULL);
 
+	if (package)
+		set = razor_set_package_owner(set, package);
+
 	pi = zalloc(sizeof *pi);
 	pi->set = set;
 
@@ -179,8 +283,15 @@ razor_property_iterator_create(struct razor_set *set,
 		pi->index = list_first(&package->properties,
 				       &set->property_pool);
 	} else {
+		razor_set_enter_phase(set, RAZOR_PHASE_SCAN);
 		pi->property = set->properties.data;
 		pi->end = set->properties.data + set->properties.size;
+		if (set->view && set->view->added) {
+			pi->added = set->view->added;
+			pi->added_property = pi->added->properties.data;
+			pi->added_end = pi->added->properties.data +
+				pi->added->properties.size;
+		}
 	}
 
 	return pi;
@@ -194,14 +305,43 @@ razor_property_iterator_next(struct razor_property_iterator *pi,
 			     const char **version)
 {
 	char *pool;
-	int valid;
+	int valid, cmp;
 	struct razor_property *p, *properties;
+	struct razor_set *set;
 
 	assert (pi != NULL);
 
+	set = pi->set;
 	if (pi->property) {
-		p = pi->property++;
+		while (pi->property < pi->end &&
+		       !razor_set_property_visible(pi->set, pi->property))
+			pi->property++;
+		p = pi->property;
 		valid = p < pi->end;
+
+		/* The added properties of a layer are merged in by
+		 * name, flags and version, and those the base has too
+		 * are skipped. */
+		cmp = 1;
+		while (pi->added_property < pi->added_end) {
+			if (!valid) {
+				cmp = -1;
+				break;
+			}
+			cmp = razor_set_compare_properties(pi->added,
+							   pi->added_property,
+							   pi->set, p);
+			if (cmp != 0)
+				break;
+			pi->added_property++;
+		}
+		if (cmp < 0) {
+			p = pi->added_property++;
+			set = pi->added;
+			valid = 1;
+		} else if (valid) {
+			pi->property++;
+		}
 	} else if (pi->index) {
 		properties = pi->set->properties.data;
 		p = &properties[pi->index->data];
@@ -211,7 +351,7 @@ razor_property_iterator_next(struct razor_property_iterator *pi,
 		valid = 0;
 
 	if (valid) {
-		pool = pi->set->string_pool.data;
+		pool = set->string_pool.data;
 		*property = p;
 		*name = &pool[p->name];
 		*flags = p->flags;
@@ -229,24 +369,180 @@ razor_property_iterator_destroy(struct razor_property_iterator *pi)
 	free(pi);
 }
 
-struct razor_package_query {
-	struct razor_set *set;
-	char *vector;
-	int count;
-};
+/**
+ * razor_file_iterator_create:
+ * @set: a %razor_set
+ * @prefix: the directory to list, or %NULL for the whole file tree
+ * @pattern: a glob pattern for the entry names, or %NULL
+ *
+ * Create an iterator that walks the file tree below @prefix depth
+ * first, in the same order razor_set_list_files() prints it.  If
+ * @pattern is given, it is matched against the name of every entry at
+ * every depth: only entries whose name matches are returned, and
+ * directories that don't match aren't descended into.  The walk
+ * keeps an explicit stack and a single path buffer that grows as
+ * needed, so paths of any length and depth can be listed.  On a
+ * layer, the tree walked is that of the base, but the owners of an
+ * entry include the added packages that have it.
+ *
+ * Returns: the new %razor_file_iterator.
+ **/
+RAZOR_EXPORT struct razor_file_iterator *
+razor_file_iterator_create(struct razor_set *set,
+			   const char *prefix, const char *pattern)
+{
+	struct razor_file_iterator *fi;
+	struct razor_file_frame *frame;
+	struct razor_entry *root, *dir;
+	size_t length;
+	char *p;
+
+	assert (set != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+
+	fi = zalloc(sizeof *fi);
+	fi->set = set;
+	if (pattern && pattern[0])
+		fi->pattern = strdup(pattern);
+
+	if (prefix == NULL)
+		prefix = "";
+	length = strlen(prefix);
+	while (length > 0 && prefix[length - 1] == '/')
+		length--;
+	p = array_add(&fi->path, length + 1);
+	memcpy(p, prefix, length);
+	p[length] = '\0';
+
+	root = set->files.data;
+	if (root == NULL)
+		return fi;
+	if (length == 0)
+		dir = root;
+	else
+		dir = razor_set_find_entry(set, root, fi->path.data);
+
+	if (dir && dir->start != 0) {
+		frame = array_add(&fi->stack, sizeof *frame);
+		frame->entry = root + dir->start;
+		frame->length = length;
+	}
+
+	return fi;
+}
+
+/**
+ * razor_file_iterator_next:
+ * @fi: a %razor_file_iterator
+ * @path: return location for the full path of the entry
+ * @entry: return location for the entry, or %NULL
+ * @owners: return location for an iterator over the packages owning
+ * the entry, or %NULL
+ *
+ * Step to the next file or directory.  The path and the owners
+ * iterator belong to @fi and are only valid until the next call.
+ *
+ * Returns: 0 when there are no more entries, 1 otherwise.
+ **/
+RAZOR_EXPORT int
+razor_file_iterator_next(struct razor_file_iterator *fi, const char **path,
+			 struct razor_entry **entry,
+			 struct razor_package_iterator **owners)
+{
+	struct razor_file_frame *frame;
+	struct razor_entry *e, *entries;
+	const char *pool, *name;
+	uint32_t length;
+	size_t name_length;
+	char *p;
+
+	assert (fi != NULL);
+	assert (path != NULL);
+
+	entries = fi->set->files.data;
+	pool = fi->set->file_string_pool.data;
+
+	while (fi->stack.size > 0) {
+		frame = fi->stack.data + fi->stack.size - sizeof *frame;
+		e = frame->entry;
+		length = frame->length;
+		if (e->flags & RAZOR_ENTRY_LAST)
+			fi->stack.size -= sizeof *frame;
+		else
+			frame->entry++;
+
+		name = &pool[e->name];
+		if (fi->pattern && fnmatch(fi->pattern, name, 0) != 0)
+			continue;
+
+		name_length = strlen(name);
+		fi->path.size = length;
+		p = array_add(&fi->path, name_length + 2);
+		p[0] = '/';
+		memcpy(p + 1, name, name_length + 1);
+
+		if (e->start != 0) {
+			frame = array_add(&fi->stack, sizeof *frame);
+			frame->entry = entries + e->start;
+			frame->length = length + name_length + 1;
+		}
+
+		*path = fi->path.data;
+		if (entry)
+			*entry = e;
+		if (owners) {
+			memset(&fi->owners, 0, sizeof fi->owners);
+			fi->owners.set = fi->set;
+			fi->owners.index = list_first(&e->packages,
+						      &fi->set->package_pool);
+			add_added_file_owners(&fi->owners, fi->set,
+					      fi->path.data);
+			*owners = &fi->owners;
+		}
+
+		return 1;
+	}
+
+	*path = NULL;
+
+	return 0;
+}
+
+RAZOR_EXPORT void
+razor_file_iterator_destroy(struct razor_file_iterator *fi)
+{
+	assert (fi != NULL);
 
+	array_release(&fi->stack);
+	array_release(&fi->path);
+	free(fi->pattern);
+	free(fi);
+}
+
+/**
+ * razor_package_query_create:
+ * @set: a %razor_set
+ *
+ * Create an empty query for the packages in @set.  A query is a set of
+ * packages, stored as a bitmap with one bit per package, that can be
+ * filled in from iterators and filters and combined with other queries
+ * on the same set.  A query on a layer only holds packages of its
+ * base; the added packages are skipped.
+ *
+ * Returns: the new %razor_package_query.
+ **/
 RAZOR_EXPORT struct razor_package_query *
 razor_package_query_create(struct razor_set *set)
 {
 	struct razor_package_query *pq;
-	int count;
 
 	assert (set != NULL);
 
 	pq = zalloc(sizeof *pq);
 	pq->set = set;
-	count = set->packages.size / sizeof(struct razor_package);
-	pq->vector = zalloc(count * sizeof(char));
+	pq->count = set->packages.size / sizeof(struct razor_package);
+	pq->bits = zalloc(BITSET_WORDS(pq->count) * sizeof *pq->bits);
 
 	return pq;
 }
@@ -261,8 +557,9 @@ razor_package_query_add_package(struct razor_package_query *pq,
 	assert (p != NULL);
 
 	packages = pq->set->packages.data;
-	pq->count += pq->vector[p - packages] ^ 1;
-	pq->vector[p - packages] = 1;
+	if (razor_set_package_owner(pq->set, p) == pq->set &&
+	    razor_set_package_visible(pq->set, p))
+		bitset_set(pq->bits, p - packages);
 }
 
 RAZOR_EXPORT void
@@ -275,43 +572,164 @@ razor_package_query_add_iterator(struct razor_package_query *pq,
 	assert (pi != NULL);
 
 	packages = pq->set->packages.data;
-	while (razor_package_iterator_next(pi, &p, RAZOR_DETAIL_LAST)) {
-		pq->count += pq->vector[p - packages] ^ 1;
-		pq->vector[p - packages] = 1;
-	}
+	while (razor_package_iterator_next(pi, &p, RAZOR_DETAIL_LAST))
+		if (razor_set_package_owner(pq->set, p) == pq->set)
+			bitset_set(pq->bits, p - packages);
 }
 
-RAZOR_EXPORT struct razor_package_iterator *
-razor_package_query_finish(struct razor_package_query *pq)
+/**
+ * razor_package_query_and:
+ * @pq: a %razor_package_query
+ * @other: another %razor_package_query for the same set
+ *
+ * Remove the packages that are not in @other from @pq.
+ **/
+RAZOR_EXPORT void
+razor_package_query_and(struct razor_package_query *pq,
+			struct razor_package_query *other)
 {
-	struct razor_package_iterator *pi;
-	struct razor_set *set;
-	struct list *index;
-	int i, j;
+	uint32_t i, words;
 
 	assert (pq != NULL);
+	assert (other != NULL);
+	assert (pq->set == other->set);
 
-	set = pq->set;
-	if (pq->count > 0)
-		index = zalloc(pq->count * sizeof *index);
-	else
-		index = NULL;
+	words = BITSET_WORDS(pq->count);
+	for (i = 0; i < words; i++)
+		pq->bits[i] &= other->bits[i];
+}
 
-	for (i = 0, j = 0; j < pq->count; i++) {
-		if (!pq->vector[i])
-			continue;
+/**
+ * razor_package_query_or:
+ * @pq: a %razor_package_query
+ * @other: another %razor_package_query for the same set
+ *
+ * Add the packages in @other to @pq.
+ **/
+RAZOR_EXPORT void
+razor_package_query_or(struct razor_package_query *pq,
+		       struct razor_package_query *other)
+{
+	uint32_t i, words;
+
+	assert (pq != NULL);
+	assert (other != NULL);
+	assert (pq->set == other->set);
+
+	words = BITSET_WORDS(pq->count);
+	for (i = 0; i < words; i++)
+		pq->bits[i] |= other->bits[i];
+}
+
+/**
+ * razor_package_query_andnot:
+ * @pq: a %razor_package_query
+ * @other: another %razor_package_query for the same set
+ *
+ * Remove the packages in @other from @pq.
+ **/
+RAZOR_EXPORT void
+razor_package_query_andnot(struct razor_package_query *pq,
+			   struct razor_package_query *other)
+{
+	uint32_t i, words;
+
+	assert (pq != NULL);
+	assert (other != NULL);
+	assert (pq->set == other->set);
+
+	words = BITSET_WORDS(pq->count);
+	for (i = 0; i < words; i++)
+		pq->bits[i] &= ~other->bits[i];
+}
+
+/**
+ * razor_package_query_count:
+ * @pq: a %razor_package_query
+ *
+ * Returns: the number of packages in @pq.
+ **/
+RAZOR_EXPORT int
+razor_package_query_count(struct razor_package_query *pq)
+{
+	uint32_t i, words;
+	int count;
+
+	assert (pq != NULL);
 
-		index[j].data = i;
-		if (j == pq->count - 1)
-			index[j].flags = 0x80;
-		j++;
+	count = 0;
+	words = BITSET_WORDS(pq->count);
+	for (i = 0; i < words; i++)
+		count += __builtin_popcountll(pq->bits[i]);
+
+	return count;
+}
+
+/**
+ * razor_package_query_next:
+ * @pq: a %razor_package_query
+ * @position: the iteration state, initialized to 0 by the caller
+ *
+ * Step through the packages in @pq in set order without allocating
+ * an iterator, for example:
+ *
+ *	uint32_t position = 0;
+ *	while ((package = razor_package_query_next(pq, &position)))
+ *		...
+ *
+ * Returns: the next package, or %NULL when there are no more.
+ **/
+RAZOR_EXPORT struct razor_package *
+razor_package_query_next(struct razor_package_query *pq, uint32_t *position)
+{
+	struct razor_package *packages;
+	uint32_t bit;
+
+	assert (pq != NULL);
+	assert (position != NULL);
+
+	bit = bitset_next(pq->bits, *position, pq->count);
+	if (bit >= pq->count) {
+		*position = pq->count;
+		return NULL;
 	}
 
-	free(pq->vector);
+	*position = bit + 1;
+	packages = pq->set->packages.data;
+
+	return &packages[bit];
+}
+
+RAZOR_EXPORT void
+razor_package_query_destroy(struct razor_package_query *pq)
+{
+	assert (pq != NULL);
+
+	free(pq->bits);
 	free(pq);
+}
+
+/**
+ * razor_package_query_finish:
+ * @pq: a %razor_package_query
+ *
+ * Turn the query into an iterator over its packages.  The iterator
+ * takes over the bitmap of the query, and @pq is freed.
+ *
+ * Returns: a %razor_package_iterator for the packages in @pq.
+ **/
+RAZOR_EXPORT struct razor_package_iterator *
+razor_package_query_finish(struct razor_package_query *pq)
+{
+	struct razor_package_iterator *pi;
+
+	assert (pq != NULL);
 
-	pi = razor_package_iterator_create_with_index(set, index);
-	pi->free_index = 1;
+	pi = zalloc(sizeof *pi);
+	pi->set = pq->set;
+	pi->bits = pq->bits;
+	pi->count = pq->count;
+	free(pq);
 
 	return pi;
 }
@@ -0,0 +1,701 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* A layer is a view of its base set whose package bitmap doubles as
+ * the tombstones of the removed packages, plus a small set of its own
+ * holding the added packages.  The base stays mapped and untouched;
+ * the added set is rebuilt with an importer on every change, which is
+ * cheap as long as it stays small, but makes adding n packages one at
+ * a time cost O(n^2).  Lookups by property or file consult both
+ * sets, and a property that both have is one property of the layer,
+ * the one of the base.  Compacting merges the two the
+ * same way a transaction does.  A delta file is just the added set
+ * with a tombstones section, which holds the number of packages in
+ * the base followed by a bitmap of the removed ones, and a delta base
+ * section with the digest of the packages of the base. */
+
+static void
+format_digest(const unsigned char *digest, char *hex)
+{
+	static const char digits[] = "0123456789abcdef";
+	int i;
+
+	for (i = 0; i < RAZOR_DIGEST_SIZE; i++) {
+		hex[2 * i] = digits[digest[i] >> 4];
+		hex[2 * i + 1] = digits[digest[i] & 15];
+	}
+	hex[2 * RAZOR_DIGEST_SIZE] = '\0';
+}
+
+static void
+import_files(struct razor_importer *importer,
+	     struct razor_set *set, struct razor_package *package)
+{
+	static const unsigned char zero[RAZOR_DIGEST_SIZE];
+	struct razor_file_details details;
+	struct razor_entry *entries;
+	struct array path, chain;
+	struct list *r;
+	uint32_t *parents;
+	const char *pool;
+	char hex[2 * RAZOR_DIGEST_SIZE + 1], *name;
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	r = razor_set_first_package_file(set, package);
+	if (r == NULL)
+		return;
+
+	entries = set->files.data;
+	parents = set->file_parents.data;
+	pool = set->file_string_pool.data;
+	if (set->file_parents.size / sizeof *parents !=
+	    set->files.size / sizeof *entries) {
+		fprintf(stderr, "no file parents in set, "
+			"not copying the package files\n");
+		return;
+	}
+
+	array_init(&path);
+	array_init(&chain);
+	name = array_add(&path, 1);
+	*name = '\0';
+
+	for (; r != NULL; r = list_next(r)) {
+		razor_set_get_dir_path(set, parents[r->data], &path, &chain);
+		if (asprintf(&name, "%s/%s", (char *) path.data,
+			     &pool[entries[r->data].name]) < 0)
+			continue;
+
+		if (razor_set_get_file_details(set, r->data, &details)) {
+			format_digest(details.digest, hex);
+			razor_importer_add_file_full(importer, name,
+						     details.size,
+						     details.mode,
+						     details.mtime,
+						     memcmp(details.digest, zero,
+							    sizeof zero) ?
+						     hex : NULL,
+						     details.flags);
+		} else {
+			razor_importer_add_file(importer, name);
+		}
+		free(name);
+	}
+
+	array_release(&path);
+	array_release(&chain);
+}
+
+static void
+import_package(struct razor_importer *importer,
+	       struct razor_set *set, struct razor_package *package)
+{
+	struct razor_property_iterator *pi;
+	struct razor_property *property;
+	const char *name, *version, *arch;
+	const char *summary, *description, *url, *license;
+	uint32_t flags;
+
+	razor_package_get_details(set, package,
+				  RAZOR_DETAIL_NAME, &name,
+				  RAZOR_DETAIL_VERSION, &version,
+				  RAZOR_DETAIL_ARCH, &arch,
+				  RAZOR_DETAIL_SUMMARY, &summary,
+				  RAZOR_DETAIL_DESCRIPTION, &description,
+				  RAZOR_DETAIL_URL, &url,
+				  RAZOR_DETAIL_LICENSE, &license,
+				  RAZOR_DETAIL_LAST);
+
+	razor_importer_begin_package(importer, name, version, arch);
+	razor_importer_add_details(importer,
+				   summary, description, url, license);
+
+	pi = razor_property_iterator_create(set, package);
+	while (razor_property_iterator_next(pi, &property,
+					    &name, &flags, &version))
+		razor_importer_add_property(importer, name, flags, version);
+	razor_property_iterator_destroy(pi);
+
+	import_files(importer, set, package);
+	razor_importer_finish_package(importer);
+}
+
+/* Rebuild the added packages of a layer, leaving out skip and adding
+ * package from set.  If the result is too big to index, the added
+ * packages are left as they were. */
+static int
+rebuild_added(struct razor_set_view *view, struct razor_package *skip,
+	      struct razor_set *set, struct razor_package *package)
+{
+	struct razor_importer *importer;
+	struct razor_package *p, *end;
+	struct razor_set *added;
+
+	importer = razor_importer_create();
+	added = view->added;
+	if (added) {
+		end = added->packages.data + added->packages.size;
+		for (p = added->packages.data; p < end; p++)
+			if (p != skip)
+				import_package(importer, added, p);
+	}
+	if (package)
+		import_package(importer, set, package);
+
+	view->added = razor_importer_finish(importer);
+	if (view->added == NULL) {
+		view->added = added;
+		return -1;
+	}
+
+	if (added)
+		razor_set_destroy(added);
+
+	return 0;
+}
+
+/* Hide a package of the base, and the properties only it had. */
+static void
+remove_base_package(struct razor_set *layer, uint32_t index)
+{
+	struct razor_set *base = layer->view->base;
+	struct razor_package *packages;
+	struct razor_property *properties;
+	struct list *r, *q;
+
+	packages = base->packages.data;
+	properties = base->properties.data;
+	bitset_clear(layer->view->packages, index);
+
+	r = list_first(&packages[index].properties, &base->property_pool);
+	for (; r != NULL; r = list_next(r)) {
+		q = list_first(&properties[r->data].packages,
+			       &base->package_pool);
+		while (q != NULL &&
+		       !bitset_test(layer->view->packages, q->data))
+			q = list_next(q);
+		if (q == NULL)
+			bitset_clear(layer->view->properties, r->data);
+	}
+}
+
+/**
+ * razor_set_create_layer:
+ * @base: the %razor_set to layer changes on
+ *
+ * Create a layer on top of @base that packages can be added to and
+ * removed from without touching @base, which typically stays mapped
+ * from its file.  Package and property iterators created for the
+ * layer return the packages of @base that haven't been removed merged
+ * by name with the added ones, and the owners of a property or file
+ * include the added packages that have it.  razor_set_diff(),
+ * razor_set_parallel_for_packages() and
+ * razor_set_parallel_for_properties() see the added packages too.
+ * Package queries, searches, razor_set_reverse_closure() and
+ * transactions only see what is left of @base until the layer is
+ * compacted with razor_set_compact().  Writing the layer with
+ * razor_set_write() writes the compacted set, or with
+ * %RAZOR_SECTION_DELTA only the changes, which
+ * razor_set_open_layer() reads back.  The layer must be destroyed
+ * before @base.
+ *
+ * Returns: the new layer, or %NULL if @base is a layer with packages
+ * added to it.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_create_layer(struct razor_set *base)
+{
+	assert (base != NULL);
+
+	if (base->view && base->view->added) {
+		fprintf(stderr, "can't layer on a set with added packages\n");
+		return NULL;
+	}
+
+	return razor_set_create_view(base, NULL, 0);
+}
+
+/**
+ * razor_set_add_package:
+ * @layer: a layer from razor_set_create_layer()
+ * @set: the %razor_set @package is from
+ * @package: the package to add
+ *
+ * Add a copy of @package with its details, properties and files to
+ * @layer.  Packages returned for the added part of @layer are only
+ * valid until @layer is next changed.  The added packages are
+ * imported again on every change, so this is meant for a few
+ * packages; to add many, import them into a set of their own and use
+ * razor_set_create_delta() or a %razor_merger.
+ *
+ * Returns: 0, or -1 if the added packages would have more properties
+ * or files than the library can index.
+ **/
+RAZOR_EXPORT int
+razor_set_add_package(struct razor_set *layer, struct razor_set *set,
+		      struct razor_package *package)
+{
+	assert (layer != NULL && layer->view != NULL);
+	assert (set != NULL);
+	assert (package != NULL);
+
+	return rebuild_added(layer->view, NULL,
+			     razor_set_package_owner(set, package), package);
+}
+
+/**
+ * razor_set_remove_package:
+ * @layer: a layer from razor_set_create_layer()
+ * @package: a package of @layer
+ *
+ * Remove @package from @layer.  Packages of the base are only hidden.
+ *
+ * Returns: 0, or -1 if @package isn't in @layer or the remaining added
+ * packages can't be rebuilt.
+ **/
+RAZOR_EXPORT int
+razor_set_remove_package(struct razor_set *layer,
+			 struct razor_package *package)
+{
+	struct razor_set *base;
+	struct razor_package *packages;
+	uint32_t index, count;
+
+	assert (layer != NULL && layer->view != NULL);
+	assert (package != NULL);
+
+	if (razor_set_package_owner(layer, package) != layer)
+		return rebuild_added(layer->view, package, NULL, NULL);
+
+	base = layer->view->base;
+	packages = base->packages.data;
+	count = base->packages.size / sizeof *packages;
+	index = package - packages;
+	if (package < packages || index >= count ||
+	    !bitset_test(layer->view->packages, index))
+		return -1;
+
+	remove_base_package(layer, index);
+
+	return 0;
+}
+
+/* Order properties of two sets the way the importer sorts them. */
+int
+razor_set_compare_properties(struct razor_set *set1,
+			     struct razor_property *p1,
+			     struct razor_set *set2,
+			     struct razor_property *p2)
+{
+	const char *pool1 = set1->string_pool.data;
+	const char *pool2 = set2->string_pool.data;
+	int cmp;
+
+	cmp = strcmp(&pool1[p1->name], &pool2[p2->name]);
+	if (cmp != 0)
+		return cmp;
+	if (p1->flags != p2->flags)
+		return p1->flags < p2->flags ? -1 : 1;
+
+	return razor_versioncmp(&pool1[p1->version], &pool2[p2->version]);
+}
+
+/* The property of set with the same name, flags and version as
+ * property, which belongs to other, or NULL. */
+struct razor_property *
+razor_set_find_same_property(struct razor_set *set, struct razor_set *other,
+			     struct razor_property *property)
+{
+	struct razor_property *properties;
+	uint32_t low, high, middle;
+	int cmp;
+
+	properties = set->properties.data;
+	low = 0;
+	high = set->properties.size / sizeof *properties;
+	while (low < high) {
+		middle = low + (high - low) / 2;
+		cmp = razor_set_compare_properties(set, &properties[middle],
+						   other, property);
+		if (cmp == 0)
+			return &properties[middle];
+		if (cmp < 0)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+
+	return NULL;
+}
+
+static int
+compare_layer_packages(struct razor_set *set1, struct razor_package *p1,
+		       struct razor_set *set2, struct razor_package *p2)
+{
+	const char *pool1 = set1->string_pool.data;
+	const char *pool2 = set2->string_pool.data;
+	int cmp;
+
+	cmp = strcmp(&pool1[p1->name], &pool2[p2->name]);
+	if (cmp != 0)
+		return cmp;
+
+	return razor_versioncmp(&pool1[p1->version], &pool2[p2->version]);
+}
+
+static int
+compare_layer_archs(struct razor_set *set1, struct razor_package *p1,
+		    struct razor_set *set2, struct razor_package *p2)
+{
+	const char *pool1 = set1->string_pool.data;
+	const char *pool2 = set2->string_pool.data;
+
+	return strcmp(&pool1[p1->arch], &pool2[p2->arch]);
+}
+
+/**
+ * razor_set_compact:
+ * @set: a layer or view
+ *
+ * Merge what is visible of @set into a new, standalone set: the
+ * packages of the base that weren't removed or filtered out, and any
+ * packages added to a layer.
+ *
+ * Returns: the new set, or %NULL if it has more packages, properties
+ * or files than the library can index.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_compact(struct razor_set *set)
+{
+	struct razor_merger *merger;
+	struct razor_set *base, *added, *empty, *compact;
+	struct razor_package *b, *bpkgs, *bend, *a, *aend;
+	int cmp;
+
+	assert (set != NULL && set->view != NULL);
+
+	base = set->view->base;
+	added = set->view->added;
+	empty = NULL;
+	if (added == NULL)
+		added = empty = razor_set_create();
+
+	bpkgs = base->packages.data;
+	bend = base->packages.data + base->packages.size;
+	a = added->packages.data;
+	aend = added->packages.data + added->packages.size;
+
+	merger = razor_merger_create(base, added);
+	for (b = bpkgs; b < bend || a < aend; ) {
+		if (b < bend && a < aend) {
+			cmp = compare_layer_packages(base, b, added, a);
+			if (cmp == 0)
+				cmp = compare_layer_archs(base, b, added, a);
+		} else if (b < bend)
+			cmp = -1;
+		else
+			cmp = 1;
+
+		if (cmp <= 0) {
+			if (bitset_test(set->view->packages, b - bpkgs))
+				razor_merger_add_package(merger, b);
+			b++;
+		} else {
+			razor_merger_add_package(merger, a);
+			a++;
+		}
+	}
+
+	/* The merger reads the properties and files of both sets
+	 * until it is finished. */
+	compact = razor_merger_finish(merger);
+	if (empty)
+		razor_set_destroy(empty);
+
+	return compact;
+}
+
+/* A digest of the names, versions and archs of the packages of a set
+ * in the order they are in.  Tombstones refer to packages by index,
+ * so this is what a delta needs to match its base, and it is the same
+ * for a set built by the importer and one the merger put together
+ * from the same packages. */
+void
+razor_set_digest_packages(struct razor_set *set, unsigned char *digest)
+{
+	struct razor_package *p, *end;
+	struct razor_md5 md5;
+	const char *pool;
+
+	pool = set->string_pool.data;
+	end = set->packages.data + set->packages.size;
+	razor_md5_init(&md5);
+	for (p = set->packages.data; p < end; p++) {
+		razor_md5_update(&md5, &pool[p->name],
+				 strlen(&pool[p->name]) + 1);
+		razor_md5_update(&md5, &pool[p->version],
+				 strlen(&pool[p->version]) + 1);
+		razor_md5_update(&md5, &pool[p->arch],
+				 strlen(&pool[p->arch]) + 1);
+	}
+	razor_md5_final(&md5, digest);
+}
+
+/* Write the added packages of a layer, the tombstones of the removed
+ * ones and the digest of the base. */
+int
+razor_set_write_delta_to_fd(struct razor_set *set, int fd,
+			    uint32_t section_mask)
+{
+	struct razor_set *added, *empty;
+	struct array tombstones, base, saved_tombstones, saved_base;
+	uint32_t *words, count, i;
+	void *digest;
+	int status;
+
+	added = set->view->added;
+	empty = NULL;
+	if (added == NULL)
+		added = empty = razor_set_create();
+
+	count = set->view->base->packages.size / sizeof (struct razor_package);
+	array_init(&tombstones);
+	words = array_add(&tombstones, (1 + (count + 31) / 32) * sizeof *words);
+	memset(words, 0, tombstones.size);
+	words[0] = count;
+	for (i = 0; i < count; i++)
+		if (!bitset_test(set->view->packages, i))
+			words[1 + i / 32] |= 1u << (i % 32);
+
+	array_init(&base);
+	digest = array_add(&base, RAZOR_DIGEST_SIZE);
+	razor_set_digest_packages(set->view->base, digest);
+
+	saved_tombstones = added->tombstones;
+	saved_base = added->delta_base;
+	added->tombstones = tombstones;
+	added->delta_base = base;
+	status = razor_set_write_to_fd(added, fd, section_mask);
+	added->tombstones = saved_tombstones;
+	added->delta_base = saved_base;
+	array_release(&tombstones);
+	array_release(&base);
+
+	if (empty)
+		razor_set_destroy(empty);
+
+	return status;
+}
+
+/**
+ * razor_set_open_layer:
+ * @base: the %razor_set the delta was written against
+ * @filename: a file written from a layer with %RAZOR_SECTION_DELTA
+ *
+ * Open a layer on top of @base with the changes in @filename.  The
+ * delta records a digest of the packages of the base it was written
+ * against and is only applied to a @base with the same packages in
+ * the same order.
+ *
+ * Returns: the layer, or %NULL if @filename can't be read or doesn't
+ * fit @base.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_open_layer(struct razor_set *base, const char *filename)
+{
+	struct razor_set *layer, *added;
+	unsigned char digest[RAZOR_DIGEST_SIZE];
+	uint32_t *words, count, i;
+
+	assert (base != NULL);
+	assert (filename != NULL);
+
+	added = razor_set_open(filename);
+	if (added == NULL)
+		return NULL;
+
+	count = base->packages.size / sizeof (struct razor_package);
+	words = added->tombstones.data;
+	razor_set_digest_packages(base, digest);
+	if (added->tombstones.size !=
+	    (1 + (count + 31) / 32) * sizeof *words || words[0] != count ||
+	    added->delta_base.size != sizeof digest ||
+	    memcmp(added->delta_base.data, digest, sizeof digest) != 0) {
+		fprintf(stderr, "%s is not a delta for this set\n", filename);
+		razor_set_destroy(added);
+		return NULL;
+	}
+
+	layer = razor_set_create_layer(base);
+	if (layer == NULL) {
+		razor_set_destroy(added);
+		return NULL;
+	}
+
+	for (i = 0; i < count; i++)
+		if ((words[1 + i / 32] >> (i % 32)) & 1 &&
+		    bitset_test(layer->view->packages, i))
+			remove_base_package(layer, i);
+
+	if (added->packages.size > 0)
+		layer->view->added = added;
+	else
+		razor_set_destroy(added);
+
+	return layer;
+}
+
+static int
+has_arch(struct razor_set *set, struct razor_package *package,
+	 struct razor_set *other, struct razor_package *begin,
+	 struct razor_package *end)
+{
+	struct razor_package *p;
+
+	for (p = begin; p < end; p++)
+		if (compare_layer_archs(set, package, other, p) == 0)
+			return 1;
+
+	return 0;
+}
+
+/**
+ * razor_set_create_delta:
+ * @old: the %razor_set to go from
+ * @new: the %razor_set to go to
+ *
+ * Create a layer on top of @old that removes the packages that aren't
+ * in @new and adds the ones that are only in @new, with their
+ * details, properties and files.  Packages are matched by name,
+ * version and arch.  Write the layer with %RAZOR_SECTION_DELTA to get
+ * a delta file for razor_set_apply_delta(), which only holds the
+ * strings, properties and files of the added packages.
+ *
+ * Returns: the new layer, or %NULL if the added packages have more
+ * properties or files than the library can index.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_create_delta(struct razor_set *old, struct razor_set *new)
+{
+	struct razor_importer *importer;
+	struct razor_set *layer, *added;
+	struct razor_package *packages, *p;
+	struct razor_package *o, *oend, *orun, *n, *nend, *nrun;
+	int cmp;
+
+	assert (old != NULL && old->view == NULL);
+	assert (new != NULL && new->view == NULL);
+
+	layer = razor_set_create_layer(old);
+	importer = razor_importer_create();
+
+	packages = old->packages.data;
+	o = packages;
+	oend = old->packages.data + old->packages.size;
+	n = new->packages.data;
+	nend = new->packages.data + new->packages.size;
+	while (o < oend || n < nend) {
+		if (o < oend && n < nend)
+			cmp = compare_layer_packages(old, o, new, n);
+		else if (o < oend)
+			cmp = -1;
+		else
+			cmp = 1;
+
+		if (cmp < 0) {
+			remove_base_package(layer, o++ - packages);
+			continue;
+		} else if (cmp > 0) {
+			import_package(importer, new, n++);
+			continue;
+		}
+
+		/* Sets from before packages were sorted by arch too
+		 * may have the archs of a name and version in any
+		 * order, so match them up. */
+		for (orun = o;
+		     orun < oend &&
+		     compare_layer_packages(old, orun, new, n) == 0; orun++)
+			;
+		for (nrun = n;
+		     nrun < nend &&
+		     compare_layer_packages(old, o, new, nrun) == 0; nrun++)
+			;
+		for (p = o; p < orun; p++)
+			if (!has_arch(old, p, new, n, nrun))
+				remove_base_package(layer, p - packages);
+		for (p = n; p < nrun; p++)
+			if (!has_arch(new, p, old, o, orun))
+				import_package(importer, new, p);
+		o = orun;
+		n = nrun;
+	}
+
+	added = razor_importer_finish(importer);
+	if (added == NULL) {
+		razor_set_destroy(layer);
+		return NULL;
+	}
+
+	if (added->packages.size > 0)
+		layer->view->added = added;
+	else
+		razor_set_destroy(added);
+
+	return layer;
+}
+
+/**
+ * razor_set_apply_delta:
+ * @old: the %razor_set the delta was created from
+ * @filename: a delta file written from razor_set_create_delta()
+ *
+ * Apply the delta in @filename to @old and merge the result into a
+ * new set.
+ *
+ * Returns: the new set, or %NULL if @filename can't be read, isn't
+ * a delta for @old or the result has more packages, properties or
+ * files than the library can index.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_apply_delta(struct razor_set *old, const char *filename)
+{
+	struct razor_set *layer, *set;
+
+	assert (old != NULL);
+	assert (filename != NULL);
+
+	layer = razor_set_open_layer(old, filename);
+	if (layer == NULL)
+		return NULL;
+
+	set = razor_set_compact(layer);
+	razor_set_destroy(layer);
+
+	return set;
+}
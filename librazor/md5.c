@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+
+#include "razor-internal.h"
+
+/* MD5 as described in RFC 1321, just enough to check the file digests
+ * rpm stores without pulling in a crypto library. */
+
+static const uint32_t md5_sines[64] = {
+	0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee,
+	0xf57c0faf, 0x4787c62a, 0xa8304613, 0xfd469501,
+	0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+	0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821,
+	0xf61e2562, 0xc040b340, 0x265e5a51, 0xe9b6c7aa,
+	0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+	0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed,
+	0xa9e3e905, 0xfcefa3f8, 0x676f02d9, 0x8d2a4c8a,
+	0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+	0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70,
+	0x289b7ec6, 0xeaa127fa, 0xd4ef3085, 0x04881d05,
+	0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+	0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039,
+	0x655b59c3, 0x8f0ccc92, 0xffeff47d, 0x85845dd1,
+	0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+	0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+};
+
+static const unsigned char md5_shifts[64] = {
+	7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+	5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20, 5, 9, 14, 20,
+	4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+	6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+};
+
+static void
+md5_block(uint32_t *state, const unsigned char *block)
+{
+	uint32_t a, b, c, d, f, t, x[16];
+	int i, g;
+
+	for (i = 0; i < 16; i++)
+		x[i] = block[i * 4] | block[i * 4 + 1] << 8 |
+			block[i * 4 + 2] << 16 | (uint32_t) block[i * 4 + 3] << 24;
+
+	a = state[0];
+	b = state[1];
+	c = state[2];
+	d = state[3];
+
+	for (i = 0; i < 64; i++) {
+		if (i < 16) {
+			f = (b & c) | (~b & d);
+			g = i;
+		} else if (i < 32) {
+			f = (d & b) | (~d & c);
+			g = (5 * i + 1) % 16;
+		} else if (i < 48) {
+			f = b ^ c ^ d;
+			g = (3 * i + 5) % 16;
+		} else {
+			f = c ^ (b | ~d);
+			g = (7 * i) % 16;
+		}
+
+		t = a + f + md5_sines[i] + x[g];
+		a = d;
+		d = c;
+		c = b;
+		b = b + (t << md5_shifts[i] | t >> (32 - md5_shifts[i]));
+	}
+
+	state[0] += a;
+	state[1] += b;
+	state[2] += c;
+	state[3] += d;
+}
+
+void
+razor_md5_init(struct razor_md5 *md5)
+{
+	md5->state[0] = 0x67452301;
+	md5->state[1] = 0xefcdab89;
+	md5->state[2] = 0x98badcfe;
+	md5->state[3] = 0x10325476;
+	md5->length = 0;
+}
+
+void
+razor_md5_update(struct razor_md5 *md5, const void *data, size_t size)
+{
+	const unsigned char *p = data;
+	size_t used, n;
+
+	used = md5->length % 64;
+	md5->length += size;
+
+	if (used > 0) {
+		n = 64 - used;
+		if (n > size)
+			n = size;
+		memcpy(md5->buffer + used, p, n);
+		p += n;
+		size -= n;
+		if (used + n < 64)
+			return;
+		md5_block(md5->state, md5->buffer);
+	}
+
+	for (; size >= 64; p += 64, size -= 64)
+		md5_block(md5->state, p);
+
+	memcpy(md5->buffer, p, size);
+}
+
+void
+razor_md5_final(struct razor_md5 *md5, unsigned char *digest)
+{
+	static const unsigned char padding[64] = { 0x80 };
+	unsigned char bits[8];
+	uint64_t length;
+	int i;
+
+	length = md5->length * 8;
+	for (i = 0; i < 8; i++)
+		bits[i] = length >> (i * 8);
+
+	razor_md5_update(md5, padding, 1 + (119 - md5->length % 64) % 64);
+	razor_md5_update(md5, bits, 8);
+
+	for (i = 0; i < 16; i++)
+		digest[i] = md5->state[i / 4] >> (i % 4 * 8);
+}
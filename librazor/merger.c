@@ -32,6 +32,8 @@ struct source {
 struct razor_merger {
 	struct razor_set *set;
 	struct hashtable table;
+	struct hashtable details_table;
+	struct hashtable file_table;
 	struct source source1;
 	struct source source2;
 };
@@ -43,9 +45,19 @@ razor_merger_create(struct razor_set *set1, struct razor_set *set2)
 	int count;
 	size_t size;
 
+	/* Merging needs all of both sets. */
+	razor_set_bind_lazy_sections(set1, RAZOR_SECTION_ALL);
+	razor_set_bind_lazy_sections(set2, RAZOR_SECTION_ALL);
+
 	merger = zalloc(sizeof *merger);
 	merger->set = razor_set_create();
 	hashtable_init(&merger->table, &merger->set->string_pool);
+	hashtable_init(&merger->details_table,
+		       &merger->set->details_string_pool);
+	hashtable_init(&merger->file_table, &merger->set->file_string_pool);
+
+	/* The root entry from razor_set_create() is named by offset 0. */
+	hashtable_tokenize(&merger->file_table, "");
 
 	merger->source1.set = set1;
 	count = set1->properties.size / sizeof (struct razor_property);
@@ -66,6 +78,14 @@ razor_merger_create(struct razor_set *set1, struct razor_set *set2)
 	return merger;
 }
 
+static uint32_t
+add_details(struct razor_merger *merger, struct source *source, uint32_t s)
+{
+	const char *pool = source->set->details_string_pool.data;
+
+	return hashtable_tokenize(&merger->details_table, pool ? &pool[s] : "");
+}
+
 void
 razor_merger_add_package(struct razor_merger *merger,
 			 struct razor_package *package)
@@ -95,6 +115,10 @@ razor_merger_add_package(struct razor_merger *merger,
 					&pool[package->version]);
 	p->arch = hashtable_tokenize(&merger->table,
 				     &pool[package->arch]);
+	p->summary = add_details(merger, source, package->summary);
+	p->description = add_details(merger, source, package->description);
+	p->url = add_details(merger, source, package->url);
+	p->license = add_details(merger, source, package->license);
 
 	p->properties = package->properties;
 	r = list_first(&package->properties, &source->set->property_pool);
@@ -104,7 +128,9 @@ razor_merger_add_package(struct razor_merger *merger,
 	}
 
 	p->files = package->files;
-	r = list_first(&package->files, &source->set->file_pool);
+	r = razor_set_first_package_file(source->set, package);
+	if (r == NULL)
+		list_set_empty(&p->files);
 	while (r) {
 		source->file_map[r->data] = 1;
 		r = list_next(r);
@@ -204,16 +230,31 @@ emit_properties(struct list_head *properties, struct array *source_pool,
 		p = list_next(p);
 	}
 
-	list_set_ptr(properties, r);
+	if (r == pool->size / sizeof *q)
+		list_set_empty(properties);
+	else
+		list_set_ptr(properties, r);
 }
 
 static uint32_t
-add_file(struct razor_merger *merger, const char *name)
+add_file(struct razor_merger *merger,
+	 struct razor_set *set, uint32_t entry, uint32_t dir)
 {
-	struct razor_entry *e;
+	struct razor_file_details details;
+	struct razor_entry *e, *source;
+	uint32_t *parent;
+	const char *pool;
+
+	source = (struct razor_entry *) set->files.data + entry;
+	pool = set->file_string_pool.data;
+	razor_set_get_file_details(set, entry, &details);
+	razor_set_add_file_details(merger->set, &details);
 
 	e = array_add(&merger->set->files, sizeof *e);
-	e->name = hashtable_tokenize(&merger->table, name);
+	parent = array_add(&merger->set->file_parents, sizeof *parent);
+	*parent = dir;
+	e->name = hashtable_tokenize(&merger->file_table,
+				     &pool[source->name]);
 	e->flags = 0;
 	e->start = 0;
 
@@ -304,7 +345,8 @@ merge_one_directory(struct razor_merger *merger, struct merge_directory *md)
 		if (cmp < 0) {
 			if (map1[e1 - root1]) {
 				map1[e1 - root1] = last =
-					add_file(merger, &pool1[e1->name]);
+					add_file(merger, set1, e1 - root1,
+						 md->merged);
 				if (e1->start) {
 					child_md = array_add(&merge_stack, sizeof (struct merge_directory));
 					child_md->merged = last;
@@ -317,7 +359,8 @@ merge_one_directory(struct razor_merger *merger, struct merge_directory *md)
 		} else if (cmp > 0) {
 			if (map2[e2 - root2]) {
 				map2[e2 - root2] = last =
-					add_file(merger, &pool2[e2->name]);
+					add_file(merger, set2, e2 - root2,
+						 md->merged);
 				if (e2->start) {
 					child_md = array_add(&merge_stack, sizeof (struct merge_directory));
 					child_md->merged = last;
@@ -329,7 +372,8 @@ merge_one_directory(struct razor_merger *merger, struct merge_directory *md)
 				e2 = NULL;
 		} else {
 			map1[e1 - root1] = map2[e2- root2] = last =
-				add_file(merger, &pool1[e1->name]);
+				add_file(merger, set1, e1 - root1,
+					 md->merged);
 			if (e1->start || e2->start) {
 				child_md = array_add(&merge_stack, sizeof (struct merge_directory));
 				child_md->merged = last;
@@ -359,6 +403,7 @@ merge_one_directory(struct razor_merger *merger, struct merge_directory *md)
 static void
 merge_files(struct razor_merger *merger)
 {
+	static const struct razor_file_details root_details;
 	struct razor_entry *root;
 	struct merge_directory md;
 	uint32_t *map1, *map2;
@@ -384,7 +429,13 @@ merge_files(struct razor_merger *merger)
 	} else
 		md.dir2 = 0;
 
+	/* The merged set has file details if either source has, with
+	 * zeroes for the files from the other one. */
+	razor_set_add_file_details(merger->set, &root_details);
 	merge_one_directory(merger, &md);
+	if (!razor_set_has_file_details(merger->source1.set) &&
+	    !razor_set_has_file_details(merger->source2.set))
+		razor_set_release_file_details(merger->set);
 }
 
 static void
@@ -403,7 +454,10 @@ emit_files(struct list_head *files, struct array *source_pool,
 		p = list_next(p);
 	}
 
-	list_set_ptr(files, r);
+	if (r == pool->size / sizeof *q)
+		list_set_empty(files);
+	else
+		list_set_ptr(files, r);
 }
 
 /* Rebuild property->packages maps.  We can't just remap these, as a
@@ -516,10 +570,23 @@ razor_merger_finish(struct razor_merger *merger)
 
 	rebuild_property_package_lists(merger->set);
 	rebuild_file_package_lists(merger->set);
+	razor_set_build_package_sizes(merger->set);
+
+	/* Carry over the optional indexes of the source sets. */
+	razor_set_build_indexes(merger->set,
+				razor_set_get_indexes(merger->source1.set) |
+				razor_set_get_indexes(merger->source2.set));
 
 	result = merger->set;
 	hashtable_release(&merger->table);
+	hashtable_release(&merger->details_table);
+	hashtable_release(&merger->file_table);
 	free(merger);
 
+	if (razor_set_check_limits(result) < 0) {
+		razor_set_destroy(result);
+		return NULL;
+	}
+
 	return result;
 }
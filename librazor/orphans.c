@@ -0,0 +1,377 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The install root is walked by a pool of threads taking directories
+ * from a shared stack.  Each directory is read with getdents64, its
+ * names sorted and merge-joined against the children of its entry in
+ * the file tree, which are sorted the same way.  Names on disk with no
+ * entry are orphans and aren't descended into.  Directories that are
+ * in the set but have no children listed, such as cache directories
+ * filled at run time, are taken to belong wholesale to their package
+ * and aren't read at all.  The walk stays on the file system of the
+ * directory it starts from. */
+
+#define ORPHAN_BUFFER_SIZE (32 * 1024)
+
+struct linux_dirent64 {
+	uint64_t d_ino;
+	int64_t d_off;
+	unsigned short d_reclen;
+	unsigned char d_type;
+	char d_name[];
+};
+
+struct orphan_task {
+	char *path;
+	uint32_t entry;
+	dev_t dev;
+};
+
+struct orphan_name {
+	uint32_t name;
+	uint32_t type;
+};
+
+struct orphan_work {
+	struct razor_set *set;
+	int root;
+	struct array tasks;
+	int active;
+	int count;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	razor_orphan_callback_t callback;
+	void *data;
+};
+
+static void
+report_orphan(struct orphan_work *work, const char *dir, const char *name)
+{
+	char *path;
+
+	if (asprintf(&path, "%s/%s", dir, name) < 0)
+		return;
+
+	pthread_mutex_lock(&work->mutex);
+	work->callback(path, work->data);
+	work->count++;
+	pthread_mutex_unlock(&work->mutex);
+
+	free(path);
+}
+
+static int
+compare_names(const void *p1, const void *p2, void *data)
+{
+	const struct orphan_name *n1 = p1, *n2 = p2;
+	const char *pool = data;
+
+	return strcmp(&pool[n1->name], &pool[n2->name]);
+}
+
+/* Read the names in a directory into names, with the strings in
+ * pool, sorted. */
+static int
+read_directory(int fd, struct array *names, struct array *pool)
+{
+	struct linux_dirent64 *d;
+	struct orphan_name *n;
+	char *buffer, *p;
+	long len, pos, length;
+
+	buffer = malloc(ORPHAN_BUFFER_SIZE);
+	while (len = syscall(SYS_getdents64, fd, buffer, ORPHAN_BUFFER_SIZE),
+	       len > 0) {
+		for (pos = 0; pos < len; pos += d->d_reclen) {
+			d = (struct linux_dirent64 *) (buffer + pos);
+			if (strcmp(d->d_name, ".") == 0 ||
+			    strcmp(d->d_name, "..") == 0)
+				continue;
+
+			length = strlen(d->d_name) + 1;
+			n = array_add(names, sizeof *n);
+			n->name = pool->size;
+			n->type = d->d_type;
+			p = array_add(pool, length);
+			memcpy(p, d->d_name, length);
+		}
+	}
+	free(buffer);
+
+	free(razor_qsort_with_data(names->data,
+				   names->size / sizeof *n, sizeof *n,
+				   compare_names, pool->data));
+
+	return len < 0 ? -1 : 0;
+}
+
+static void
+push_task(struct array *tasks, const char *dir, const char *name,
+	  uint32_t entry, dev_t dev)
+{
+	struct orphan_task *task;
+
+	task = array_add(tasks, sizeof *task);
+	if (asprintf(&task->path, "%s/%s", dir, name) < 0)
+		task->path = NULL;
+	task->entry = entry;
+	task->dev = dev;
+}
+
+static void
+walk_directory(struct orphan_work *work, struct orphan_task *task)
+{
+	struct razor_entry *entries, *e;
+	struct orphan_name *n, *end;
+	struct orphan_task *t, *tend;
+	void *p;
+	struct array names, pool, children;
+	const char *set_pool, *strings;
+	struct stat st;
+	int fd, cmp, is_dir;
+
+	fd = openat(work->root, task->path[0] ? task->path + 1 : ".",
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+	if (fd < 0)
+		return;
+	if (fstat(fd, &st) < 0 || st.st_dev != task->dev) {
+		close(fd);
+		return;
+	}
+
+	array_init(&names);
+	array_init(&pool);
+	array_init(&children);
+	read_directory(fd, &names, &pool);
+	strings = pool.data;
+
+	entries = work->set->files.data;
+	set_pool = work->set->file_string_pool.data;
+	e = &entries[entries[task->entry].start];
+	end = names.data + names.size;
+	for (n = names.data; n < end; n++) {
+		cmp = -1;
+		while (e != NULL) {
+			cmp = strcmp(&strings[n->name], &set_pool[e->name]);
+			if (cmp <= 0)
+				break;
+			e = (e->flags & RAZOR_ENTRY_LAST) ? NULL : e + 1;
+		}
+
+		if (cmp != 0) {
+			report_orphan(work, task->path, &strings[n->name]);
+			continue;
+		}
+
+		/* Only descend if the set lists files below this
+		 * name and it is a real directory, not a symlink. */
+		if (e->start != 0) {
+			if (n->type == DT_UNKNOWN)
+				is_dir = fstatat(fd, &strings[n->name], &st,
+						 AT_SYMLINK_NOFOLLOW) == 0 &&
+					S_ISDIR(st.st_mode);
+			else
+				is_dir = n->type == DT_DIR;
+			if (is_dir)
+				push_task(&children, task->path,
+					  &strings[n->name],
+					  e - entries, task->dev);
+		}
+	}
+	close(fd);
+
+	if (children.size > 0) {
+		pthread_mutex_lock(&work->mutex);
+		tend = children.data + children.size;
+		for (t = children.data; t < tend; t++) {
+			if (t->path == NULL)
+				continue;
+			p = array_add(&work->tasks, sizeof *t);
+			memcpy(p, t, sizeof *t);
+		}
+		pthread_cond_broadcast(&work->cond);
+		pthread_mutex_unlock(&work->mutex);
+	}
+
+	array_release(&names);
+	array_release(&pool);
+	array_release(&children);
+}
+
+static void *
+orphan_worker(void *data)
+{
+	struct orphan_work *work = data;
+	struct orphan_task task;
+
+	pthread_mutex_lock(&work->mutex);
+	while (1) {
+		while (work->tasks.size == 0 && work->active > 0)
+			pthread_cond_wait(&work->cond, &work->mutex);
+		if (work->tasks.size == 0)
+			break;
+
+		/* Taking the last task walks depth first, which keeps
+		 * the stack small. */
+		work->tasks.size -= sizeof task;
+		memcpy(&task, work->tasks.data + work->tasks.size,
+		       sizeof task);
+		work->active++;
+		pthread_mutex_unlock(&work->mutex);
+
+		walk_directory(work, &task);
+		free(task.path);
+
+		pthread_mutex_lock(&work->mutex);
+		work->active--;
+		if (work->active == 0 && work->tasks.size == 0)
+			pthread_cond_broadcast(&work->cond);
+	}
+	pthread_mutex_unlock(&work->mutex);
+
+	return NULL;
+}
+
+/**
+ * razor_set_find_orphans:
+ * @set: the %razor_set installed under @root
+ * @root: the install root
+ * @prefix: the directory to look for orphans in, such as "/usr"
+ * @nthreads: the number of threads to use, or 0 for one per cpu
+ * @callback: called for each file or directory no package owns
+ * @data: user data passed to @callback
+ *
+ * Walk @prefix under @root and report the files and directories that
+ * aren't in @set.  The contents of an orphaned directory aren't
+ * reported separately.  Directories a package owns without listing
+ * any files in them are assumed to be owned with all their contents
+ * and are skipped, and the walk doesn't cross into other file systems.
+ * Directories are read in parallel, so @callback is called in no
+ * particular order, but from one thread at a time.  Paths are relative
+ * to @root and start with a slash.
+ *
+ * Returns: the number of orphans found, or -1 if @root or @prefix
+ * can't be opened.
+ **/
+RAZOR_EXPORT int
+razor_set_find_orphans(struct razor_set *set, const char *root,
+		       const char *prefix, int nthreads,
+		       razor_orphan_callback_t callback, void *data)
+{
+	struct orphan_work work;
+	struct razor_entry *entries, *e;
+	struct orphan_task *task;
+	struct stat st;
+	pthread_t *threads;
+	const char *dir;
+	char *path, *p;
+	int i, started;
+
+	assert (set != NULL);
+	assert (root != NULL);
+	assert (prefix != NULL);
+	assert (callback != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	dir = *root ? root : "/";
+	work.root = open(dir, O_RDONLY | O_DIRECTORY);
+	if (work.root < 0) {
+		fprintf(stderr, "failed to open %s: %m\n", dir);
+		return -1;
+	}
+
+	/* Strip trailing slashes, so "/" becomes the root entry. */
+	path = strdup(prefix);
+	for (p = path + strlen(path); p > path && p[-1] == '/'; p--)
+		p[-1] = '\0';
+
+	if (fstatat(work.root, path[0] ? path + 1 : ".", &st, 0) < 0 ||
+	    !S_ISDIR(st.st_mode)) {
+		fprintf(stderr, "failed to open %s%s: %m\n",
+			root, path[0] ? path : "/");
+		free(path);
+		close(work.root);
+		return -1;
+	}
+
+	work.set = set;
+	work.count = 0;
+	work.active = 0;
+	work.callback = callback;
+	work.data = data;
+	array_init(&work.tasks);
+	pthread_mutex_init(&work.mutex, NULL);
+	pthread_cond_init(&work.cond, NULL);
+
+	entries = set->files.data;
+	if (path[0] == '\0')
+		e = entries;
+	else
+		e = razor_set_find_entry(set, entries, path);
+
+	if (e == NULL) {
+		callback(path, data);
+		work.count++;
+	} else if (e->start != 0) {
+		task = array_add(&work.tasks, sizeof *task);
+		task->path = strdup(path);
+		task->entry = e - entries;
+		task->dev = st.st_dev;
+	}
+	free(path);
+
+	nthreads = razor_parallel_threads(nthreads);
+	threads = malloc(nthreads * sizeof *threads);
+	started = 0;
+	for (i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[started], NULL,
+				   orphan_worker, &work) != 0)
+			break;
+		started++;
+	}
+
+	orphan_worker(&work);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	pthread_cond_destroy(&work.cond);
+	pthread_mutex_destroy(&work.mutex);
+	array_release(&work.tasks);
+	close(work.root);
+
+	return work.count;
+}
@@ -0,0 +1,573 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* An overlay is a stack of sets where a package name in a set hides
+ * every package of that name in the sets below it.  Nothing is merged
+ * up front: lookups binary search the packages of each layer from the
+ * top, and the iterators collect their results layer by layer,
+ * dropping packages whose name a higher layer has.  The effective set
+ * merges the layers pairwise from the bottom; when it is cached, the
+ * cache carries the fingerprint of each layer and is only used while
+ * they all still match. */
+
+struct razor_overlay {
+	struct array layers;
+};
+
+struct razor_overlay_result {
+	struct razor_set *set;
+	struct razor_package *package;
+};
+
+struct razor_overlay_iterator {
+	struct array results;
+	struct razor_overlay_result *next;
+};
+
+/**
+ * razor_overlay_create:
+ *
+ * Create an empty overlay stack.
+ *
+ * Returns: the new #razor_overlay.
+ **/
+RAZOR_EXPORT struct razor_overlay *
+razor_overlay_create(void)
+{
+	struct razor_overlay *overlay;
+
+	overlay = zalloc(sizeof *overlay);
+	array_init(&overlay->layers);
+
+	return overlay;
+}
+
+/**
+ * razor_overlay_push:
+ * @overlay: a %razor_overlay
+ * @set: the %razor_set to stack on top
+ *
+ * Stack @set on top of the layers already in @overlay, so that its
+ * packages hide the packages of the same name below.  @set must not
+ * be a view and stays owned by the caller; it must outlive @overlay.
+ **/
+RAZOR_EXPORT void
+razor_overlay_push(struct razor_overlay *overlay, struct razor_set *set)
+{
+	struct razor_set **layer;
+
+	assert (overlay != NULL);
+	assert (set != NULL && set->view == NULL);
+
+	layer = array_add(&overlay->layers, sizeof *layer);
+	*layer = set;
+}
+
+RAZOR_EXPORT void
+razor_overlay_destroy(struct razor_overlay *overlay)
+{
+	assert (overlay != NULL);
+
+	array_release(&overlay->layers);
+	free(overlay);
+}
+
+/* The first package called name in set, or NULL. */
+static struct razor_package *
+find_package(struct razor_set *set, const char *name)
+{
+	struct razor_package *packages;
+	const char *pool;
+	uint32_t lo, hi, mid;
+
+	packages = set->packages.data;
+	pool = set->string_pool.data;
+	lo = 0;
+	hi = set->packages.size / sizeof *packages;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (strcmp(&pool[packages[mid].name], name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (lo == set->packages.size / sizeof *packages ||
+	    strcmp(&pool[packages[lo].name], name) != 0)
+		return NULL;
+
+	return &packages[lo];
+}
+
+/* Whether a layer above the given one has a package called name. */
+static int
+is_shadowed(struct razor_overlay *overlay, int layer, const char *name)
+{
+	struct razor_set **layers;
+	int i, count;
+
+	layers = overlay->layers.data;
+	count = overlay->layers.size / sizeof *layers;
+	for (i = layer + 1; i < count; i++)
+		if (find_package(layers[i], name))
+			return 1;
+
+	return 0;
+}
+
+/**
+ * razor_overlay_get_package:
+ * @overlay: a %razor_overlay
+ * @name: a package name
+ * @package: returns the package
+ *
+ * Look up @name in the layers of @overlay from the top.
+ *
+ * Returns: the %razor_set of the topmost layer with a package called
+ * @name, with the first of them in @package, or %NULL if no layer has
+ * one.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_overlay_get_package(struct razor_overlay *overlay, const char *name,
+			  struct razor_package **package)
+{
+	struct razor_set **layers;
+	struct razor_package *p;
+	int i;
+
+	assert (overlay != NULL);
+	assert (name != NULL);
+	assert (package != NULL);
+
+	layers = overlay->layers.data;
+	for (i = overlay->layers.size / sizeof *layers - 1; i >= 0; i--) {
+		p = find_package(layers[i], name);
+		if (p) {
+			*package = p;
+			return layers[i];
+		}
+	}
+
+	return NULL;
+}
+
+static struct razor_overlay_iterator *
+iterator_create(void)
+{
+	struct razor_overlay_iterator *oi;
+
+	oi = zalloc(sizeof *oi);
+	array_init(&oi->results);
+
+	return oi;
+}
+
+static void
+add_result(struct razor_overlay_iterator *oi,
+	   struct razor_set *set, struct razor_package *package)
+{
+	struct razor_overlay_result *r;
+
+	r = array_add(&oi->results, sizeof *r);
+	r->set = set;
+	r->package = package;
+}
+
+static struct razor_overlay_iterator *
+iterator_finish(struct razor_overlay_iterator *oi)
+{
+	oi->next = oi->results.data;
+
+	return oi;
+}
+
+/**
+ * razor_overlay_iterator_create:
+ * @overlay: a %razor_overlay
+ *
+ * Create an iterator for the packages visible through @overlay,
+ * sorted by name.
+ *
+ * Returns: the new #razor_overlay_iterator.
+ **/
+RAZOR_EXPORT struct razor_overlay_iterator *
+razor_overlay_iterator_create(struct razor_overlay *overlay)
+{
+	struct razor_overlay_iterator *oi;
+	struct razor_set **layers;
+	struct razor_package **cursors, **ends, *p;
+	const char *pool, *name, *best;
+	int i, top, count;
+
+	assert (overlay != NULL);
+
+	layers = overlay->layers.data;
+	count = overlay->layers.size / sizeof *layers;
+	cursors = malloc(count * sizeof *cursors);
+	ends = malloc(count * sizeof *ends);
+	for (i = 0; i < count; i++) {
+		cursors[i] = layers[i]->packages.data;
+		ends[i] = layers[i]->packages.data + layers[i]->packages.size;
+	}
+
+	/* Merge the layers by name; of the layers that have the
+	 * smallest name, the topmost one provides the packages. */
+	oi = iterator_create();
+	while (1) {
+		best = NULL;
+		top = -1;
+		for (i = 0; i < count; i++) {
+			if (cursors[i] == ends[i])
+				continue;
+			pool = layers[i]->string_pool.data;
+			name = &pool[cursors[i]->name];
+			if (best == NULL || strcmp(name, best) <= 0) {
+				best = name;
+				top = i;
+			}
+		}
+		if (top < 0)
+			break;
+
+		for (i = 0; i < count; i++) {
+			pool = layers[i]->string_pool.data;
+			for (p = cursors[i];
+			     p < ends[i] && strcmp(&pool[p->name], best) == 0;
+			     p++)
+				if (i == top)
+					add_result(oi, layers[i], p);
+			cursors[i] = p;
+		}
+	}
+
+	free(cursors);
+	free(ends);
+
+	return iterator_finish(oi);
+}
+
+/**
+ * razor_overlay_iterator_create_for_property:
+ * @overlay: a %razor_overlay
+ * @name: a property name
+ * @type: the %razor_property_type of the property
+ *
+ * Create an iterator for the visible packages that have a property
+ * called @name of the given type, in any version.  Each layer is
+ * searched, from the top, and a package that has the property in
+ * several versions is returned once.
+ *
+ * Returns: the new #razor_overlay_iterator.
+ **/
+RAZOR_EXPORT struct razor_overlay_iterator *
+razor_overlay_iterator_create_for_property(struct razor_overlay *overlay,
+					   const char *name, uint32_t type)
+{
+	struct razor_overlay_iterator *oi;
+	struct razor_set **layers, *set;
+	struct razor_property *properties, *p, *end;
+	struct razor_package *packages;
+	struct list *r;
+	const char *pool;
+	uint64_t *seen;
+	uint32_t lo, hi, mid;
+	int i;
+
+	assert (overlay != NULL);
+	assert (name != NULL);
+
+	oi = iterator_create();
+	layers = overlay->layers.data;
+	for (i = overlay->layers.size / sizeof *layers - 1; i >= 0; i--) {
+		set = layers[i];
+		properties = set->properties.data;
+		end = set->properties.data + set->properties.size;
+		packages = set->packages.data;
+		pool = set->string_pool.data;
+		seen = zalloc(BITSET_WORDS(set->packages.size /
+					   sizeof *packages) * sizeof *seen);
+
+		lo = 0;
+		hi = end - properties;
+		while (lo < hi) {
+			mid = lo + (hi - lo) / 2;
+			if (strcmp(&pool[properties[mid].name], name) < 0)
+				lo = mid + 1;
+			else
+				hi = mid;
+		}
+
+		for (p = &properties[lo];
+		     p < end && strcmp(&pool[p->name], name) == 0; p++) {
+			if ((p->flags & RAZOR_PROPERTY_TYPE_MASK) != type)
+				continue;
+			r = list_first(&p->packages, &set->package_pool);
+			for (; r != NULL; r = list_next(r)) {
+				if (bitset_test(seen, r->data))
+					continue;
+				bitset_set(seen, r->data);
+				if (!is_shadowed(overlay, i,
+						 &pool[packages[r->data].name]))
+					add_result(oi, set, &packages[r->data]);
+			}
+		}
+		free(seen);
+	}
+
+	return iterator_finish(oi);
+}
+
+/**
+ * razor_overlay_iterator_create_for_file:
+ * @overlay: a %razor_overlay
+ * @filename: an absolute path
+ *
+ * Create an iterator for the visible packages that own @filename,
+ * from the top layer down.
+ *
+ * Returns: the new #razor_overlay_iterator.
+ **/
+RAZOR_EXPORT struct razor_overlay_iterator *
+razor_overlay_iterator_create_for_file(struct razor_overlay *overlay,
+				       const char *filename)
+{
+	struct razor_overlay_iterator *oi;
+	struct razor_package_iterator *pi;
+	struct razor_package *package;
+	struct razor_set **layers;
+	const char *name;
+	int i;
+
+	assert (overlay != NULL);
+	assert (filename != NULL);
+
+	oi = iterator_create();
+	layers = overlay->layers.data;
+	for (i = overlay->layers.size / sizeof *layers - 1; i >= 0; i--) {
+		pi = razor_package_iterator_create_for_file(layers[i],
+							    filename);
+		while (razor_package_iterator_next(pi, &package,
+						   RAZOR_DETAIL_NAME, &name,
+						   RAZOR_DETAIL_LAST))
+			if (!is_shadowed(overlay, i, name))
+				add_result(oi, layers[i], package);
+		razor_package_iterator_destroy(pi);
+	}
+
+	return iterator_finish(oi);
+}
+
+/**
+ * razor_overlay_iterator_next:
+ * @oi: a %razor_overlay_iterator
+ * @set: returns the layer the package is from
+ * @package: returns the package
+ *
+ * Get the next package and the %razor_set to look up its details in.
+ *
+ * Returns: 1 if there was a package, 0 at the end.
+ **/
+RAZOR_EXPORT int
+razor_overlay_iterator_next(struct razor_overlay_iterator *oi,
+			    struct razor_set **set,
+			    struct razor_package **package)
+{
+	assert (oi != NULL);
+	assert (set != NULL);
+	assert (package != NULL);
+
+	if ((void *) oi->next == oi->results.data + oi->results.size)
+		return 0;
+
+	*set = oi->next->set;
+	*package = oi->next->package;
+	oi->next++;
+
+	return 1;
+}
+
+RAZOR_EXPORT void
+razor_overlay_iterator_destroy(struct razor_overlay_iterator *oi)
+{
+	assert (oi != NULL);
+
+	array_release(&oi->results);
+	free(oi);
+}
+
+/* Merge top over bottom, leaving out the packages of bottom whose
+ * name top has. */
+static struct razor_set *
+merge_layer(struct razor_set *bottom, struct razor_set *top)
+{
+	struct razor_merger *merger;
+	struct razor_package *b, *bend, *t, *tend;
+	const char *bpool, *tpool;
+	uint32_t name;
+	int cmp;
+
+	bpool = bottom->string_pool.data;
+	tpool = top->string_pool.data;
+	b = bottom->packages.data;
+	bend = bottom->packages.data + bottom->packages.size;
+	t = top->packages.data;
+	tend = top->packages.data + top->packages.size;
+
+	merger = razor_merger_create(bottom, top);
+	while (b < bend || t < tend) {
+		if (b < bend && t < tend)
+			cmp = strcmp(&bpool[b->name], &tpool[t->name]);
+		else if (b < bend)
+			cmp = -1;
+		else
+			cmp = 1;
+
+		if (cmp < 0) {
+			razor_merger_add_package(merger, b++);
+			continue;
+		}
+
+		if (cmp == 0)
+			for (name = b->name; b < bend && b->name == name; b++)
+				;
+		for (name = t->name; t < tend && t->name == name; t++)
+			razor_merger_add_package(merger, t);
+	}
+
+	return razor_merger_finish(merger);
+}
+
+static int
+digest_layers(struct razor_overlay *overlay, struct array *stamps)
+{
+	struct razor_set **layers;
+	unsigned char *fingerprint;
+	int i, count, status;
+
+	layers = overlay->layers.data;
+	count = overlay->layers.size / sizeof *layers;
+	status = 0;
+	for (i = 0; i < count; i++) {
+		fingerprint = array_add(stamps, RAZOR_FINGERPRINT_SIZE);
+		if (razor_set_get_fingerprint(layers[i], fingerprint) < 0)
+			status = -1;
+	}
+
+	return status;
+}
+
+static void
+write_cache(struct razor_set *set, const char *cache)
+{
+	char *tmp;
+
+	if (asprintf(&tmp, "%s.tmp", cache) < 0)
+		return;
+
+	if (razor_set_write(set, tmp, RAZOR_SECTION_ALL) < 0 ||
+	    rename(tmp, cache) < 0) {
+		fprintf(stderr, "failed to cache overlay in %s: %m\n", cache);
+		unlink(tmp);
+	}
+
+	free(tmp);
+}
+
+/**
+ * razor_overlay_get_effective_set:
+ * @overlay: a %razor_overlay with at least one layer
+ * @cache: a file to cache the effective set in, or %NULL
+ *
+ * Merge the layers of @overlay into one set holding the packages
+ * visible through it.  If @cache is given and holds the effective set
+ * of the same layers, it is opened instead; otherwise the merged set
+ * is written to it for next time.  The layers are compared by their
+ * fingerprints, so a cache is never used after a layer changed,
+ * whatever the file times say.
+ *
+ * Returns: the effective set, or %NULL if it has more packages,
+ * properties or files than the library can index.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_overlay_get_effective_set(struct razor_overlay *overlay,
+				const char *cache)
+{
+	struct razor_set **layers, *set, *next, *empty;
+	struct array stamps;
+	int i, count;
+
+	assert (overlay != NULL);
+	assert (overlay->layers.size > 0);
+
+	/* Without the fingerprints of all the layers, a cache can't
+	 * be told apart from one of other layers. */
+	array_init(&stamps);
+	if (digest_layers(overlay, &stamps) < 0)
+		cache = NULL;
+
+	if (cache && access(cache, R_OK) == 0) {
+		set = razor_set_open(cache);
+		if (set && set->overlay_stamps.size == stamps.size &&
+		    memcmp(set->overlay_stamps.data,
+			   stamps.data, stamps.size) == 0) {
+			array_release(&stamps);
+			return set;
+		}
+		if (set)
+			razor_set_destroy(set);
+	}
+
+	/* A lone layer is merged with an empty set to get a copy. */
+	layers = overlay->layers.data;
+	count = overlay->layers.size / sizeof *layers;
+	if (count == 1) {
+		empty = razor_set_create();
+		set = merge_layer(empty, layers[0]);
+		razor_set_destroy(empty);
+	} else {
+		set = merge_layer(layers[0], layers[1]);
+		for (i = 2; i < count && set != NULL; i++) {
+			next = merge_layer(set, layers[i]);
+			razor_set_destroy(set);
+			set = next;
+		}
+	}
+
+	if (set == NULL) {
+		array_release(&stamps);
+		return NULL;
+	}
+
+	set->overlay_stamps = stamps;
+	if (cache)
+		write_cache(set, cache);
+
+	return set;
+}
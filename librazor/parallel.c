@@ -0,0 +1,233 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* Items are handed out in chunks from a shared counter, so threads
+ * that finish early keep taking work from the rest of the range
+ * instead of idling while a slow thread finishes a fixed slice.  The
+ * chunks are small enough that each thread gets several of them. */
+#define PARALLEL_CHUNK_SIZE 256
+#define PARALLEL_CHUNKS_PER_THREAD 4
+
+struct parallel_work {
+	uint32_t count;
+	uint32_t chunk;
+	uint32_t next;
+	razor_parallel_func_t func;
+	void *data;
+};
+
+static void *
+parallel_worker(void *data)
+{
+	struct parallel_work *work = data;
+	uint32_t start, end;
+
+	while (1) {
+		start = __sync_fetch_and_add(&work->next, work->chunk);
+		if (start >= work->count)
+			break;
+		end = start + work->chunk;
+		if (end > work->count)
+			end = work->count;
+		work->func(start, end, work->data);
+	}
+
+	return NULL;
+}
+
+int
+razor_parallel_threads(int nthreads)
+{
+	long online;
+
+	if (nthreads > 0)
+		return nthreads;
+
+	online = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return online > 0 ? online : 1;
+}
+
+/* Call func for consecutive ranges covering [0, count) from up to
+ * nthreads threads, including the calling thread.  If nthreads is 0
+ * or less, one thread per online cpu is used.  Returns once all
+ * ranges are done. */
+void
+razor_parallel_for(uint32_t count, int nthreads,
+		   razor_parallel_func_t func, void *data)
+{
+	struct parallel_work work;
+	pthread_t *threads;
+	int i, started;
+
+	work.count = count;
+	work.next = 0;
+	work.func = func;
+	work.data = data;
+
+	nthreads = razor_parallel_threads(nthreads);
+	if (nthreads > count)
+		nthreads = count;
+
+	work.chunk = count / (nthreads * PARALLEL_CHUNKS_PER_THREAD + 1);
+	if (work.chunk > PARALLEL_CHUNK_SIZE)
+		work.chunk = PARALLEL_CHUNK_SIZE;
+	if (work.chunk == 0)
+		work.chunk = 1;
+
+	/* If a thread can't be created, the threads that did start
+	 * and the calling thread pick up its share. */
+	threads = malloc(nthreads * sizeof *threads);
+	started = 0;
+	for (i = 1; i < nthreads; i++) {
+		if (pthread_create(&threads[started], NULL,
+				   parallel_worker, &work) != 0)
+			break;
+		started++;
+	}
+
+	parallel_worker(&work);
+
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+}
+
+struct package_work {
+	struct razor_set *set;
+	struct razor_package *packages;
+	razor_package_callback_t callback;
+	void *data;
+};
+
+static void
+package_range(uint32_t start, uint32_t end, void *data)
+{
+	struct package_work *work = data;
+	uint32_t i;
+
+	for (i = start; i < end; i++)
+		if (razor_set_package_visible(work->set, &work->packages[i]))
+			work->callback(&work->packages[i], work->data);
+}
+
+/**
+ * razor_set_parallel_for_packages:
+ * @set: a %razor_set
+ * @callback: called once for each package in @set
+ * @data: user data passed to @callback
+ * @nthreads: the number of threads to use, or 0 for one per cpu
+ *
+ * Call @callback for every package in @set, spreading the packages
+ * over @nthreads threads.  For a layer, the packages added to it are
+ * visited along with what is left of its base.  The callback is called concurrently from
+ * several threads and in no particular order, so any state it updates
+ * through @data must be protected by the caller.  Reading the set from
+ * the callback is safe, see the thread safety notes for %razor_set.
+ * Returns when all packages have been visited.
+ **/
+RAZOR_EXPORT void
+razor_set_parallel_for_packages(struct razor_set *set,
+				razor_package_callback_t callback,
+				void *data, int nthreads)
+{
+	struct package_work work;
+
+	assert (set != NULL);
+	assert (callback != NULL);
+
+	work.set = set;
+	work.packages = set->packages.data;
+	work.callback = callback;
+	work.data = data;
+	razor_parallel_for(set->packages.size / sizeof *work.packages,
+			   nthreads, package_range, &work);
+
+	/* The packages added to a layer are in a set of their own. */
+	if (set->view && set->view->added) {
+		work.set = set->view->added;
+		work.packages = work.set->packages.data;
+		razor_parallel_for(work.set->packages.size /
+				   sizeof *work.packages,
+				   nthreads, package_range, &work);
+	}
+}
+
+struct property_work {
+	struct razor_set *set;
+	struct razor_property *properties;
+	razor_property_callback_t callback;
+	void *data;
+};
+
+static void
+property_range(uint32_t start, uint32_t end, void *data)
+{
+	struct property_work *work = data;
+	uint32_t i;
+
+	for (i = start; i < end; i++)
+		if (razor_set_property_visible(work->set,
+					       &work->properties[i]))
+			work->callback(&work->properties[i], work->data);
+}
+
+/**
+ * razor_set_parallel_for_properties:
+ * @set: a %razor_set
+ * @callback: called once for each property in @set
+ * @data: user data passed to @callback
+ * @nthreads: the number of threads to use, or 0 for one per cpu
+ *
+ * Like razor_set_parallel_for_packages(), but for the properties of
+ * @set.
+ **/
+RAZOR_EXPORT void
+razor_set_parallel_for_properties(struct razor_set *set,
+				  razor_property_callback_t callback,
+				  void *data, int nthreads)
+{
+	struct property_work work;
+
+	assert (set != NULL);
+	assert (callback != NULL);
+
+	work.set = set;
+	work.properties = set->properties.data;
+	work.callback = callback;
+	work.data = data;
+	razor_parallel_for(set->properties.size / sizeof *work.properties,
+			   nthreads, property_range, &work);
+
+	if (set->view && set->view->added) {
+		work.set = set->view->added;
+		work.properties = work.set->properties.data;
+		razor_parallel_for(work.set->properties.size /
+				   sizeof *work.properties,
+				   nthreads, property_range, &work);
+	}
+}
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <string.h>
+#include <fnmatch.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+struct version_predicate {
+	uint32_t relation;
+	char *version;
+};
+
+struct razor_package_filter {
+	char *pattern;
+	char *prefix;
+	int prefix_length;
+	int literal;
+	char *arch;
+	struct array versions;
+};
+
+/**
+ * razor_package_filter_create:
+ * @pattern: a glob pattern for the package name or %NULL
+ *
+ * Compile a package name pattern into a %razor_package_filter.  The
+ * literal part of the pattern up to the first wildcard is used to
+ * binary search the name sorted package array of a set, so a pattern
+ * such as "gnome-*" only looks at the packages that start with
+ * "gnome-".  A %NULL pattern matches all package names.
+ *
+ * Returns: the new %razor_package_filter.
+ **/
+RAZOR_EXPORT struct razor_package_filter *
+razor_package_filter_create(const char *pattern)
+{
+	struct razor_package_filter *filter;
+
+	filter = zalloc(sizeof *filter);
+	if (pattern == NULL)
+		pattern = "*";
+
+	filter->pattern = strdup(pattern);
+	filter->prefix_length = strcspn(pattern, "*?[\\");
+	filter->prefix = strndup(pattern, filter->prefix_length);
+	filter->literal = pattern[filter->prefix_length] == '\0';
+
+	return filter;
+}
+
+/**
+ * razor_package_filter_set_arch:
+ * @filter: the %razor_package_filter
+ * @arch: a glob pattern for the package architecture or %NULL
+ *
+ * Restrict the filter to packages whose architecture matches @arch.
+ **/
+RAZOR_EXPORT void
+razor_package_filter_set_arch(struct razor_package_filter *filter,
+			      const char *arch)
+{
+	assert (filter != NULL);
+
+	free(filter->arch);
+	filter->arch = arch ? strdup(arch) : NULL;
+}
+
+/**
+ * razor_package_filter_add_version:
+ * @filter: the %razor_package_filter
+ * @relation: a combination of %RAZOR_PROPERTY_LESS,
+ * %RAZOR_PROPERTY_GREATER and %RAZOR_PROPERTY_EQUAL
+ * @version: the version to compare against
+ *
+ * Restrict the filter to packages whose version compares to @version
+ * as given by @relation.  Calling this twice gives a version range,
+ * for example ">= 2.0" and "< 3.0".
+ **/
+RAZOR_EXPORT void
+razor_package_filter_add_version(struct razor_package_filter *filter,
+				 uint32_t relation, const char *version)
+{
+	struct version_predicate *v;
+
+	assert (filter != NULL);
+	assert (version != NULL);
+
+	v = array_add(&filter->versions, sizeof *v);
+	v->relation = relation & RAZOR_PROPERTY_RELATION_MASK;
+	v->version = strdup(version);
+}
+
+RAZOR_EXPORT void
+razor_package_filter_destroy(struct razor_package_filter *filter)
+{
+	struct version_predicate *v, *end;
+
+	assert (filter != NULL);
+
+	end = filter->versions.data + filter->versions.size;
+	for (v = filter->versions.data; v < end; v++)
+		free(v->version);
+	array_release(&filter->versions);
+	free(filter->pattern);
+	free(filter->prefix);
+	free(filter->arch);
+	free(filter);
+}
+
+static int
+match_version(struct razor_package_filter *filter, const char *version)
+{
+	struct version_predicate *v, *end;
+	int cmp;
+
+	end = filter->versions.data + filter->versions.size;
+	for (v = filter->versions.data; v < end; v++) {
+		cmp = razor_versioncmp(version, v->version);
+		if (cmp < 0 && !(v->relation & RAZOR_PROPERTY_LESS))
+			return 0;
+		if (cmp == 0 && !(v->relation & RAZOR_PROPERTY_EQUAL))
+			return 0;
+		if (cmp > 0 && !(v->relation & RAZOR_PROPERTY_GREATER))
+			return 0;
+	}
+
+	return 1;
+}
+
+/* Match everything but the name prefix, which the caller has already
+ * checked. */
+static int
+match_package(struct razor_package_filter *filter,
+	      const char *pool, struct razor_package *package)
+{
+	const char *name = &pool[package->name];
+
+	if (filter->literal) {
+		if (name[filter->prefix_length] != '\0')
+			return 0;
+	} else if (fnmatch(filter->pattern, name, 0) != 0)
+		return 0;
+
+	if (filter->arch && fnmatch(filter->arch, &pool[package->arch], 0) != 0)
+		return 0;
+
+	return match_version(filter, &pool[package->version]);
+}
+
+RAZOR_EXPORT int
+razor_package_filter_match(struct razor_package_filter *filter,
+			   struct razor_set *set,
+			   struct razor_package *package)
+{
+	const char *pool;
+
+	assert (filter != NULL);
+	assert (set != NULL);
+	assert (package != NULL);
+
+	pool = set->string_pool.data;
+	if (strncmp(&pool[package->name],
+		    filter->prefix, filter->prefix_length) != 0)
+		return 0;
+
+	return match_package(filter, pool, package);
+}
+
+/**
+ * razor_package_query_add_filter:
+ * @pq: a %razor_package_query
+ * @filter: the %razor_package_filter to run
+ *
+ * Add all packages in the query set that match @filter to the query.
+ *
+ * Returns: the number of matching packages.
+ **/
+RAZOR_EXPORT int
+razor_package_query_add_filter(struct razor_package_query *pq,
+			       struct razor_package_filter *filter)
+{
+	struct razor_package *packages;
+	const char *pool, *name;
+	int lo, hi, mid, count, matches;
+
+	assert (pq != NULL);
+	assert (filter != NULL);
+
+	packages = pq->set->packages.data;
+	count = pq->set->packages.size / sizeof *packages;
+	pool = pq->set->string_pool.data;
+
+	/* Find the first package whose name is not less than the
+	 * literal prefix; all candidates follow it. */
+	lo = 0;
+	hi = count;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (strcmp(&pool[packages[mid].name], filter->prefix) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	matches = 0;
+	for (; lo < count; lo++) {
+		name = &pool[packages[lo].name];
+		if (strncmp(name, filter->prefix, filter->prefix_length) != 0)
+			break;
+		if (filter->literal && name[filter->prefix_length] != '\0')
+			break;
+		if (!razor_set_package_visible(pq->set, &packages[lo]) ||
+		    !match_package(filter, pool, &packages[lo]))
+			continue;
+
+		razor_package_query_add_package(pq, &packages[lo]);
+		matches++;
+	}
+
+	return matches;
+}
@@ -48,6 +48,28 @@ void array_release(struct array *array);
 void *array_add(struct array *array, int size);
 
 
+/* List heads, list items, and the names of packages and file entries
+ * are 24-bit indices packed in a word with 8 bits of flags, which caps
+ * the pools and string pools they index at 16M.  A library built with
+ * RAZOR_WIDE_INDEX gives them a word of their own instead; it reads
+ * either kind of file, see bind_section().  The size of a struct
+ * array is an int, so in that build the real limit is 2 GiB for each
+ * pool and string pool, and no index can reach RAZOR_INDEX_LIMIT. */
+#ifdef RAZOR_WIDE_INDEX
+#define RAZOR_INDEX_LIMIT	0xffffffffu
+
+struct list_head {
+	uint32_t list_ptr;
+	uint32_t flags;
+};
+
+struct list {
+	uint32_t data;
+	uint32_t flags;
+};
+#else
+#define RAZOR_INDEX_LIMIT	0x00ffffffu
+
 struct list_head {
 	uint32_t list_ptr : 24;
 	uint32_t flags    : 8;
@@ -57,6 +79,7 @@ struct list {
 	uint32_t data  : 24;
 	uint32_t flags : 8;
 };
+#endif
 
 void list_set_empty(struct list_head *head);
 void list_set_ptr(struct list_head *head, uint32_t ptr);
@@ -81,36 +104,107 @@ uint32_t hashtable_lookup(struct hashtable *table, const char *key);
 uint32_t hashtable_tokenize(struct hashtable *table, const char *string);
 
 
+/* The header and section entries of a version 2 file are little
+ * endian, and the header gives the size of itself and of each section
+ * entry, so fields added to either later are skipped by older readers.
+ * Version 1 files are in host byte order and have only the first three
+ * fields of each.  The hash of a section is that of its data as
+ * written, before it is deflated; the fingerprint in the header is
+ * that of the whole set, even if only some of its sections are in the
+ * file. */
+#define RAZOR_HASH_SIZE	16
+
 struct razor_set_section {
 	uint32_t name;
 	uint32_t offset;
 	uint32_t size;
+	uint32_t flags;
+	uint32_t data_size;
+	uint32_t element_size;
+	uint32_t version;
+	unsigned char hash[RAZOR_HASH_SIZE];
 };
 
+#define RAZOR_SECTION_ENTRY_SIZE_V1	12
+#define RAZOR_SECTION_DEFLATED		0x01
+#define RAZOR_SECTION_ALIGNMENT		64
+#define RAZOR_HUGE_PAGE_SIZE		(2 << 20)
+
 struct razor_set_header {
 	uint32_t magic;
 	uint32_t version;
 	uint32_t num_sections;
+	uint32_t header_size;
+	uint32_t section_size;
+	unsigned char fingerprint[RAZOR_HASH_SIZE];
 };
 
+#define RAZOR_HEADER_SIZE_V1	12
+
 #define RAZOR_MAGIC 	0x525a4442
-#define RAZOR_VERSION	1
+#define RAZOR_VERSION	2
+
+/* Load or store a 32-bit word in the given byte order. */
+static inline uint32_t
+load32(const void *p, int big)
+{
+	const unsigned char *b = p;
+
+	if (big)
+		return (uint32_t) b[0] << 24 | b[1] << 16 | b[2] << 8 | b[3];
+	else
+		return (uint32_t) b[3] << 24 | b[2] << 16 | b[1] << 8 | b[0];
+}
+
+static inline void
+store32(void *p, uint32_t v, int big)
+{
+	unsigned char *b = p;
+	int i;
+
+	for (i = 0; i < 4; i++)
+		b[big ? 3 - i : i] = v >> (i * 8);
+}
 
 #define RAZOR_STRING_POOL		"string_pool"
 #define RAZOR_PACKAGES			"packages"
 #define RAZOR_PROPERTIES		"properties"
 #define RAZOR_PACKAGE_POOL		"package_pool"
 #define RAZOR_PROPERTY_POOL		"property_pool"
+#define RAZOR_REQUIRES_GRAPH		"requires_graph"
+#define RAZOR_REQUIRED_BY_GRAPH		"required_by_graph"
 
 #define RAZOR_DETAILS_STRING_POOL	"details_string_pool"
 
+#define RAZOR_SEARCH_TRIGRAMS		"search_trigrams"
+#define RAZOR_SEARCH_POSTINGS		"search_postings"
+
 #define RAZOR_FILES			"files"
 #define RAZOR_FILE_POOL			"file_pool"
 #define RAZOR_FILE_STRING_POOL		"file_string_pool"
+#define RAZOR_FILE_HASH			"file_hash"
+#define RAZOR_FILE_PARENTS		"file_parents"
+#define RAZOR_BASENAMES			"basenames"
+#define RAZOR_BASENAME_ENTRIES		"basename_entries"
+#define RAZOR_FILE_SIZES		"file_sizes"
+#define RAZOR_FILE_MODES		"file_modes"
+#define RAZOR_FILE_MTIMES		"file_mtimes"
+#define RAZOR_FILE_DIGESTS		"file_digests"
+#define RAZOR_FILE_FLAGS		"file_flags"
+#define RAZOR_PACKAGE_SIZES		"package_sizes"
+
+#define RAZOR_TOMBSTONES		"tombstones"
+#define RAZOR_DELTA_BASE		"delta_base"
+#define RAZOR_OVERLAY_STAMPS		"overlay_stamps"
 
 struct razor_package {
+#ifdef RAZOR_WIDE_INDEX
+	uint32_t name;
+	uint32_t flags;
+#else
 	uint name  : 24;
 	uint flags : 8;
+#endif
 	uint32_t version;
 	uint32_t arch;
 	uint32_t summary;
@@ -130,14 +224,41 @@ struct razor_property {
 };
 
 struct razor_entry {
+#ifdef RAZOR_WIDE_INDEX
+	uint32_t name;
+	uint32_t flags;
+#else
 	uint32_t name  : 24;
 	uint32_t flags : 8;
+#endif
 	uint32_t start;
 	struct list_head packages;
 };
 
 #define RAZOR_ENTRY_LAST	0x80
 
+struct razor_trigram {
+	uint32_t trigram;
+	uint32_t postings;
+};
+
+/* A slot in the file hash table.  The 64-bit hash of the full path is
+ * split in two words to keep the slot 4-byte aligned; an entry of 0
+ * (the root directory) marks an empty slot. */
+struct razor_file_slot {
+	uint32_t hash_low;
+	uint32_t hash_high;
+	uint32_t entry;
+};
+
+/* A name in the basename index and the run of entries in the
+ * basename entries section that have it. */
+struct razor_basename {
+	uint32_t name;
+	uint32_t entries;
+	uint32_t count;
+};
+
 struct razor_set {
 	struct array string_pool;
  	struct array packages;
@@ -148,18 +269,67 @@ struct razor_set {
  	struct array file_pool;
 	struct array file_string_pool;
 	struct array details_string_pool;
+	struct array search_trigrams;
+	struct array search_postings;
+	struct array requires_graph;
+	struct array required_by_graph;
+	struct array file_hash;
+	struct array file_parents;
+	struct array basenames;
+	struct array basename_entries;
+	struct array file_sizes;
+	struct array file_modes;
+	struct array file_mtimes;
+	struct array file_digests;
+	struct array file_flags;
+	struct array package_sizes;
+	struct array tombstones;
+	struct array delta_base;
+	struct array overlay_stamps;
 	struct razor_mapped_file *mapped_files;
+	struct razor_set_view *view;
+	uint32_t lazy_sections;
+	uint32_t sidecar_sections;
+	struct array deflated_sections;
+	char *filename;
+	uint32_t open_flags;
+	uint32_t phases;
+	unsigned char fingerprint[RAZOR_HASH_SIZE];
+	int has_fingerprint;
+};
+
+/* A view shares all arrays with its base set and only adds bitmaps of
+ * the packages and properties it shows.  A layer is a view with a set
+ * of added packages on top. */
+struct razor_set_view {
+	struct razor_set *base;
+	uint64_t *packages;
+	uint64_t *properties;
+	struct razor_set *added;
+};
+
+/* One row of the file detail columns. */
+struct razor_file_details {
+	uint32_t size;
+	uint32_t mode;
+	uint32_t mtime;
+	uint32_t flags;
+	unsigned char digest[RAZOR_DIGEST_SIZE];
 };
 
 struct import_entry {
 	uint32_t package;
 	char *name;
+	struct razor_file_details details;
+	int has_details;
 };
 
 struct import_directory {
 	uint32_t name, count;
 	struct array files;
 	struct array packages;
+	struct razor_file_details details;
+	int has_details;
 	struct import_directory *last;
 };
 
@@ -172,13 +342,20 @@ struct razor_importer {
 	struct array properties;
 	struct array files;
 	struct array file_requires;
+	uint32_t indexes;
+	uint32_t ignored_digests;
+	int has_file_details;
 };
 
 struct razor_package_iterator {
 	struct razor_set *set;
 	struct razor_package *package, *end;
 	struct list *index;
-	int free_index;
+	uint64_t *bits;
+	uint32_t bit, count;
+	struct razor_set *added;
+	struct razor_package *added_package, *added_end;
+	struct list *added_index;
 };
 
 void
@@ -190,11 +367,187 @@ struct razor_property_iterator {
 	struct razor_set *set;
 	struct razor_property *property, *end;
 	struct list *index;
+	struct razor_set *added;
+	struct razor_property *added_property, *added_end;
+};
+
+struct razor_file_frame {
+	struct razor_entry *entry;
+	uint32_t length;
+};
+
+struct razor_file_iterator {
+	struct razor_set *set;
+	struct array stack;
+	struct array path;
+	char *pattern;
+	struct razor_package_iterator owners;
 };
 
+struct razor_package_query {
+	struct razor_set *set;
+	uint64_t *bits;
+	uint32_t count;
+};
+
+#define BITSET_WORDS(count) (((count) + 63) / 64)
+
+static inline void
+bitset_set(uint64_t *bits, uint32_t bit)
+{
+	bits[bit / 64] |= (uint64_t) 1 << (bit % 64);
+}
+
+static inline void
+bitset_clear(uint64_t *bits, uint32_t bit)
+{
+	bits[bit / 64] &= ~((uint64_t) 1 << (bit % 64));
+}
+
+static inline int
+bitset_test(const uint64_t *bits, uint32_t bit)
+{
+	return (bits[bit / 64] >> (bit % 64)) & 1;
+}
+
+/* Returns the first set bit at or after start, or count if there is
+ * none. */
+static inline uint32_t
+bitset_next(const uint64_t *bits, uint32_t start, uint32_t count)
+{
+	uint32_t i;
+	uint64_t word;
+
+	if (start >= count)
+		return count;
+
+	i = start / 64;
+	word = bits[i] & (~(uint64_t) 0 << (start % 64));
+	while (word == 0) {
+		if (++i >= BITSET_WORDS(count))
+			return count;
+		word = bits[i];
+	}
+
+	return i * 64 + __builtin_ctzll(word);
+}
+
+static inline int
+razor_set_package_visible(struct razor_set *set, struct razor_package *package)
+{
+	struct razor_package *packages = set->packages.data;
+
+	return set->view == NULL ||
+		bitset_test(set->view->packages, package - packages);
+}
+
+static inline int
+razor_set_property_visible(struct razor_set *set,
+			   struct razor_property *property)
+{
+	struct razor_property *properties = set->properties.data;
+
+	return set->view == NULL ||
+		bitset_test(set->view->properties, property - properties);
+}
+
+/* The set a package or property of a layer belongs to: the added set
+ * if it is one of the added ones, otherwise the layer itself. */
+static inline struct razor_set *
+razor_set_package_owner(struct razor_set *set, struct razor_package *package)
+{
+	struct razor_set *added;
+
+	if (set->view == NULL || set->view->added == NULL)
+		return set;
+
+	added = set->view->added;
+	if (added->packages.data <= (void *) package &&
+	    (void *) package < added->packages.data + added->packages.size)
+		return added;
+
+	return set;
+}
+
+static inline struct razor_set *
+razor_set_property_owner(struct razor_set *set,
+			 struct razor_property *property)
+{
+	struct razor_set *added;
+
+	if (set->view == NULL || set->view->added == NULL)
+		return set;
+
+	added = set->view->added;
+	if (added->properties.data <= (void *) property &&
+	    (void *) property <
+	    added->properties.data + added->properties.size)
+		return added;
+
+	return set;
+}
+
+void razor_set_digest_packages(struct razor_set *set, unsigned char *digest);
+int razor_set_write_delta_to_fd(struct razor_set *set, int fd,
+				uint32_t section_mask);
+int razor_set_compare_properties(struct razor_set *set1,
+				 struct razor_property *p1,
+				 struct razor_set *set2,
+				 struct razor_property *p2);
+struct razor_property *
+razor_set_find_same_property(struct razor_set *set, struct razor_set *other,
+			     struct razor_property *property);
+
 struct razor_entry *
 razor_set_find_entry(struct razor_set *set,
 		     struct razor_entry *dir, const char *pattern);
+void
+razor_set_get_dir_path(struct razor_set *set, uint32_t dir,
+		       struct array *path, struct array *chain);
+struct list *
+razor_set_first_package_file(struct razor_set *set,
+			     struct razor_package *package);
+
+void razor_set_bind_lazy_sections(struct razor_set *set, uint32_t mask);
+
+/* The parts of the library that give the kernel access hints for the
+ * sections they use.  The hints for the bind phase are given when a
+ * section is mapped, the others the first time a set enters the
+ * phase. */
+enum razor_phase {
+	RAZOR_PHASE_BIND = 0x01,
+	RAZOR_PHASE_SCAN = 0x02,
+	RAZOR_PHASE_SOLVE = 0x04
+};
+
+void razor_set_enter_phase(struct razor_set *set, uint32_t phase);
+void razor_set_build_indexes(struct razor_set *set, uint32_t indexes);
+uint32_t razor_set_get_indexes(struct razor_set *set);
+void razor_set_build_search_index(struct razor_set *set);
+void razor_set_build_dependency_graph(struct razor_set *set);
+void razor_set_build_file_hash(struct razor_set *set);
+struct razor_entry *
+razor_set_find_hashed_entry(struct razor_set *set, const char *path);
+void razor_set_build_basename_index(struct razor_set *set);
+struct razor_basename *
+razor_set_find_basename_entries(struct razor_set *set, const char *name);
+
+int razor_set_has_file_details(struct razor_set *set);
+void razor_set_add_file_details(struct razor_set *set,
+				const struct razor_file_details *details);
+int razor_set_get_file_details(struct razor_set *set, uint32_t entry,
+			       struct razor_file_details *details);
+void razor_set_release_file_details(struct razor_set *set);
+int razor_parse_digest(const char *hex, unsigned char *digest);
+void razor_set_build_package_sizes(struct razor_set *set);
+int razor_set_check_limits(struct razor_set *set);
+struct razor_set *razor_set_copy(struct razor_set *set);
+
+int
+provider_satisfies_requirement(struct razor_property *provider,
+			       const char *provider_strings,
+			       uint32_t flags,
+			       const char *required);
 
 struct razor_merger *
 razor_merger_create(struct razor_set *set1, struct razor_set *set2);
@@ -212,6 +565,7 @@ razor_package_get_details_varg(struct razor_set *set,
 			       va_list args);
 
 int razor_create_dir(const char *root, const char *path);
+int razor_compare_filenames(const char *p1, const char *p2);
 int razor_write(int fd, const void *data, size_t size);
 
 
@@ -222,4 +576,23 @@ uint32_t *
 razor_qsort_with_data(void *base, size_t nelem, size_t size,
 		      razor_compare_with_data_func_t compare, void *data);
 
+struct razor_md5 {
+	uint32_t state[4];
+	uint64_t length;
+	unsigned char buffer[64];
+};
+
+void razor_md5_init(struct razor_md5 *md5);
+void razor_md5_update(struct razor_md5 *md5, const void *data, size_t size);
+void razor_md5_final(struct razor_md5 *md5, unsigned char *digest);
+
+void razor_hash128(const void *data, size_t size, unsigned char *hash);
+
+typedef void (*razor_parallel_func_t)(uint32_t start, uint32_t end,
+				      void *data);
+int razor_parallel_threads(int nthreads);
+void
+razor_parallel_for(uint32_t count, int nthreads,
+		   razor_parallel_func_t func, void *data);
+
 #endif /* _RAZOR_INTERNAL_H_ */
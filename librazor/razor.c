@@ -33,6 +33,8 @@
 #include <errno.h>
 #include <ctype.h>
 #include <fnmatch.h>
+#include <pthread.h>
+#include <zlib.h>
 #include <assert.h>
 
 #include "razor-internal.h"
@@ -49,29 +51,94 @@ zalloc(size_t size)
 	return p;
 }
 
+/* Each section lists the size of its elements and how they are laid
+ * out, one character per field: 'b' for bytes, 'h' for 16-bit and 'w'
+ * for 32-bit words, and 'l' for words split in a 24-bit and an 8-bit
+ * bitfield, such as list heads.  The layout repeats over the element,
+ * so a string pool is just "b".  The version has the major number in
+ * the high 16 bits; fields are only ever appended to elements, which
+ * bumps the minor number, and readers give up on a section with a
+ * different major number. */
 struct razor_set_section_index {
 	const char *name;
 	uint32_t offset;
 	uint32_t flags;
+	uint32_t element_size;
+	const char *layout;
+	uint32_t version;
 };
 
-#define MAIN(type, field) \
-	{ type, offsetof(struct razor_set, field), RAZOR_SECTION_MAIN }
-#define FILES(type, field) \
-	{ type, offsetof(struct razor_set, field), RAZOR_SECTION_FILES }
-#define DETAILS(type, field) \
-	{ type, offsetof(struct razor_set, field), RAZOR_SECTION_DETAILS }
+/* Sections that are large, read rarely and compress well.  They are
+ * deflated when a set is written with RAZOR_SECTION_COMPRESSED. */
+#define SECTION_COLD 0x10000
+
+/* Sections most sets don't have, which are left out when empty. */
+#define SECTION_OPTIONAL 0x20000
+
+#define SECTION_VERSION(major, minor) ((major) << 16 | (minor))
+
+/* A library built with RAZOR_WIDE_INDEX widens each 24:8 word to a
+ * 32-bit index followed by 32 bits of flags, and writes the sections
+ * that have them with this major number.  Either kind of library
+ * converts such sections to its own width as it binds them; older
+ * readers give up on them rather than misread them. */
+#define SECTION_WIDE_MAJOR 2
+
+#ifdef RAZOR_WIDE_INDEX
+#define HOST_WIDE 1
+#else
+#define HOST_WIDE 0
+#endif
+
+#define SECTION(type, field, flags, element, layout) \
+	{ type, offsetof(struct razor_set, field), flags, \
+	  element, layout, SECTION_VERSION(1, 0) }
+#define MAIN(type, field, element, layout) \
+	SECTION(type, field, RAZOR_SECTION_MAIN, element, layout)
+#define FILES(type, field, element, layout) \
+	SECTION(type, field, RAZOR_SECTION_FILES, element, layout)
+#define DETAILS(type, field, element, layout) \
+	SECTION(type, field, RAZOR_SECTION_DETAILS, element, layout)
 
 struct razor_set_section_index razor_sections[] = {
-	MAIN(RAZOR_STRING_POOL, string_pool),
-	MAIN(RAZOR_PACKAGES, packages),
-	MAIN(RAZOR_PROPERTIES, properties),
-	MAIN(RAZOR_PACKAGE_POOL, package_pool),
-	MAIN(RAZOR_PROPERTY_POOL, property_pool),
-	FILES(RAZOR_FILES, files),
-	FILES(RAZOR_FILE_POOL, file_pool),
-	FILES(RAZOR_FILE_STRING_POOL, file_string_pool),
-	DETAILS(RAZOR_DETAILS_STRING_POOL, details_string_pool)
+	MAIN(RAZOR_STRING_POOL, string_pool, 1, "b"),
+	MAIN(RAZOR_PACKAGES, packages,
+	     sizeof (struct razor_package), "lwwwwwwll"),
+	MAIN(RAZOR_PROPERTIES, properties,
+	     sizeof (struct razor_property), "wwwl"),
+	MAIN(RAZOR_PACKAGE_POOL, package_pool, sizeof (struct list), "l"),
+	MAIN(RAZOR_PROPERTY_POOL, property_pool, sizeof (struct list), "l"),
+	MAIN(RAZOR_REQUIRES_GRAPH, requires_graph, sizeof (uint32_t), "w"),
+	MAIN(RAZOR_REQUIRED_BY_GRAPH, required_by_graph,
+	     sizeof (uint32_t), "w"),
+	FILES(RAZOR_FILES, files, sizeof (struct razor_entry), "lwl"),
+	FILES(RAZOR_FILE_POOL, file_pool, sizeof (struct list), "l"),
+	SECTION(RAZOR_FILE_STRING_POOL, file_string_pool,
+		RAZOR_SECTION_FILES | SECTION_COLD, 1, "b"),
+	FILES(RAZOR_FILE_HASH, file_hash,
+	      sizeof (struct razor_file_slot), "www"),
+	FILES(RAZOR_FILE_PARENTS, file_parents, sizeof (uint32_t), "w"),
+	FILES(RAZOR_BASENAMES, basenames,
+	      sizeof (struct razor_basename), "www"),
+	FILES(RAZOR_BASENAME_ENTRIES, basename_entries,
+	      sizeof (uint32_t), "w"),
+	FILES(RAZOR_FILE_SIZES, file_sizes, sizeof (uint32_t), "w"),
+	FILES(RAZOR_FILE_MODES, file_modes, sizeof (uint16_t), "h"),
+	FILES(RAZOR_FILE_MTIMES, file_mtimes, sizeof (uint32_t), "w"),
+	FILES(RAZOR_FILE_DIGESTS, file_digests, RAZOR_DIGEST_SIZE, "b"),
+	FILES(RAZOR_FILE_FLAGS, file_flags, 1, "b"),
+	FILES(RAZOR_PACKAGE_SIZES, package_sizes, sizeof (uint32_t), "w"),
+	SECTION(RAZOR_DETAILS_STRING_POOL, details_string_pool,
+		RAZOR_SECTION_DETAILS | SECTION_COLD, 1, "b"),
+	DETAILS(RAZOR_SEARCH_TRIGRAMS, search_trigrams,
+		sizeof (struct razor_trigram), "ww"),
+	DETAILS(RAZOR_SEARCH_POSTINGS, search_postings, 1, "b"),
+	SECTION(RAZOR_TOMBSTONES, tombstones,
+		RAZOR_SECTION_DELTA, sizeof (uint32_t), "w"),
+	SECTION(RAZOR_DELTA_BASE, delta_base,
+		RAZOR_SECTION_DELTA, 1, "b"),
+	SECTION(RAZOR_OVERLAY_STAMPS, overlay_stamps,
+		RAZOR_SECTION_MAIN | SECTION_OPTIONAL, 1, "b")
 };
 
 RAZOR_EXPORT struct razor_set *
@@ -79,11 +146,14 @@ razor_set_create(void)
 {
 	struct razor_set *set;
 	struct razor_entry *e;
+	uint32_t *parent;
 	char *empty;
 
 	set = zalloc(sizeof *set);
 
 	e = array_add(&set->files, sizeof *e);
+	parent = array_add(&set->file_parents, sizeof *parent);
+	*parent = 0;
 	empty = array_add(&set->string_pool, 1);
 	*empty = '\0';
 	e->name = 0;
@@ -100,15 +170,476 @@ struct razor_mapped_file {
 	struct razor_mapped_file *next;
 };
 
-RAZOR_EXPORT int
-razor_set_bind_sections(struct razor_set *set, const char *filename)
+/* Files are little endian.  A 24:8 bitfield word holds the 24-bit
+ * field in its low bits, which is how GCC lays it out on little endian
+ * hosts; on big endian hosts it is the other way around.  Version 1
+ * files are in the byte order of the host that wrote them. */
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_BIG_ENDIAN 1
+#else
+#define HOST_BIG_ENDIAN 0
+#endif
+
+static uint32_t
+to_le32(uint32_t v)
+{
+	uint32_t le;
+
+	store32(&le, v, 0);
+
+	return le;
+}
+
+static int
+field_width(char field, int wide)
+{
+	switch (field) {
+	case 'b':
+		return 1;
+	case 'h':
+		return 2;
+	case 'l':
+		return wide ? 8 : 4;
+	default:
+		return 4;
+	}
+}
+
+/* The size of the elements of section j in a file of the given
+ * width. */
+static uint32_t
+section_element_size(int j, int wide)
+{
+	const char *l;
+	uint32_t size;
+
+	size = razor_sections[j].element_size;
+	if (wide != HOST_WIDE)
+		for (l = razor_sections[j].layout; *l; l++)
+			if (*l == 'l')
+				size = size - field_width('l', HOST_WIDE) +
+					field_width('l', wide);
+
+	return size;
+}
+
+/* Copy count elements laid out as given by layout from src to dst,
+ * swapping the byte order and converting the width of 24:8 words as
+ * needed.  Fields past the end of the shorter element size are
+ * dropped, or left as they are in dst.  Returns -1 if an index
+ * doesn't fit in a narrow word. */
+static int
+convert_elements(void *dst, uint32_t dst_size, int dst_big, int dst_wide,
+		 const void *src, uint32_t src_size, int src_big, int src_wide,
+		 uint32_t count, const char *layout)
+{
+	const unsigned char *s;
+	unsigned char *d;
+	const char *l;
+	uint32_t i, j, k, sw, dw, v, f;
+
+	for (i = 0; i < count; i++) {
+		s = (const unsigned char *) src + i * src_size;
+		d = (unsigned char *) dst + i * dst_size;
+		for (j = 0, k = 0, l = layout; ; j += sw, k += dw) {
+			sw = field_width(*l, src_wide);
+			dw = field_width(*l, dst_wide);
+			if (j + sw > src_size || k + dw > dst_size)
+				break;
+
+			switch (*l) {
+			case 'b':
+				d[k] = s[j];
+				break;
+			case 'h':
+				d[k + dst_big] = s[j + src_big];
+				d[k + !dst_big] = s[j + !src_big];
+				break;
+			case 'w':
+				store32(d + k, load32(s + j, src_big), dst_big);
+				break;
+			case 'l':
+				v = load32(s + j, src_big);
+				if (src_wide) {
+					f = load32(s + j + 4, src_big);
+				} else {
+					if (src_big)
+						v = v >> 8 | v << 24;
+					f = v >> 24;
+					v &= 0xffffff;
+				}
+
+				if (dst_wide) {
+					store32(d + k, v, dst_big);
+					store32(d + k + 4, f, dst_big);
+					break;
+				}
+
+				/* Empty lists have all ones for an index. */
+				if ((v > 0xffffff && v != ~0u) || f > 0xff)
+					return -1;
+				v = (v & 0xffffff) | f << 24;
+				if (dst_big)
+					v = v << 8 | v >> 24;
+				store32(d + k, v, dst_big);
+				break;
+			}
+
+			if (*++l == '\0')
+				l = layout;
+		}
+	}
+
+	return 0;
+}
+
+/* Map anonymous memory that is unmapped with the files of the set. */
+static void *
+map_anonymous(struct razor_set *set, size_t size)
 {
-	struct razor_set_section *s, *sections;
 	struct razor_mapped_file *file;
+	void *data;
+
+	data = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED)
+		return NULL;
+
+	file = zalloc(sizeof *file);
+	file->header = data;
+	file->size = size;
+	file->next = set->mapped_files;
+	set->mapped_files = file;
+
+	return data;
+}
+
+static void
+unmap_anonymous(struct razor_set *set, void *data)
+{
+	struct razor_mapped_file **p, *file;
+
+	for (p = &set->mapped_files; *p != NULL; p = &(*p)->next) {
+		if ((void *) (*p)->header != data)
+			continue;
+		file = *p;
+		*p = file->next;
+		munmap(file->header, file->size);
+		free(file);
+		return;
+	}
+}
+
+/* Access hints for the sections the library uses.  Hash and binary
+ * search lookups only want the pages they hit, while the solver scans
+ * the packages and properties front to back and needs most of the main
+ * sections.  Sections share pages at their ends, so the hints only
+ * cover the pages wholly inside a section and leave how the
+ * neighbouring sections are read alone. */
+struct section_advice {
+	uint32_t phase;
+	uint32_t offset;
+	uint32_t advice;
+};
+
+#define ADVICE(phase, field, advice) \
+	{ phase, offsetof(struct razor_set, field), advice }
+
+static const struct section_advice default_advice[] = {
+	ADVICE(RAZOR_PHASE_BIND, file_hash, RAZOR_ADVISE_RANDOM),
+	ADVICE(RAZOR_PHASE_BIND, basenames, RAZOR_ADVISE_RANDOM),
+	ADVICE(RAZOR_PHASE_BIND, basename_entries, RAZOR_ADVISE_RANDOM),
+	ADVICE(RAZOR_PHASE_BIND, search_trigrams, RAZOR_ADVISE_RANDOM),
+	ADVICE(RAZOR_PHASE_SCAN, packages, RAZOR_ADVISE_SEQUENTIAL),
+	ADVICE(RAZOR_PHASE_SCAN, properties, RAZOR_ADVISE_SEQUENTIAL),
+	ADVICE(RAZOR_PHASE_SOLVE, packages,
+	       RAZOR_ADVISE_SEQUENTIAL | RAZOR_ADVISE_WILLNEED),
+	ADVICE(RAZOR_PHASE_SOLVE, properties,
+	       RAZOR_ADVISE_SEQUENTIAL | RAZOR_ADVISE_WILLNEED),
+	ADVICE(RAZOR_PHASE_SOLVE, package_pool, RAZOR_ADVISE_WILLNEED),
+	ADVICE(RAZOR_PHASE_SOLVE, property_pool, RAZOR_ADVISE_WILLNEED),
+	ADVICE(RAZOR_PHASE_SOLVE, requires_graph, RAZOR_ADVISE_WILLNEED),
+	ADVICE(RAZOR_PHASE_SOLVE, required_by_graph, RAZOR_ADVISE_WILLNEED)
+};
+
+/* Give the advice for the pages an array is on.  The first and last
+ * page may be shared with the neighbouring sections, so if inner is
+ * set, only the pages wholly inside the array are advised. */
+static int
+advise_array(struct array *array, uint32_t advice, int inner)
+{
+	static const struct {
+		uint32_t flag;
+		int advice;
+	} flags[] = {
+		{ RAZOR_ADVISE_NORMAL, MADV_NORMAL },
+		{ RAZOR_ADVISE_SEQUENTIAL, MADV_SEQUENTIAL },
+		{ RAZOR_ADVISE_RANDOM, MADV_RANDOM },
+		{ RAZOR_ADVISE_WILLNEED, MADV_WILLNEED },
+#ifdef MADV_HUGEPAGE
+		{ RAZOR_ADVISE_HUGEPAGE, MADV_HUGEPAGE },
+#endif
+	};
+	uintptr_t page, start, end;
+	int i, status;
+
+	if (array->size == 0)
+		return 0;
+
+	page = sysconf(_SC_PAGESIZE);
+	start = (uintptr_t) array->data & ~(page - 1);
+	end = (uintptr_t) array->data + array->size;
+	if (inner) {
+		if (start != (uintptr_t) array->data)
+			start += page;
+		end &= ~(page - 1);
+		if (start >= end)
+			return 0;
+	}
+
+	status = 0;
+	for (i = 0; i < ARRAY_SIZE(flags); i++)
+		if ((advice & flags[i].flag) &&
+		    madvise((void *) start, end - start, flags[i].advice) < 0)
+			status = -1;
+
+	return status;
+}
+
+static void
+advise_phase(struct razor_set *set, uint32_t phase, uint32_t offset)
+{
+	const struct section_advice *a;
+
+	for (a = default_advice;
+	     a < default_advice + ARRAY_SIZE(default_advice); a++)
+		if (a->phase == phase &&
+		    (offset == 0 || a->offset == offset))
+			advise_array((void *) set + a->offset, a->advice, 1);
+}
+
+/* Called by the parts of the library that use a set in a way the
+ * defaults above know about.  The hints are only given once per set
+ * and only for sets mapped from files. */
+void
+razor_set_enter_phase(struct razor_set *set, uint32_t phase)
+{
+	struct razor_set *base;
+
+	base = set->view ? set->view->base : set;
+	if (base->mapped_files == NULL ||
+	    (__sync_fetch_and_or(&base->phases, phase) & phase))
+		return;
+
+	advise_phase(base, phase, 0);
+}
+
+/* Point the array of section j at data.  If the elements in the file
+ * have the size, byte order and width of the host, which is the common
+ * case, the data is used in place.  Otherwise it is converted into
+ * memory of its own.  Returns 1 if data is used in place, 0 if it is
+ * copied and -1 if it can't be converted. */
+static int
+bind_section(struct razor_set *set, int j, void *data, uint32_t size,
+	     uint32_t element_size, int big, int wide)
+{
+	struct razor_set_section_index *index = &razor_sections[j];
+	struct array *array;
+	uint32_t count;
+	void *copy;
+
+	array = (void *) set + index->offset;
+	if (element_size == index->element_size && wide == HOST_WIDE &&
+	    (big == HOST_BIG_ENDIAN || strcmp(index->layout, "b") == 0)) {
+		array->data = data;
+		array->size = size;
+		array->alloc = size;
+		advise_phase(set, RAZOR_PHASE_BIND, index->offset);
+		return 1;
+	}
+
+	count = size / element_size;
+	if (count == 0)
+		return 0;
+
+	copy = map_anonymous(set, count * index->element_size);
+	if (copy == NULL) {
+		fprintf(stderr, "failed to convert section %s: %m\n",
+			index->name);
+		return -1;
+	}
+
+	if (convert_elements(copy, index->element_size,
+			     HOST_BIG_ENDIAN, HOST_WIDE,
+			     data, element_size, big, wide,
+			     count, index->layout) < 0) {
+		fprintf(stderr, "section %s needs a razor built with "
+			"--enable-wide-indices\n", index->name);
+		unmap_anonymous(set, copy);
+		return -1;
+	}
+	mprotect(copy, count * index->element_size, PROT_READ);
+
+	array->data = copy;
+	array->size = count * index->element_size;
+	array->alloc = array->size;
+	advise_phase(set, RAZOR_PHASE_BIND, index->offset);
+
+	return 0;
+}
+
+/* A deflated section that hasn't been inflated yet. */
+struct deflated_section {
+	uint32_t index;
+	const void *data;
+	uint32_t size;
+	uint32_t data_size;
+	uint32_t element_size;
+	int big;
+	int wide;
+	int verify;
+	unsigned char hash[RAZOR_HASH_SIZE];
+};
+
+static int
+check_section(const void *data, uint32_t size, const unsigned char *hash)
+{
+	unsigned char actual[RAZOR_HASH_SIZE];
+
+	razor_hash128(data, size, actual);
+
+	return memcmp(actual, hash, RAZOR_HASH_SIZE) == 0 ? 0 : -1;
+}
+
+/* Inflate a section into anonymous memory.  On failure the section is
+ * left empty. */
+static int
+inflate_section(struct razor_set *set, struct deflated_section *d)
+{
+	uLongf length;
+	void *data;
+	int status;
+
+	data = map_anonymous(set, d->data_size);
+	if (data == NULL)
+		return -1;
+
+	length = d->data_size;
+	if (uncompress(data, &length, d->data, d->size) != Z_OK ||
+	    length != d->data_size) {
+		fprintf(stderr, "corrupt compressed section %s\n",
+			razor_sections[d->index].name);
+		unmap_anonymous(set, data);
+		return -1;
+	}
+
+	if (d->verify && check_section(data, d->data_size, d->hash) < 0) {
+		fprintf(stderr, "section %s doesn't match its hash\n",
+			razor_sections[d->index].name);
+		unmap_anonymous(set, data);
+		return -1;
+	}
+	mprotect(data, d->data_size, PROT_READ);
+
+	status = bind_section(set, d->index, data, d->data_size,
+			      d->element_size, d->big, d->wide);
+	if (status < 1)
+		unmap_anonymous(set, data);
+
+	return status < 0 ? -1 : 0;
+}
+
+/* Returns the mask of section groups with sections still to be
+ * inflated. */
+static uint32_t
+deflated_groups(struct razor_set *set)
+{
+	struct deflated_section *d, *end;
+	uint32_t groups = 0;
+
+	end = set->deflated_sections.data + set->deflated_sections.size;
+	for (d = set->deflated_sections.data; d < end; d++)
+		groups |= razor_sections[d->index].flags & RAZOR_SECTION_ALL;
+
+	return groups;
+}
+
+/* Inflate the pending sections in the groups of mask. */
+static void
+inflate_sections(struct razor_set *set, uint32_t mask)
+{
+	struct deflated_section *d, *end, *keep;
+
+	keep = set->deflated_sections.data;
+	end = set->deflated_sections.data + set->deflated_sections.size;
+	for (d = set->deflated_sections.data; d < end; d++) {
+		if (razor_sections[d->index].flags & mask)
+			inflate_section(set, d);
+		else
+			*keep++ = *d;
+	}
+	set->deflated_sections.size =
+		(void *) keep - set->deflated_sections.data;
+}
+
+/* Sections written with RAZOR_SECTION_PAGE_ALIGNED that are large
+ * enough start on a huge page in the file, which only lines up with
+ * huge pages in memory if the file is mapped on one too.  So large
+ * files are mapped into the huge page aligned middle of a reservation
+ * and the rest of the reservation is given back. */
+static void *
+map_file(int fd, size_t size, int flags)
+{
+	uintptr_t area, start, end;
+	void *data;
+
+	if (size < RAZOR_HUGE_PAGE_SIZE)
+		return mmap(NULL, size, PROT_READ, MAP_PRIVATE | flags, fd, 0);
+
+	data = mmap(NULL, size + RAZOR_HUGE_PAGE_SIZE, PROT_NONE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED)
+		return data;
+
+	area = (uintptr_t) data;
+	start = ALIGN(area, RAZOR_HUGE_PAGE_SIZE);
+	data = mmap((void *) start, size, PROT_READ,
+		    MAP_PRIVATE | MAP_FIXED | flags, fd, 0);
+	if (data == MAP_FAILED) {
+		munmap((void *) area, size + RAZOR_HUGE_PAGE_SIZE);
+		return data;
+	}
+
+	end = ALIGN(start + size, (uintptr_t) sysconf(_SC_PAGESIZE));
+	if (start > area)
+		munmap((void *) area, start - area);
+	if (end < area + size + RAZOR_HUGE_PAGE_SIZE)
+		munmap((void *) end, area + size + RAZOR_HUGE_PAGE_SIZE - end);
+
+	return data;
+}
+
+/* Map a set file and bind the sections in it.  The mask of section
+ * groups found in the file is returned in groups.  Deflated sections
+ * are only inflated when their group is first used, except for the
+ * main sections, which are always needed.  Sections this code doesn't
+ * know are skipped, and so are fields it doesn't know at the end of
+ * section entries and elements.  If fingerprint isn't NULL, a file
+ * with another fingerprint is refused. */
+static int
+bind_file(struct razor_set *set, const char *filename,
+	  const unsigned char *fingerprint, uint32_t *groups)
+{
+	struct razor_set_header *header;
+	struct razor_mapped_file *file;
+	struct deflated_section *d;
 	struct stat stat;
 	const char *pool;
-	struct array *array;
-	int fd, i, j;
+	const unsigned char *s, *hash;
+	size_t pool_size;
+	uint32_t version, count, header_size, entry_size;
+	uint32_t name, offset, size, flags, data_size, element_size;
+	int fd, i, j, big, wide, verify;
 
 	file = zalloc(sizeof *file);
 	if (file == NULL)
@@ -120,7 +651,9 @@ razor_set_bind_sections(struct razor_set *set, const char *filename)
 		return -1;
 	}
 
-	file->header = mmap(NULL, stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	file->header = map_file(fd, stat.st_size,
+				(set->open_flags & RAZOR_OPEN_POPULATE) ?
+				MAP_POPULATE : 0);
 	close(fd);
 	if (file->header == MAP_FAILED) {
 		free(file);
@@ -131,39 +664,405 @@ razor_set_bind_sections(struct razor_set *set, const char *filename)
 	file->next = set->mapped_files;
 	set->mapped_files = file;
 
-	sections = (void *) file->header + sizeof *file->header;
-	pool = (void *) sections +
-		file->header->num_sections * sizeof *sections;
+	header = file->header;
+	if (file->size < RAZOR_HEADER_SIZE_V1)
+		big = -1;
+	else if (load32(&header->magic, HOST_BIG_ENDIAN) == RAZOR_MAGIC)
+		big = HOST_BIG_ENDIAN;
+	else if (load32(&header->magic, !HOST_BIG_ENDIAN) == RAZOR_MAGIC)
+		big = !HOST_BIG_ENDIAN;
+	else
+		big = -1;
+	if (big < 0) {
+		fprintf(stderr, "%s is not a razor package set\n", filename);
+		return -1;
+	}
+
+	version = load32(&header->version, big);
+	count = load32(&header->num_sections, big);
+	if (version == 1) {
+		header_size = RAZOR_HEADER_SIZE_V1;
+		entry_size = RAZOR_SECTION_ENTRY_SIZE_V1;
+	} else if (file->size >= sizeof *header) {
+		header_size = load32(&header->header_size, big);
+		entry_size = load32(&header->section_size, big);
+	} else {
+		header_size = entry_size = 0;
+	}
+
+	if (entry_size < RAZOR_SECTION_ENTRY_SIZE_V1 ||
+	    header_size < RAZOR_HEADER_SIZE_V1 ||
+	    header_size > file->size ||
+	    (file->size - header_size) / entry_size < count) {
+		fprintf(stderr, "%s: unsupported or corrupt header\n",
+			filename);
+		return -1;
+	}
+
+	/* Sidecar files carry the fingerprint of the set too, so
+	 * whichever file comes first provides it, and a sidecar left
+	 * over from another version of the set is refused. */
+	if (version >= 2 &&
+	    header_size >= sizeof *header && file->size >= sizeof *header) {
+		if (fingerprint != NULL &&
+		    memcmp(fingerprint, header->fingerprint,
+			   RAZOR_HASH_SIZE) != 0) {
+			fprintf(stderr, "%s doesn't belong to the set, "
+				"its fingerprint differs\n", filename);
+			return -1;
+		}
+		if (!set->has_fingerprint) {
+			memcpy(set->fingerprint, header->fingerprint,
+			       RAZOR_HASH_SIZE);
+			set->has_fingerprint = 1;
+		}
+	}
+
+	verify = (set->open_flags & RAZOR_OPEN_VERIFY) &&
+		entry_size >= sizeof (struct razor_set_section);
+	pool = (void *) header + header_size + count * entry_size;
+	pool_size = file->size - (pool - (char *) header);
+
+	for (i = 0; i < count; i++) {
+		s = (void *) header + header_size + i * entry_size;
+		name = load32(s, big);
+		offset = load32(s + 4, big);
+		size = load32(s + 8, big);
+		if (offset > file->size || size > file->size - offset ||
+		    name >= pool_size ||
+		    memchr(&pool[name], '\0', pool_size - name) == NULL)
+			continue;
 
-	for (i = 0; i < file->header->num_sections; i++) {
-		s = sections + i;
 		for (j = 0; j < ARRAY_SIZE(razor_sections); j++)
-			if (!strcmp(razor_sections[j].name, &pool[s->name]))
+			if (!strcmp(razor_sections[j].name, &pool[name]))
 				break;
 		if (j == ARRAY_SIZE(razor_sections))
 			continue;
-		array = (void *) set + razor_sections[j].offset;
-		array->data = (void *) file->header + s->offset;
-		array->size = s->size;
-		array->alloc = s->size;
+		*groups |= razor_sections[j].flags & RAZOR_SECTION_ALL;
+
+		flags = 0;
+		data_size = size;
+		element_size = section_element_size(j, 0);
+		version = razor_sections[j].version;
+		hash = s + offsetof(struct razor_set_section, hash);
+		if (entry_size >= offsetof(struct razor_set_section, hash)) {
+			flags = load32(s + 12, big);
+			data_size = load32(s + 16, big);
+			element_size = load32(s + 20, big);
+			version = load32(s + 24, big);
+		}
+
+		wide = version >> 16 == SECTION_WIDE_MAJOR &&
+			strchr(razor_sections[j].layout, 'l') != NULL;
+		if ((!wide &&
+		     version >> 16 != razor_sections[j].version >> 16) ||
+		    element_size == 0) {
+			fprintf(stderr, "%s: unsupported version %d.%d "
+				"of section %s\n", filename,
+				version >> 16, version & 0xffff,
+				razor_sections[j].name);
+			continue;
+		}
+
+		if (flags & RAZOR_SECTION_DEFLATED) {
+			d = array_add(&set->deflated_sections, sizeof *d);
+			d->index = j;
+			d->data = (void *) header + offset;
+			d->size = size;
+			d->data_size = data_size;
+			d->element_size = element_size;
+			d->big = big;
+			d->wide = wide;
+			d->verify = verify;
+			if (verify)
+				memcpy(d->hash, hash, RAZOR_HASH_SIZE);
+			continue;
+		}
+
+		if (verify &&
+		    check_section((void *) header + offset, size, hash) < 0) {
+			fprintf(stderr, "%s: section %s doesn't match its hash\n",
+				filename, razor_sections[j].name);
+			return -1;
+		}
+
+		if (bind_section(set, j, (void *) header + offset, size,
+				 element_size, big, wide) < 0)
+			return -1;
 	}
 
+	inflate_sections(set, RAZOR_SECTION_MAIN);
+
+	return 0;
+}
+
+RAZOR_EXPORT int
+razor_set_bind_sections(struct razor_set *set, const char *filename)
+{
+	uint32_t groups = 0;
+
+	assert (set != NULL);
+	assert (filename != NULL);
+
+	if (bind_file(set, filename, NULL, &groups) < 0)
+		return -1;
+
+	/* Sections bound by hand are no longer looked for in the
+	 * sidecar files. */
+	set->sidecar_sections &= ~groups;
+	set->lazy_sections = set->sidecar_sections | deflated_groups(set);
+
 	return 0;
 }
 
+/* The files and details sections of a split set are kept in sidecar
+ * files next to the main file, named foo-files.rzdb and
+ * foo-details.rzdb for foo.rzdb. */
+static char *
+sidecar_filename(const char *filename, uint32_t group)
+{
+	const char *suffix, *name;
+	char *path;
+	int length;
+
+	name = group == RAZOR_SECTION_FILES ? "files" : "details";
+	length = strlen(filename);
+	suffix = ".rzdb";
+	if (length >= 5 && strcmp(filename + length - 5, suffix) == 0)
+		length -= 5;
+	else
+		suffix = "";
+
+	if (asprintf(&path, "%.*s-%s%s", length, filename, name, suffix) < 0)
+		return NULL;
+
+	return path;
+}
+
+/**
+ * razor_set_open_with_flags:
+ * @filename: the file to open
+ * @flags: a mask of %razor_open_flags values
+ *
+ * Open a set like razor_set_open().  With %RAZOR_OPEN_POPULATE, the
+ * files of the set are read in completely when they are mapped, which
+ * saves the page faults for a set that is about to be used all over,
+ * such as by the solver.  With %RAZOR_OPEN_VERIFY, each section is
+ * checked against the hash it was written with when it is bound, and
+ * a set with a corrupt section isn't opened; deflated sections are
+ * checked when they are inflated and left empty if they don't match.
+ *
+ * Returns: the set, or %NULL if @filename can't be mapped.
+ **/
 RAZOR_EXPORT struct razor_set *
-razor_set_open(const char *filename)
+razor_set_open_with_flags(const char *filename, uint32_t flags)
 {
 	struct razor_set *set;
+	uint32_t groups = 0;
+
+	assert (filename != NULL);
 
 	set = zalloc(sizeof *set);
-	if (razor_set_bind_sections(set, filename)) {
-		free(set);
+	set->open_flags = flags;
+	if (bind_file(set, filename, NULL, &groups)) {
+		razor_set_destroy(set);
 		return NULL;
 	}
+
+	set->sidecar_sections =
+		(RAZOR_SECTION_FILES | RAZOR_SECTION_DETAILS) & ~groups;
+	set->lazy_sections = set->sidecar_sections | deflated_groups(set);
+	if (set->sidecar_sections)
+		set->filename = strdup(filename);
+
 	return set;
 }
 
+/**
+ * razor_set_open:
+ * @filename: the file to open
+ *
+ * Open a set written by razor_set_write() or razor_set_write_split().
+ * Only the sections in @filename are mapped up front.  If it was
+ * written split, the files and details sections are mapped from the
+ * sidecar files the first time they are used, and compressed sections
+ * are inflated the first time they are used.
+ *
+ * Returns: the set, or %NULL if @filename can't be mapped.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_open(const char *filename)
+{
+	return razor_set_open_with_flags(filename, 0);
+}
+
+/**
+ * razor_set_advise:
+ * @set: a %razor_set
+ * @section_mask: the section groups the advice is for
+ * @advice: a mask of %razor_advice values
+ *
+ * Tell the kernel how the sections in @section_mask are about to be
+ * used, so it can read ahead or not as suits.  The library already
+ * gives hints for the way it uses sets itself; this is for
+ * applications that know better.  The advice covers every page the
+ * sections are on, including pages they share with other sections.
+ * Sections that are mapped lazily are bound first.  Sets that weren't
+ * opened from a file are left alone.
+ *
+ * Returns: 0 on success, or -1 if the kernel rejected some advice.
+ **/
+RAZOR_EXPORT int
+razor_set_advise(struct razor_set *set, uint32_t section_mask, uint32_t advice)
+{
+	struct razor_set *base;
+	int i, status;
+
+	assert (set != NULL);
+
+	razor_set_bind_lazy_sections(set, section_mask & RAZOR_SECTION_ALL);
+	base = set->view ? set->view->base : set;
+	if (base->mapped_files == NULL)
+		return 0;
+
+	status = 0;
+	for (i = 0; i < ARRAY_SIZE(razor_sections); i++)
+		if ((razor_sections[i].flags & section_mask) &&
+		    advise_array((void *) base + razor_sections[i].offset,
+				 advice, 0) < 0)
+			status = -1;
+
+	return status;
+}
+
+/**
+ * razor_set_prefetch:
+ * @set: a %razor_set
+ * @section_mask: the section groups to read in
+ *
+ * Start reading in the sections in @section_mask in the background,
+ * ahead of a phase that is going to scan them.
+ **/
+RAZOR_EXPORT void
+razor_set_prefetch(struct razor_set *set, uint32_t section_mask)
+{
+	assert (set != NULL);
+
+	razor_set_advise(set, section_mask, RAZOR_ADVISE_WILLNEED);
+}
+
+static pthread_mutex_t lazy_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Make sure the section groups in mask are bound, mapping them from
+ * the sidecar files if the set was opened split and inflating them if
+ * they are compressed, the first time they are used.  Sets are shared
+ * between threads, so this is done under a lock; once a group is
+ * bound, this is a single atomic read.  A view binds its base set and
+ * copies the arrays. */
+void
+razor_set_bind_lazy_sections(struct razor_set *set, uint32_t mask)
+{
+	struct razor_set *base;
+	struct array *array;
+	uint32_t groups, pending, found;
+	char *path;
+	int i;
+
+	if ((__sync_fetch_and_add(&set->lazy_sections, 0) & mask) == 0)
+		return;
+
+	pthread_mutex_lock(&lazy_mutex);
+
+	base = set->view ? set->view->base : set;
+	pending = base->lazy_sections & mask;
+	for (groups = RAZOR_SECTION_DETAILS;
+	     groups <= RAZOR_SECTION_FILES; groups <<= 1) {
+		if ((pending & base->sidecar_sections & groups) == 0)
+			continue;
+
+		/* A missing sidecar, or one of another set, leaves the
+		 * sections empty, like for a set written without them. */
+		found = 0;
+		path = sidecar_filename(base->filename, groups);
+		if (path != NULL)
+			bind_file(base, path,
+				  base->has_fingerprint ?
+				  base->fingerprint : NULL, &found);
+		free(path);
+	}
+	inflate_sections(base, pending);
+	base->sidecar_sections &= ~pending;
+	__sync_fetch_and_and(&base->lazy_sections, ~pending);
+
+	if (set != base) {
+		for (i = 0; i < ARRAY_SIZE(razor_sections); i++) {
+			if ((razor_sections[i].flags & mask &
+			     set->lazy_sections) == 0)
+				continue;
+			array = (void *) base + razor_sections[i].offset;
+			memcpy((void *) set + razor_sections[i].offset,
+			       array, sizeof *array);
+		}
+		__sync_fetch_and_and(&set->lazy_sections, ~mask);
+	}
+
+	pthread_mutex_unlock(&lazy_mutex);
+}
+
+/* Copy all sections of a set into memory of their own in a new set,
+ * which can then be changed. */
+struct razor_set *
+razor_set_copy(struct razor_set *set)
+{
+	struct razor_set *copy;
+	struct array *src, *dst;
+	int i;
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_ALL);
+
+	copy = zalloc(sizeof *copy);
+	for (i = 0; i < ARRAY_SIZE(razor_sections); i++) {
+		src = (void *) set + razor_sections[i].offset;
+		dst = (void *) copy + razor_sections[i].offset;
+		if (src->size > 0)
+			memcpy(array_add(dst, src->size),
+			       src->data, src->size);
+	}
+
+	return copy;
+}
+
+/* The importer and the merger build sets with no regard for the width
+ * of indices, so they check afterwards that none of the pools and
+ * string pools outgrew it.  If one did, some of the indices into it
+ * were truncated.  The counts come from int array sizes, so with
+ * RAZOR_WIDE_INDEX this never fails; the arrays themselves stop at
+ * 2 GiB first. */
+int
+razor_set_check_limits(struct razor_set *set)
+{
+	uint32_t counts[] = {
+		set->string_pool.size,
+		set->file_string_pool.size,
+		set->packages.size / sizeof (struct razor_package),
+		set->properties.size / sizeof (struct razor_property),
+		set->files.size / sizeof (struct razor_entry),
+		set->package_pool.size / sizeof (struct list),
+		set->property_pool.size / sizeof (struct list),
+		set->file_pool.size / sizeof (struct list)
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(counts); i++)
+		if (counts[i] >= RAZOR_INDEX_LIMIT) {
+			fprintf(stderr, "package set too large, razor needs "
+				"to be built with --enable-wide-indices\n");
+			return -1;
+		}
+
+	return 0;
+}
+
 RAZOR_EXPORT void
 razor_set_destroy(struct razor_set *set)
 {
@@ -173,6 +1072,16 @@ razor_set_destroy(struct razor_set *set)
 
 	assert (set != NULL);
 
+	if (set->view) {
+		if (set->view->added)
+			razor_set_destroy(set->view->added);
+		free(set->view->packages);
+		free(set->view->properties);
+		free(set->view);
+		free(set);
+		return;
+	}
+
 	if (set->mapped_files == NULL) {
 		for (i = 0; i < ARRAY_SIZE(razor_sections); i++) {
 			array = (void *) set + razor_sections[i].offset;
@@ -186,55 +1095,353 @@ razor_set_destroy(struct razor_set *set)
 		}
 	}
 
+	array_release(&set->deflated_sections);
+	free(set->filename);
 	free(set);
 }
 
+struct deflate_work {
+	const void **data;
+	void **buffers;
+	struct razor_set_section *sections;
+};
+
+/* Hash the sections and deflate the ones marked for it.  A section
+ * that doesn't get any smaller is stored as it is. */
+static void
+encode_range(uint32_t start, uint32_t end, void *data)
+{
+	struct deflate_work *work = data;
+	struct razor_set_section *s;
+	uLongf length;
+	uint32_t i;
+	void *buffer;
+
+	for (i = start; i < end; i++) {
+		s = &work->sections[i];
+		razor_hash128(work->data[i], s->data_size, s->hash);
+		if (!(s->flags & RAZOR_SECTION_DEFLATED))
+			continue;
+
+		length = compressBound(s->data_size);
+		buffer = malloc(length);
+		if (compress2(buffer, &length, work->data[i], s->data_size,
+			      Z_BEST_COMPRESSION) != Z_OK ||
+		    length >= s->data_size) {
+			free(buffer);
+			s->flags &= ~RAZOR_SECTION_DEFLATED;
+			continue;
+		}
+
+		free(work->buffers[i]);
+		work->buffers[i] = buffer;
+		work->data[i] = buffer;
+		s->size = length;
+	}
+}
+
+/* Hash a section the way it is written: little endian and not
+ * deflated. */
+static void
+hash_section(struct razor_set *set, int i, unsigned char *hash)
+{
+	struct razor_set_section_index *index = &razor_sections[i];
+	struct array *array = (void *) set + index->offset;
+	void *buffer;
+
+	if (HOST_BIG_ENDIAN && strcmp(index->layout, "b") != 0 &&
+	    array->size > 0) {
+		buffer = malloc(array->size);
+		convert_elements(buffer, index->element_size, 0, HOST_WIDE,
+				 array->data, index->element_size,
+				 HOST_BIG_ENDIAN, HOST_WIDE,
+				 array->size / index->element_size,
+				 index->layout);
+		razor_hash128(buffer, array->size, hash);
+		free(buffer);
+	} else {
+		razor_hash128(array->data, array->size, hash);
+	}
+}
+
+/* The fingerprint of a set is the hash of the names and hashes of all
+ * its sections but the optional ones.  Sections already hashed are
+ * passed in hashes, marked in known. */
+static void
+compute_fingerprint(struct razor_set *set,
+		    unsigned char (*hashes)[RAZOR_HASH_SIZE],
+		    const char *known, unsigned char *fingerprint)
+{
+	struct razor_set_section_index *index;
+	struct array buffer;
+	unsigned char *hash;
+	char *name;
+	int i;
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_ALL);
+
+	array_init(&buffer);
+	for (i = 0; i < ARRAY_SIZE(razor_sections); i++) {
+		index = &razor_sections[i];
+		if (!(index->flags & RAZOR_SECTION_ALL) ||
+		    (index->flags & SECTION_OPTIONAL))
+			continue;
+
+		name = array_add(&buffer, strlen(index->name) + 1);
+		strcpy(name, index->name);
+		hash = array_add(&buffer, RAZOR_HASH_SIZE);
+		if (known && known[i])
+			memcpy(hash, hashes[i], RAZOR_HASH_SIZE);
+		else
+			hash_section(set, i, hash);
+	}
+
+	razor_hash128(buffer.data, buffer.size, fingerprint);
+	array_release(&buffer);
+}
+
+/* Sets are shared between threads, so a fingerprint computed on
+ * demand is stored under the lazy section lock, and has_fingerprint
+ * is only set once the fingerprint is in place.  Two threads may both
+ * compute it; they get the same result and the first one is kept. */
+static void
+store_fingerprint(struct razor_set *set, const unsigned char *fingerprint)
+{
+	pthread_mutex_lock(&lazy_mutex);
+	if (!__sync_fetch_and_add(&set->has_fingerprint, 0)) {
+		memcpy(set->fingerprint, fingerprint, RAZOR_HASH_SIZE);
+		__sync_fetch_and_or(&set->has_fingerprint, 1);
+	}
+	pthread_mutex_unlock(&lazy_mutex);
+}
+
+/**
+ * razor_set_get_fingerprint:
+ * @set: a %razor_set
+ * @fingerprint: returns %RAZOR_FINGERPRINT_SIZE bytes
+ *
+ * Get a hash of the contents of @set.  Sets with the same packages,
+ * properties, files and details laid out the same way have the same
+ * fingerprint, however they were written, so it can key caches of
+ * anything derived from a set or tell that a downloaded set hasn't
+ * changed.  The fingerprint is stored when a set is written, so for
+ * a set opened from a file this is cheap; otherwise the whole set is
+ * hashed the first time.  A view or layer is compacted and the result
+ * hashed.
+ *
+ * Returns: 0, or -1 if @set is a view or layer that can't be
+ * compacted, in which case @fingerprint is all zeros.
+ **/
+RAZOR_EXPORT int
+razor_set_get_fingerprint(struct razor_set *set, unsigned char *fingerprint)
+{
+	unsigned char computed[RAZOR_HASH_SIZE];
+	struct razor_set *compact;
+	int status;
+
+	assert (set != NULL);
+	assert (fingerprint != NULL);
+
+	if (set->view) {
+		compact = razor_set_compact(set);
+		if (compact == NULL) {
+			memset(fingerprint, 0, RAZOR_HASH_SIZE);
+			return -1;
+		}
+		status = razor_set_get_fingerprint(compact, fingerprint);
+		razor_set_destroy(compact);
+		return status;
+	}
+
+	if (!__sync_fetch_and_add(&set->has_fingerprint, 0)) {
+		compute_fingerprint(set, NULL, NULL, computed);
+		store_fingerprint(set, computed);
+	}
+
+	memcpy(fingerprint, set->fingerprint, RAZOR_HASH_SIZE);
+
+	return 0;
+}
+
+/* Sets laid out for mapping have their cold sections written after
+ * all the others, so the pages used all the time are together. */
+static int
+section_pass(struct razor_set_section_index *index, uint32_t section_mask)
+{
+	return (section_mask & RAZOR_SECTION_PAGE_ALIGNED) &&
+		(index->flags & SECTION_COLD);
+}
+
+/* Sections start on a cache line, so the mapped elements are suitably
+ * aligned for vector loads.  Laid out for mapping, they start on a page
+ * of their own, so advice for one doesn't spill over to the next, and
+ * large sections start on a huge page. */
+static uint32_t
+section_alignment(uint32_t size, uint32_t section_mask)
+{
+	if ((section_mask & RAZOR_SECTION_PAGE_ALIGNED) == 0)
+		return RAZOR_SECTION_ALIGNMENT;
+	else if (size >= RAZOR_HUGE_PAGE_SIZE)
+		return RAZOR_HUGE_PAGE_SIZE;
+	else
+		return sysconf(_SC_PAGESIZE);
+}
+
+static int
+write_padding(int fd, uint32_t size)
+{
+	static const char padding[4096];
+	uint32_t length;
+
+	for (; size > 0; size -= length) {
+		length = size < sizeof padding ? size : sizeof padding;
+		if (razor_write(fd, padding, length) < 0)
+			return -1;
+	}
+
+	return 0;
+}
+
 RAZOR_EXPORT int
 razor_set_write_to_fd(struct razor_set *set, int fd, uint32_t section_mask)
 {
 	struct razor_set_header header;
-	struct razor_set_section sections[ARRAY_SIZE(razor_sections)];
+	struct razor_set_section sections[ARRAY_SIZE(razor_sections)], *s;
+	struct razor_set_section_index *index;
 	struct hashtable table;
-	struct array pool, *arrays[ARRAY_SIZE(razor_sections)];
-	uint32_t offset;
-	int count, i, j;
-	static const char padding[4];
+	struct array pool, *array;
+	const void *data[ARRAY_SIZE(razor_sections)];
+	void *buffers[ARRAY_SIZE(razor_sections)];
+	unsigned char hashes[ARRAY_SIZE(razor_sections)][RAZOR_HASH_SIZE];
+	char known[ARRAY_SIZE(razor_sections)];
+	int section_index[ARRAY_SIZE(razor_sections)];
+	struct deflate_work work;
+	struct razor_set *compact;
+	uint32_t offset, size;
+	int count, i, j, k, status;
+
+	/* Views and layers are written compacted, unless only the
+	 * changes of a layer are asked for. */
+	if (set->view && (section_mask & RAZOR_SECTION_DELTA))
+		return razor_set_write_delta_to_fd(set, fd,
+						   section_mask);
+	if (set->view) {
+		compact = razor_set_compact(set);
+		if (compact == NULL)
+			return -1;
+		status = razor_set_write_to_fd(compact, fd, section_mask);
+		razor_set_destroy(compact);
+		return status;
+	}
+
+	razor_set_bind_lazy_sections(set, section_mask & RAZOR_SECTION_ALL);
 
 	array_init(&pool);
 	hashtable_init(&table, &pool);
 
+	/* The sections are written in two passes, see
+	 * section_pass(). */
 	j = 0;
-	for (i = 0; i < ARRAY_SIZE(razor_sections); i++) {
-		if ((razor_sections[i].flags & section_mask) == 0)
+	for (k = 0; k < ARRAY_SIZE(razor_sections) * 2; k++) {
+		i = k % ARRAY_SIZE(razor_sections);
+		index = &razor_sections[i];
+		if ((index->flags & section_mask) == 0 ||
+		    section_pass(index, section_mask) !=
+		    k / ARRAY_SIZE(razor_sections))
 			continue;
 
-		arrays[j] = (void *) set + razor_sections[i].offset;
-		sections[j].name =
-			hashtable_tokenize(&table, razor_sections[i].name);
+		array = (void *) set + index->offset;
+		if ((index->flags & SECTION_OPTIONAL) && array->size == 0)
+			continue;
+		s = &sections[j];
+		s->name = hashtable_tokenize(&table, index->name);
+		s->size = array->size;
+		s->flags = 0;
+		s->data_size = array->size;
+		s->element_size = index->element_size;
+		s->version = index->version;
+		if (HOST_WIDE && strchr(index->layout, 'l') != NULL)
+			s->version = SECTION_VERSION(SECTION_WIDE_MAJOR,
+						     index->version & 0xffff);
+		if ((section_mask & RAZOR_SECTION_COMPRESSED) &&
+		    (index->flags & SECTION_COLD) && array->size > 0)
+			s->flags = RAZOR_SECTION_DEFLATED;
+
+		section_index[j] = i;
+		data[j] = array->data;
+		buffers[j] = NULL;
+		if (HOST_BIG_ENDIAN && strcmp(index->layout, "b") != 0 &&
+		    array->size > 0) {
+			buffers[j] = malloc(array->size);
+			convert_elements(buffers[j], index->element_size,
+					 0, HOST_WIDE,
+					 array->data, index->element_size,
+					 HOST_BIG_ENDIAN, HOST_WIDE,
+					 array->size / index->element_size,
+					 index->layout);
+			data[j] = buffers[j];
+		}
 		j++;
 	}
 
 	count = j;
-	header.magic = RAZOR_MAGIC;
-	header.version = RAZOR_VERSION;
-	header.num_sections = count;
-	offset = sizeof header + count * sizeof *sections + ALIGN(pool.size, 4);
+
+	/* The sections are hashed and the cold ones deflated in
+	 * parallel; the hot ones are written as they are, so they can be
+	 * used straight from the mapped file. */
+	work.data = data;
+	work.buffers = buffers;
+	work.sections = sections;
+	razor_parallel_for(count, 0, encode_range, &work);
+
+	if (!__sync_fetch_and_add(&set->has_fingerprint, 0)) {
+		memset(known, 0, sizeof known);
+		for (j = 0; j < count; j++) {
+			memcpy(hashes[section_index[j]], sections[j].hash,
+			       RAZOR_HASH_SIZE);
+			known[section_index[j]] = 1;
+		}
+		compute_fingerprint(set, hashes, known, header.fingerprint);
+		store_fingerprint(set, header.fingerprint);
+	}
+	memcpy(header.fingerprint, set->fingerprint, RAZOR_HASH_SIZE);
+
+	header.magic = to_le32(RAZOR_MAGIC);
+	header.version = to_le32(RAZOR_VERSION);
+	header.num_sections = to_le32(count);
+	header.header_size = to_le32(sizeof header);
+	header.section_size = to_le32(sizeof *sections);
+	offset = sizeof header + count * sizeof *sections + pool.size;
 
 	for (i = 0; i < count; i++) {
-		sections[i].offset = offset;
-		sections[i].size = arrays[i]->size;
-		offset += ALIGN(arrays[i]->size, 4);
+		s = &sections[i];
+		size = s->size;
+		s->offset = ALIGN(offset, section_alignment(size, section_mask));
+		offset = s->offset + size;
+
+		s->name = to_le32(s->name);
+		s->offset = to_le32(s->offset);
+		s->size = to_le32(s->size);
+		s->flags = to_le32(s->flags);
+		s->data_size = to_le32(s->data_size);
+		s->element_size = to_le32(s->element_size);
+		s->version = to_le32(s->version);
 	}
 
 	razor_write(fd, &header, sizeof header);
 	razor_write(fd, sections, count * sizeof *sections);
 	razor_write(fd, pool.data, pool.size);
-	razor_write(fd, padding, PADDING(pool.size, 4));
 
+	offset = sizeof header + count * sizeof *sections + pool.size;
 	for (i = 0; i < count; i++) {
-		razor_write(fd, arrays[i]->data, arrays[i]->size);
-		razor_write(fd, padding, PADDING(arrays[i]->size, 4));
+		s = &sections[i];
+		write_padding(fd, load32(&s->offset, 0) - offset);
+		size = load32(&s->size, 0);
+		razor_write(fd, data[i], size);
+		offset = load32(&s->offset, 0) + size;
+		free(buffers[i]);
 	}
+	write_padding(fd, PADDING(offset, RAZOR_SECTION_ALIGNMENT));
 
 	array_release(&pool);
 	hashtable_release(&table);
@@ -260,6 +1467,86 @@ razor_set_write(struct razor_set *set, const char *filename, uint32_t sections)
 	return close(fd);
 }
 
+/**
+ * razor_set_write_split:
+ * @set: the %razor_set to write
+ * @filename: the file to write the main sections to
+ * @flags: %RAZOR_SECTION_COMPRESSED to compress the string pools of
+ * the sidecar files, %RAZOR_SECTION_PAGE_ALIGNED to lay the files out
+ * for mapping, or 0
+ *
+ * Write the main sections of @set to @filename and the files and
+ * details sections to sidecar files next to it, foo-files.rzdb and
+ * foo-details.rzdb for foo.rzdb.  A set opened from @filename with
+ * razor_set_open() then only maps the sidecars when they are used,
+ * which most queries never do.  The three files belong together and
+ * must be replaced together.
+ *
+ * Returns: 0 on success, -1 if a file can't be written.
+ **/
+RAZOR_EXPORT int
+razor_set_write_split(struct razor_set *set, const char *filename,
+		      uint32_t flags)
+{
+	static const uint32_t groups[] = {
+		RAZOR_SECTION_FILES, RAZOR_SECTION_DETAILS
+	};
+	char *path;
+	int i, status;
+
+	assert (set != NULL);
+	assert (filename != NULL);
+
+	flags &= RAZOR_SECTION_COMPRESSED | RAZOR_SECTION_PAGE_ALIGNED;
+
+	/* Write the sidecars first, so that a main file never refers
+	 * to sidecars that aren't there yet. */
+	for (i = 0; i < ARRAY_SIZE(groups); i++) {
+		path = sidecar_filename(filename, groups[i]);
+		if (path == NULL)
+			return -1;
+		status = razor_set_write(set, path, groups[i] | flags);
+		free(path);
+		if (status < 0)
+			return -1;
+	}
+
+	return razor_set_write(set, filename, RAZOR_SECTION_MAIN | flags);
+}
+
+/* Build the optional indexes given by the %razor_index_type mask for
+ * a set whose packages, properties and files are complete. */
+void
+razor_set_build_indexes(struct razor_set *set, uint32_t indexes)
+{
+	if (indexes & RAZOR_INDEX_SEARCH)
+		razor_set_build_search_index(set);
+	if (indexes & RAZOR_INDEX_DEPENDENCIES)
+		razor_set_build_dependency_graph(set);
+	if (indexes & RAZOR_INDEX_FILE_HASH)
+		razor_set_build_file_hash(set);
+	if (indexes & RAZOR_INDEX_BASENAME)
+		razor_set_build_basename_index(set);
+}
+
+/* Returns the mask of optional indexes present in a set. */
+uint32_t
+razor_set_get_indexes(struct razor_set *set)
+{
+	uint32_t indexes = 0;
+
+	if (set->search_trigrams.size > 0)
+		indexes |= RAZOR_INDEX_SEARCH;
+	if (set->requires_graph.size > 0)
+		indexes |= RAZOR_INDEX_DEPENDENCIES;
+	if (set->file_hash.size > 0)
+		indexes |= RAZOR_INDEX_FILE_HASH;
+	if (set->basenames.size > 0)
+		indexes |= RAZOR_INDEX_BASENAME;
+
+	return indexes;
+}
+
 RAZOR_EXPORT void
 razor_build_evr(char *evr_buf, int size, const char *epoch,
 		const char *version, const char *release)
@@ -330,6 +1617,10 @@ razor_package_get_details_type(struct razor_set *set,
 {
 	const char *pool;
 
+	if (type != RAZOR_DETAIL_NAME && type != RAZOR_DETAIL_VERSION &&
+	    type != RAZOR_DETAIL_ARCH)
+		razor_set_bind_lazy_sections(set, RAZOR_SECTION_DETAILS);
+
 	switch (type) {
 	case RAZOR_DETAIL_NAME:
 		pool = set->string_pool.data;
@@ -380,6 +1671,7 @@ razor_package_get_details_varg(struct razor_set *set,
 	enum razor_detail_type type;
 	const char **data;
 
+	set = razor_set_package_owner(set, package);
 	for (i = 0;; i += 2) {
 		type = va_arg(args, enum razor_detail_type);
 		if (type == RAZOR_DETAIL_LAST)
@@ -460,92 +1752,299 @@ razor_property_type_to_string(struct razor_property *p)
 	}
 }
 
+/* Compare a path component of the given length to an entry name the
+ * way razor_compare_filenames() orders them: bytewise as unsigned
+ * chars, a prefix sorting first. */
+static int
+compare_component(const char *name, const char *component, int length)
+{
+	int cmp;
+
+	cmp = strncmp(name, component, length);
+	if (cmp == 0 && name[length] != '\0')
+		return 1;
+
+	return cmp;
+}
+
+/* Binary search the directory entries from first to last for a path
+ * component. */
+static struct razor_entry *
+find_component(struct razor_entry *first, struct razor_entry *last,
+	       const char *pool, const char *component, int length)
+{
+	int lo, hi, mid, cmp;
+
+	lo = 0;
+	hi = last - first + 1;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		cmp = compare_component(&pool[first[mid].name],
+					component, length);
+		if (cmp < 0)
+			lo = mid + 1;
+		else if (cmp > 0)
+			hi = mid;
+		else
+			return &first[mid];
+	}
+
+	return NULL;
+}
+
 RAZOR_EXPORT struct razor_entry *
 razor_set_find_entry(struct razor_set *set,
 		     struct razor_entry *dir, const char *pattern)
 {
-	struct razor_entry *e;
-	const char *n, *pool = set->file_string_pool.data;
-	int len;
+	struct razor_entry *entries, *first, *last, *e;
+	const char *pool;
+	int length;
 
 	assert (set != NULL);
 	assert (dir != NULL);
 	assert (pattern != NULL);
 
-	e = (struct razor_entry *) set->files.data + dir->start;
-	do {
-		n = pool + e->name;
-		if (strcmp(pattern + 1, n) == 0)
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	entries = set->files.data;
+	pool = set->file_string_pool.data;
+	if (dir == entries && set->file_hash.size > 0 &&
+	    pattern[0] == '/' && pattern[1] != '\0')
+		return razor_set_find_hashed_entry(set, pattern);
+
+	while (dir->start != 0) {
+		first = entries + dir->start;
+		for (last = first; !(last->flags & RAZOR_ENTRY_LAST); last++)
+			;
+
+		length = strcspn(pattern + 1, "/");
+		e = find_component(first, last, pool, pattern + 1, length);
+		if (e == NULL)
+			return NULL;
+
+		pattern += length + 1;
+		if (*pattern == '\0')
 			return e;
-		len = strlen(n);
-		if (e->start != 0 && strncmp(pattern + 1, n, len) == 0 &&
-		    pattern[len + 1] == '/') {
-			return razor_set_find_entry(set, e, pattern + len + 1);
-		}
-	} while (!((e++)->flags & RAZOR_ENTRY_LAST));
+		dir = e;
+	}
 
 	return NULL;
 }
 
-static void
-list_dir(struct razor_set *set, struct razor_entry *dir,
-	 char *prefix, const char *pattern)
+struct lookup_level {
+	struct razor_entry *dir;
+	struct razor_entry *cursor;
+	struct razor_entry *match;
+	const char *name;
+	int length;
+};
+
+static int
+compare_paths(const void *p1, const void *p2, void *data)
 {
-	struct razor_entry *e;
-	const char *n, *pool = set->file_string_pool.data;
+	const char * const *s1 = p1, * const *s2 = p2;
 
-	e = (struct razor_entry *) set->files.data + dir->start;
-	do {
-		n = pool + e->name;
-		if (pattern && pattern[0] && fnmatch(pattern, n, 0) != 0)
-			continue;
-		printf("%s/%s\n", prefix, n);
-		if (e->start) {
-			char *sub = prefix + strlen (prefix);
-			*sub = '/';
-			strcpy (sub + 1, n);
-			list_dir(set, e, prefix, pattern);
-			*sub = '\0';
+	return razor_compare_filenames(*s1, *s2);
+}
+
+/* Advance the cursor of a level to the entry for its component.  The
+ * components looked up in a directory come in sorted order, so the
+ * cursor never has to move back. */
+static struct razor_entry *
+advance_level(struct lookup_level *level, const char *pool)
+{
+	int cmp;
+
+	while (level->cursor) {
+		cmp = compare_component(&pool[level->cursor->name],
+					level->name, level->length);
+		if (cmp == 0)
+			return level->cursor;
+		if (cmp > 0)
+			return NULL;
+		if (level->cursor->flags & RAZOR_ENTRY_LAST)
+			level->cursor = NULL;
+		else
+			level->cursor++;
+	}
+
+	return NULL;
+}
+
+/**
+ * razor_set_lookup_files:
+ * @set: a %razor_set
+ * @paths: an array of absolute paths
+ * @count: the number of paths in @paths
+ * @callback: called once for each path
+ * @data: user data passed to @callback
+ *
+ * Find the owners of many files at once.  The paths are sorted in
+ * file tree order and looked up with a single walk over the file tree
+ * of @set, so each directory is only scanned once no matter how many
+ * of the paths are in it.  @callback is called with each path, its
+ * index in @paths and an iterator for the packages owning it, in file
+ * tree order.  The iterator is only valid during the callback and
+ * must not be destroyed; it yields no packages for paths that aren't
+ * in the set.
+ **/
+RAZOR_EXPORT void
+razor_set_lookup_files(struct razor_set *set,
+		       const char * const *paths, int count,
+		       razor_file_callback_t callback, void *data)
+{
+	struct razor_package_iterator owners;
+	struct razor_entry *entries, *entry;
+	struct lookup_level *l;
+	struct array stack;
+	const char **sorted, *pool, *p;
+	uint32_t *map;
+	int i, depth, valid;
+
+	assert (set != NULL);
+	assert (paths != NULL || count == 0);
+	assert (callback != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+
+	if (count == 0)
+		return;
+
+	sorted = malloc(count * sizeof *sorted);
+	memcpy(sorted, paths, count * sizeof *sorted);
+	map = razor_qsort_with_data(sorted, count, sizeof *sorted,
+				    compare_paths, NULL);
+
+	entries = set->files.data;
+	pool = set->file_string_pool.data;
+
+	/* Level d holds the directory searched for the d-th component
+	 * of the current path; valid counts the levels that the
+	 * current path shares with the previous one. */
+	array_init(&stack);
+	valid = 0;
+	for (i = 0; i < count; i++) {
+		entry = NULL;
+		p = sorted[i];
+		if (p[0] != '/' || entries == NULL)
+			goto report;
+
+		for (depth = 0; *p == '/'; depth++) {
+			p++;
+			if (depth < valid) {
+				l = (struct lookup_level *) stack.data + depth;
+				if (l->length == strcspn(p, "/") &&
+				    strncmp(l->name, p, l->length) == 0) {
+					entry = l->match;
+					p += l->length;
+					if (entry == NULL)
+						break;
+					continue;
+				}
+				/* Same directory, a later name. */
+				valid = depth + 1;
+			} else {
+				if (depth == stack.size / sizeof *l)
+					array_add(&stack, sizeof *l);
+				l = (struct lookup_level *) stack.data + depth;
+				l->dir = depth == 0 ? entries : l[-1].match;
+				l->cursor = l->dir->start ?
+					entries + l->dir->start : NULL;
+				valid = depth + 1;
+			}
+
+			l->name = p;
+			l->length = strcspn(p, "/");
+			l->match = advance_level(l, pool);
+			entry = l->match;
+			p += l->length;
+			if (entry == NULL || (*p == '/' && entry->start == 0)) {
+				entry = NULL;
+				break;
+			}
 		}
-	} while (!((e++)->flags & RAZOR_ENTRY_LAST));
+		if (*p != '\0')
+			entry = NULL;
+
+	report:
+		memset(&owners, 0, sizeof owners);
+		owners.set = set;
+		if (entry)
+			owners.index = list_first(&entry->packages,
+						  &set->package_pool);
+		callback(sorted[i], map[i], &owners, data);
+	}
+
+	array_release(&stack);
+	free(sorted);
+	free(map);
 }
 
 RAZOR_EXPORT void
 razor_set_list_files(struct razor_set *set, const char *pattern)
 {
+	struct razor_file_iterator *fi;
 	struct razor_entry *e;
-	char buffer[512], *p, *base;
+	const char *path;
+	char *prefix, *p, *base;
 
 	assert (set != NULL);
 
-	if (pattern == NULL || !strcmp (pattern, "/")) {
-		buffer[0] = '\0';
-		list_dir(set, set->files.data, buffer, NULL);
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	if (set->files.size == 0)
 		return;
-	}
 
-	strcpy(buffer, pattern);
-	e = razor_set_find_entry(set, set->files.data, buffer);
-	if (e && e->start > 0) {
+	if (pattern == NULL || !strcmp (pattern, "/")) {
+		prefix = NULL;
 		base = NULL;
 	} else {
-		p = strrchr(buffer, '/');
-		if (p) {
+		prefix = strdup(pattern);
+		e = razor_set_find_entry(set, set->files.data, prefix);
+		p = strrchr(prefix, '/');
+		if ((e && e->start > 0) || p == NULL) {
+			base = NULL;
+		} else {
 			*p = '\0';
 			base = p + 1;
-		} else {
-			base = NULL;
 		}
 	}
-	e = razor_set_find_entry(set, set->files.data, buffer);
-	if (e && e->start != 0)
-		list_dir(set, e, buffer, base);
+
+	fi = razor_file_iterator_create(set, prefix, base);
+	while (razor_file_iterator_next(fi, &path, NULL, NULL)) {
+		fputs(path, stdout);
+		putchar('\n');
+	}
+	razor_file_iterator_destroy(fi);
+	free(prefix);
+}
+
+/* Append "/name" to the path in prefix and return the old length. */
+static int
+push_path(struct array *prefix, const char *name)
+{
+	int len, name_len;
+	char *p;
+
+	len = prefix->size - 1;
+	name_len = strlen(name);
+	array_add(prefix, name_len + 1);
+	p = (char *) prefix->data + len;
+	p[0] = '/';
+	memcpy(p + 1, name, name_len + 1);
+
+	return len;
+}
+
+static void
+pop_path(struct array *prefix, int len)
+{
+	((char *) prefix->data)[len] = '\0';
+	prefix->size = len + 1;
 }
 
 static struct list *
 list_package_files(struct razor_set *set, struct list *r,
 		   struct razor_entry *dir, uint32_t end,
-		   char *prefix)
+		   struct array *prefix)
 {
 	struct razor_entry *e, *f, *entries;
 	uint32_t next, file;
@@ -558,7 +2057,7 @@ list_package_files(struct razor_set *set, struct list *r,
 	e = entries + dir->start;
 	do {
 		if (entries + r->data == e) {
-			printf("%s/%s\n", prefix, pool + e->name);
+			printf("%s/%s\n", (char *) prefix->data, pool + e->name);
 			r = list_next(r);
 			if (!r)
 				return NULL;
@@ -586,32 +2085,272 @@ list_package_files(struct razor_set *set, struct list *r,
 
 		file = r->data;
 		if (e->start <= file && file < next) {
-			len = strlen(prefix);
-			prefix[len] = '/';
-			strcpy(prefix + len + 1, pool + e->name);
+			len = push_path(prefix, pool + e->name);
 			r = list_package_files(set, r, e, next, prefix);
-			prefix[len] = '\0';
+			pop_path(prefix, len);
 		}
 	} while (!((e++)->flags & RAZOR_ENTRY_LAST) && r != NULL);
 
 	return r;
 }
 
+/* Set prefix to the path of directory dir by walking up its parents,
+ * using chain as scratch space.  The root directory has the empty
+ * path.  The set must have the parent index. */
+void
+razor_set_get_dir_path(struct razor_set *set, uint32_t dir,
+		       struct array *prefix, struct array *chain)
+{
+	struct razor_entry *entries;
+	uint32_t *parents, *d, *start;
+	char *pool;
+
+	entries = set->files.data;
+	parents = set->file_parents.data;
+	pool = set->file_string_pool.data;
+
+	chain->size = 0;
+	for (; dir != 0; dir = parents[dir]) {
+		d = array_add(chain, sizeof *d);
+		*d = dir;
+	}
+
+	pop_path(prefix, 0);
+	start = chain->data;
+	for (d = chain->data + chain->size; d > start; d--)
+		push_path(prefix, pool + entries[d[-1]].name);
+}
+
+static uint32_t
+dir_depth(uint32_t *parents, uint32_t dir)
+{
+	uint32_t depth;
+
+	for (depth = 0; dir != 0; dir = parents[dir])
+		depth++;
+
+	return depth;
+}
+
+/* Order file entries the way walking the tree depth first lists them:
+ * the entries of a directory come before the contents of its
+ * subdirectories, and siblings are in entry order. */
+static int
+compare_depth_first(const void *p1, const void *p2, void *data)
+{
+	struct razor_set *set = data;
+	uint32_t *parents = set->file_parents.data;
+	uint32_t a = *(const uint32_t *) p1, b = *(const uint32_t *) p2;
+	uint32_t depth_a, depth_b;
+
+	if (parents[a] == parents[b])
+		return (a > b) - (a < b);
+
+	/* Lift the deeper entry until both are at the same depth; if
+	 * they then share a directory, the one lifted is in a
+	 * subdirectory of it and comes last. */
+	a = parents[a];
+	b = parents[b];
+	depth_a = dir_depth(parents, a);
+	depth_b = dir_depth(parents, b);
+	for (; depth_a > depth_b; depth_a--)
+		a = parents[a];
+	if (a == b)
+		return 1;
+	for (; depth_b > depth_a; depth_b--)
+		b = parents[b];
+	if (a == b)
+		return -1;
+
+	while (parents[a] != parents[b]) {
+		a = parents[a];
+		b = parents[b];
+	}
+
+	return (a > b) - (a < b);
+}
+
+/* The first item of the file list of package.  The list is empty if
+ * the files of the set couldn't be bound, as when the sidecar file
+ * is missing, since the package lists then point at nothing. */
+struct list *
+razor_set_first_package_file(struct razor_set *set,
+			     struct razor_package *package)
+{
+	if (set->files.size == 0)
+		return NULL;
+
+	return list_first(&package->files, &set->file_pool);
+}
+
+/* The files of a package are sorted by entry index, which lists the
+ * tree breadth first, so they are sorted depth first to list them in
+ * the same order as walking the tree.  The path of the directory is
+ * cached between files. */
+static void
+list_package_files_by_parent(struct razor_set *set, struct list *r,
+			     struct array *prefix)
+{
+	struct razor_entry *entries;
+	struct array chain, files;
+	uint32_t *parents, *f, *end, dir;
+	char *pool;
+
+	entries = set->files.data;
+	parents = set->file_parents.data;
+	pool = set->file_string_pool.data;
+
+	array_init(&files);
+	for (; r != NULL; r = list_next(r)) {
+		f = array_add(&files, sizeof *f);
+		*f = r->data;
+	}
+	free(razor_qsort_with_data(files.data, files.size / sizeof *f,
+				   sizeof *f, compare_depth_first, set));
+
+	array_init(&chain);
+	dir = 0;
+	end = files.data + files.size;
+	for (f = files.data; f < end; f++) {
+		if (parents[*f] != dir) {
+			dir = parents[*f];
+			razor_set_get_dir_path(set, dir, prefix, &chain);
+		}
+		printf("%s/%s\n", (char *) prefix->data,
+		       pool + entries[*f].name);
+	}
+	array_release(&chain);
+	array_release(&files);
+}
+
 RAZOR_EXPORT void
 razor_set_list_package_files(struct razor_set *set,
 			     struct razor_package *package)
 {
 	struct list *r;
+	struct array prefix;
 	uint32_t end;
-	char buffer[512];
+	char *p;
 
 	assert (set != NULL);
 	assert (package != NULL);
 
-	r = list_first(&package->files, &set->file_pool);
+	set = razor_set_package_owner(set, package);
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	r = razor_set_first_package_file(set, package);
+	if (r == NULL)
+		return;
+
 	end = set->files.size / sizeof (struct razor_entry);
-	buffer[0] = '\0';
-	list_package_files(set, r, set->files.data, end, buffer);
+	array_init(&prefix);
+	p = array_add(&prefix, 1);
+	*p = '\0';
+
+	/* Sets written before the parent index existed are listed by
+	 * scanning the directories. */
+	if (set->file_parents.size / sizeof (uint32_t) == end)
+		list_package_files_by_parent(set, r, &prefix);
+	else
+		list_package_files(set, r, set->files.data, end, &prefix);
+	array_release(&prefix);
+}
+
+static void
+report_basename_entry(struct razor_set *set, uint32_t entry,
+		      const char *path, int index,
+		      razor_file_callback_t callback, void *data)
+{
+	struct razor_entry *entries = set->files.data;
+	struct razor_package_iterator owners;
+
+	memset(&owners, 0, sizeof owners);
+	owners.set = set;
+	owners.index = list_first(&entries[entry].packages,
+				  &set->package_pool);
+	callback(path, index, &owners, data);
+}
+
+/**
+ * razor_set_find_basename:
+ * @set: a %razor_set
+ * @name: a file name without any directory part
+ * @callback: called once for each file named @name
+ * @data: user data passed to @callback
+ *
+ * Find all files and directories called @name anywhere in the file
+ * tree of @set.  @callback is called with the full path of each of
+ * them, a running count and an iterator for the packages owning it,
+ * in no particular order.
+ * The iterator is only valid during the callback and must not be
+ * destroyed.  If the set has a basename index the files are looked up
+ * directly, otherwise the whole tree is walked.
+ *
+ * Returns: the number of files found.
+ **/
+RAZOR_EXPORT int
+razor_set_find_basename(struct razor_set *set, const char *name,
+			razor_file_callback_t callback, void *data)
+{
+	struct razor_basename *basename;
+	struct razor_file_iterator *fi;
+	struct razor_package_iterator *owners;
+	struct razor_entry *entries;
+	struct array prefix, chain;
+	uint32_t *parents, *e, *end, dir;
+	const char *pool, *path;
+	char *p;
+	int count, len;
+
+	assert (set != NULL);
+	assert (name != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	assert (callback != NULL);
+
+	entries = set->files.data;
+	count = set->files.size / sizeof *entries;
+	if (set->basenames.size == 0 ||
+	    set->file_parents.size / sizeof *parents != count) {
+		count = 0;
+		fi = razor_file_iterator_create(set, NULL, NULL);
+		while (razor_file_iterator_next(fi, &path, NULL, &owners))
+			if (strcmp(strrchr(path, '/') + 1, name) == 0)
+				callback(path, count++, owners, data);
+		razor_file_iterator_destroy(fi);
+
+		return count;
+	}
+
+	basename = razor_set_find_basename_entries(set, name);
+	if (basename == NULL)
+		return 0;
+
+	parents = set->file_parents.data;
+	pool = set->file_string_pool.data;
+	array_init(&prefix);
+	array_init(&chain);
+	p = array_add(&prefix, 1);
+	*p = '\0';
+
+	count = 0;
+	dir = 0;
+	e = (uint32_t *) set->basename_entries.data + basename->entries;
+	end = e + basename->count;
+	for (; e < end; e++) {
+		if (parents[*e] != dir) {
+			dir = parents[*e];
+			razor_set_get_dir_path(set, dir, &prefix, &chain);
+		}
+		len = push_path(&prefix, pool + entries[*e].name);
+		report_basename_entry(set, *e, prefix.data, count++,
+				      callback, data);
+		pop_path(&prefix, len);
+	}
+
+	array_release(&prefix);
+	array_release(&chain);
+
+	return count;
 }
 
 /* The diff order matters.  We should sort the packages so that a
@@ -26,7 +26,73 @@ enum razor_section_type {
 	RAZOR_SECTION_MAIN = 0x01,
 	RAZOR_SECTION_DETAILS = 0x02,
 	RAZOR_SECTION_FILES = 0x04,
-	RAZOR_SECTION_ALL = 0x07
+	RAZOR_SECTION_ALL = 0x07,
+	/* Write flag: deflate the large string pools. */
+	RAZOR_SECTION_COMPRESSED = 0x100,
+	/* Write flag: only write the changes of a layer. */
+	RAZOR_SECTION_DELTA = 0x200,
+	/* Write flag: hot sections first, on pages of their own. */
+	RAZOR_SECTION_PAGE_ALIGNED = 0x400
+};
+
+enum razor_open_flags {
+	RAZOR_OPEN_POPULATE = 0x01,
+	RAZOR_OPEN_VERIFY = 0x02
+};
+
+#define RAZOR_FINGERPRINT_SIZE 16
+
+enum razor_advice {
+	RAZOR_ADVISE_NORMAL = 0x01,
+	RAZOR_ADVISE_SEQUENTIAL = 0x02,
+	RAZOR_ADVISE_RANDOM = 0x04,
+	RAZOR_ADVISE_WILLNEED = 0x08,
+	RAZOR_ADVISE_HUGEPAGE = 0x10
+};
+
+enum razor_index_type {
+	RAZOR_INDEX_SEARCH = 0x01,
+	RAZOR_INDEX_DEPENDENCIES = 0x02,
+	RAZOR_INDEX_FILE_HASH = 0x04,
+	RAZOR_INDEX_BASENAME = 0x08
+};
+
+enum razor_file_flags {
+	RAZOR_FILE_CONFIG = 0x01,
+	RAZOR_FILE_NOREPLACE = 0x02,
+	RAZOR_FILE_GHOST = 0x04,
+	RAZOR_FILE_DOC = 0x08,
+	RAZOR_FILE_MISSINGOK = 0x10
+};
+
+enum razor_file_detail_type {
+	RAZOR_FILE_DETAIL_LAST = 0,	/* the sentinel */
+	RAZOR_FILE_DETAIL_SIZE,
+	RAZOR_FILE_DETAIL_MODE,
+	RAZOR_FILE_DETAIL_MTIME,
+	RAZOR_FILE_DETAIL_DIGEST,
+	RAZOR_FILE_DETAIL_FLAGS
+};
+
+/* The size of the binary MD5 file digests. */
+#define RAZOR_DIGEST_SIZE 16
+
+enum razor_verify_flags {
+	RAZOR_VERIFY_FULL = 0x01,
+	RAZOR_VERIFY_NO_DIGEST = 0x02
+};
+
+enum razor_verify_result {
+	RAZOR_VERIFY_MISSING = 0x01,
+	RAZOR_VERIFY_SIZE = 0x02,
+	RAZOR_VERIFY_MODE = 0x04,
+	RAZOR_VERIFY_MTIME = 0x08,
+	RAZOR_VERIFY_DIGEST = 0x10,
+	RAZOR_VERIFY_UNREADABLE = 0x20
+};
+
+enum razor_view_flags {
+	RAZOR_VIEW_LATEST = 0x01
 };
 
 enum razor_detail_type {
@@ -68,6 +134,18 @@ enum razor_property_flags {
  *
  * This object represents a set of packages, their dependency
  * information, the file lists and a number of other details.
+ *
+ * Once created, a set is never modified, so any number of threads may
+ * read the same set at the same time: iterators, queries, details
+ * lookups, file listings and the transaction and diff functions only
+ * read from the set.  Each iterator or query object must only be used
+ * by one thread at a time.  Destroying a set, and the importer and
+ * merger objects that build one, need external synchronisation.  The
+ * sidecar files of a set written with razor_set_write_split() are
+ * mapped, and compressed sections inflated, under a lock the first
+ * time any thread needs them.  Likewise, the fingerprint of a set that
+ * wasn't read from a file is computed the first time it is asked for
+ * and stored under that lock.
  **/
 
 struct razor_set;
@@ -83,16 +161,68 @@ struct razor_property;
  **/
 struct razor_set *razor_set_create(void);
 struct razor_set *razor_set_open(const char *filename);
+struct razor_set *razor_set_open_with_flags(const char *filename,
+					    uint32_t flags);
+int razor_set_advise(struct razor_set *set,
+		     uint32_t section_mask, uint32_t advice);
+void razor_set_prefetch(struct razor_set *set, uint32_t section_mask);
 void razor_set_destroy(struct razor_set *set);
+int razor_set_get_fingerprint(struct razor_set *set,
+			      unsigned char *fingerprint);
 int razor_set_write_to_fd(struct razor_set *set,
 			  int fd, uint32_t section_mask);
 int razor_set_write(struct razor_set *set,
 		    const char *filename, uint32_t setions);
+int razor_set_write_split(struct razor_set *set, const char *filename,
+			  uint32_t flags);
 int razor_set_bind_sections(struct razor_set *set, const char *filename);
 
 struct razor_package *
 razor_set_get_package(struct razor_set *set, const char *package);
 
+struct razor_package_iterator;
+
+struct razor_set *razor_set_create_view(struct razor_set *set,
+				       const char * const *arches,
+				       uint32_t flags);
+
+struct razor_set *razor_set_create_layer(struct razor_set *base);
+struct razor_set *razor_set_open_layer(struct razor_set *base,
+				       const char *filename);
+int razor_set_add_package(struct razor_set *layer, struct razor_set *set,
+			  struct razor_package *package);
+int razor_set_remove_package(struct razor_set *layer,
+			     struct razor_package *package);
+struct razor_set *razor_set_compact(struct razor_set *set);
+struct razor_set *razor_set_repack(struct razor_set *set);
+void razor_set_count_page_touches(struct razor_set *set, uint32_t *properties,
+				  uint32_t *files, uint32_t *packages);
+struct razor_set *razor_set_create_delta(struct razor_set *old,
+					 struct razor_set *new);
+struct razor_set *razor_set_apply_delta(struct razor_set *old,
+					const char *filename);
+int razor_set_write_deltas(struct razor_set *set, struct razor_set **old,
+			   int count, const char *filename, const char *index);
+int razor_delta_index_lookup(const char *index, struct razor_set *set,
+			     uint32_t *offset, uint32_t *size);
+
+typedef void (*razor_package_callback_t)(struct razor_package *package,
+					 void *data);
+
+int razor_set_reverse_closure(struct razor_set *set,
+			      struct razor_package_iterator *pi,
+			      razor_package_callback_t callback, void *data);
+
+typedef void (*razor_property_callback_t)(struct razor_property *property,
+					  void *data);
+
+void razor_set_parallel_for_packages(struct razor_set *set,
+				     razor_package_callback_t callback,
+				     void *data, int nthreads);
+void razor_set_parallel_for_properties(struct razor_set *set,
+				       razor_property_callback_t callback,
+				       void *data, int nthreads);
+
 void
 razor_package_get_details(struct razor_set *set,
 			  struct razor_package *package, ...);
@@ -144,6 +274,18 @@ struct razor_package_iterator *
 razor_package_iterator_create_for_file(struct razor_set *set,
 				       const char *filename);
 
+/**
+ * razor_package_iterator_create_for_search:
+ *
+ * Create a new #razor_package_iterator object for the packages whose
+ * name, summary, description or url contain the given term.
+ *
+ * Returns: the new #razor_package_iterator object.
+ **/
+struct razor_package_iterator *
+razor_package_iterator_create_for_search(struct razor_set *set,
+					 const char *term);
+
 int razor_package_iterator_next(struct razor_package_iterator *pi,
 				struct razor_package **package, ...);
 void razor_package_iterator_destroy(struct razor_package_iterator *pi);
@@ -156,9 +298,44 @@ razor_package_query_add_package(struct razor_package_query *pq,
 void
 razor_package_query_add_iterator(struct razor_package_query *pq,
 				 struct razor_package_iterator *pi);
+void
+razor_package_query_and(struct razor_package_query *pq,
+			struct razor_package_query *other);
+void
+razor_package_query_or(struct razor_package_query *pq,
+		       struct razor_package_query *other);
+void
+razor_package_query_andnot(struct razor_package_query *pq,
+			   struct razor_package_query *other);
+int
+razor_package_query_count(struct razor_package_query *pq);
+struct razor_package *
+razor_package_query_next(struct razor_package_query *pq, uint32_t *position);
+void
+razor_package_query_destroy(struct razor_package_query *pq);
 struct razor_package_iterator *
 razor_package_query_finish(struct razor_package_query *pq);
 
+struct razor_package_filter;
+
+struct razor_package_filter *
+razor_package_filter_create(const char *pattern);
+void
+razor_package_filter_set_arch(struct razor_package_filter *filter,
+			      const char *arch);
+void
+razor_package_filter_add_version(struct razor_package_filter *filter,
+				 uint32_t relation, const char *version);
+int
+razor_package_filter_match(struct razor_package_filter *filter,
+			   struct razor_set *set,
+			   struct razor_package *package);
+void
+razor_package_filter_destroy(struct razor_package_filter *filter);
+int
+razor_package_query_add_filter(struct razor_package_query *pq,
+			       struct razor_package_filter *filter);
+
 struct razor_property_iterator;
 struct razor_property_iterator *
 razor_property_iterator_create(struct razor_set *set,
@@ -175,6 +352,46 @@ void razor_set_list_files(struct razor_set *set, const char *prefix);
 void razor_set_list_package_files(struct razor_set *set,
 				  struct razor_package *package);
 
+struct razor_entry;
+struct razor_file_iterator;
+
+struct razor_file_iterator *
+razor_file_iterator_create(struct razor_set *set,
+			   const char *prefix, const char *pattern);
+int razor_file_iterator_next(struct razor_file_iterator *fi,
+			     const char **path, struct razor_entry **entry,
+			     struct razor_package_iterator **owners);
+void razor_file_iterator_destroy(struct razor_file_iterator *fi);
+void razor_entry_get_details(struct razor_set *set,
+			     struct razor_entry *entry, ...);
+
+typedef void (*razor_file_callback_t)(const char *path, int index,
+				      struct razor_package_iterator *owners,
+				      void *data);
+
+void razor_set_lookup_files(struct razor_set *set,
+			    const char * const *paths, int count,
+			    razor_file_callback_t callback, void *data);
+int razor_set_find_basename(struct razor_set *set, const char *name,
+			    razor_file_callback_t callback, void *data);
+
+typedef void (*razor_verify_callback_t)(struct razor_package *package,
+					const char *path,
+					struct razor_entry *entry,
+					uint32_t result, void *data);
+
+int razor_set_verify(struct razor_set *set, struct razor_package_iterator *pi,
+		     const char *root, uint32_t flags, int nthreads,
+		     razor_verify_callback_t callback, void *data);
+int razor_set_check_space(struct razor_set *set, struct razor_set *next,
+			  const char *root);
+
+typedef void (*razor_orphan_callback_t)(const char *path, void *data);
+
+int razor_set_find_orphans(struct razor_set *set, const char *root,
+			   const char *prefix, int nthreads,
+			   razor_orphan_callback_t callback, void *data);
+
 enum razor_diff_action {
 	RAZOR_DIFF_ACTION_ADD,
 	RAZOR_DIFF_ACTION_REMOVE,
@@ -296,6 +513,8 @@ struct razor_importer;
 
 struct razor_importer *razor_importer_create(void);
 void razor_importer_destroy(struct razor_importer *importer);
+void razor_importer_set_indexes(struct razor_importer *importer,
+				uint32_t indexes);
 void razor_importer_begin_package(struct razor_importer *importer,
 				  const char *name,
 				  const char *version,
@@ -311,6 +530,10 @@ void razor_importer_add_property(struct razor_importer *importer,
 				 const char *version);
 void razor_importer_add_file(struct razor_importer *importer,
 			     const char *name);
+void razor_importer_add_file_full(struct razor_importer *importer,
+				  const char *name, uint32_t size,
+				  uint32_t mode, uint32_t mtime,
+				  const char *digest, uint32_t flags);
 void razor_importer_finish_package(struct razor_importer *importer);
 
 int razor_importer_add_rpm(struct razor_importer *importer,
@@ -321,6 +544,42 @@ struct razor_set *razor_importer_finish(struct razor_importer *importer);
 struct razor_set *razor_set_create_from_yum(void);
 struct razor_set *razor_set_create_from_rpmdb(void);
 
+/**
+ * SECTION:overlay
+ * @title: Overlay
+ * @short_description: A stack of package sets queried as one.
+ *
+ * A #razor_overlay stacks package sets, such as a read-only system
+ * set shared over the network with a local set on top.  A package
+ * in a higher set hides all packages of the same name below it.
+ * Queries go through the layers without merging them, and the merged
+ * effective set can be computed and cached when it is needed.
+ **/
+struct razor_overlay;
+struct razor_overlay_iterator;
+
+struct razor_overlay *razor_overlay_create(void);
+void razor_overlay_push(struct razor_overlay *overlay, struct razor_set *set);
+void razor_overlay_destroy(struct razor_overlay *overlay);
+struct razor_set *
+razor_overlay_get_package(struct razor_overlay *overlay, const char *name,
+			  struct razor_package **package);
+struct razor_overlay_iterator *
+razor_overlay_iterator_create(struct razor_overlay *overlay);
+struct razor_overlay_iterator *
+razor_overlay_iterator_create_for_property(struct razor_overlay *overlay,
+					   const char *name, uint32_t type);
+struct razor_overlay_iterator *
+razor_overlay_iterator_create_for_file(struct razor_overlay *overlay,
+				       const char *filename);
+int razor_overlay_iterator_next(struct razor_overlay_iterator *oi,
+				struct razor_set **set,
+				struct razor_package **package);
+void razor_overlay_iterator_destroy(struct razor_overlay_iterator *oi);
+struct razor_set *
+razor_overlay_get_effective_set(struct razor_overlay *overlay,
+				const char *cache);
+
 /**
  * SECTION:root
  * @title: Root
@@ -334,6 +593,8 @@ struct razor_root;
 int razor_root_create(const char *root);
 struct razor_root *razor_root_open(const char *root);
 struct razor_set *razor_root_open_read_only(const char *root);
+struct razor_set *razor_root_open_read_only_with_base(const char *root,
+						      const char *base);
 struct razor_set *razor_root_get_system_set(struct razor_root *root);
 int razor_root_close(struct razor_root *root);
 void razor_root_update(struct razor_root *root, struct razor_set *next);
@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The importer appends the property list of each package to the
+ * property pool as the package is imported, before the packages are
+ * sorted, and the package lists of properties and files end up in the
+ * pool in the order they are built.  So walking the lists of the
+ * packages or properties in order jumps all over the pools.  Repacking
+ * copies the lists into new pools in the order they are walked.  The
+ * packages, properties and file entries themselves stay where they
+ * are, since lookups depend on their order. */
+
+/* Copy an indirect list to the end of a new pool.  Immediate and
+ * empty lists aren't in a pool. */
+static void
+repack_list(struct list_head *head, struct array *old, struct array *new)
+{
+	struct list *item, *copy;
+	uint32_t start;
+
+	item = list_first(head, old);
+	if (item == NULL || item == (struct list *) head)
+		return;
+
+	start = new->size / sizeof *copy;
+	do {
+		copy = array_add(new, sizeof *copy);
+		*copy = *item;
+		item = list_next(item);
+	} while (item != NULL);
+
+	list_set_ptr(head, start);
+}
+
+static void
+repack_lists(struct array *array, size_t element_size, size_t head_offset,
+	     struct array *old, struct array *new)
+{
+	void *p, *end;
+
+	end = array->data + array->size;
+	for (p = array->data; p < end; p += element_size)
+		repack_list(p + head_offset, old, new);
+}
+
+static void
+replace_pool(struct array *pool, struct array *new)
+{
+	array_release(pool);
+	*pool = *new;
+}
+
+/**
+ * razor_set_repack:
+ * @set: a %razor_set
+ *
+ * Copy @set into a new set with the property lists and file lists of
+ * the packages laid out one after the other in package order, and the
+ * package lists of the properties and files likewise in property and
+ * file order, so walking them touches as few pages as can be.  This
+ * is worth it for a set that is written once and queried a lot; write
+ * it with %RAZOR_SECTION_PAGE_ALIGNED to lay the file out for mapping
+ * too.  A view or layer is compacted first.
+ *
+ * Returns: the new set, or %NULL if @set is a view or layer that can't
+ * be compacted.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_repack(struct razor_set *set)
+{
+	struct razor_set *repacked, *compact;
+	struct array pool;
+
+	assert (set != NULL);
+
+	if (set->view) {
+		compact = razor_set_compact(set);
+		if (compact == NULL)
+			return NULL;
+		repacked = razor_set_repack(compact);
+		razor_set_destroy(compact);
+		return repacked;
+	}
+
+	repacked = razor_set_copy(set);
+
+	array_init(&pool);
+	repack_lists(&repacked->packages, sizeof (struct razor_package),
+		     offsetof(struct razor_package, properties),
+		     &repacked->property_pool, &pool);
+	replace_pool(&repacked->property_pool, &pool);
+
+	array_init(&pool);
+	repack_lists(&repacked->packages, sizeof (struct razor_package),
+		     offsetof(struct razor_package, files),
+		     &repacked->file_pool, &pool);
+	replace_pool(&repacked->file_pool, &pool);
+
+	array_init(&pool);
+	repack_lists(&repacked->properties, sizeof (struct razor_property),
+		     offsetof(struct razor_property, packages),
+		     &repacked->package_pool, &pool);
+	repack_lists(&repacked->files, sizeof (struct razor_entry),
+		     offsetof(struct razor_entry, packages),
+		     &repacked->package_pool, &pool);
+	replace_pool(&repacked->package_pool, &pool);
+
+	return repacked;
+}
+
+/* Walk the lists of the elements of array in order and count how
+ * often the walk moves on to another page of the pool.  The page last
+ * touched is carried in last, so walks can be chained. */
+static uint32_t
+count_page_touches(struct array *array, size_t element_size,
+		   size_t head_offset, struct array *pool, uint32_t *last)
+{
+	struct list_head *head;
+	struct list *item;
+	uint32_t page, page_size, touches;
+	void *p, *end;
+
+	page_size = sysconf(_SC_PAGESIZE);
+	touches = 0;
+	end = array->data + array->size;
+	for (p = array->data; p < end; p += element_size) {
+		head = p + head_offset;
+		item = list_first(head, pool);
+		if (item == (struct list *) head)
+			continue;
+
+		for (; item != NULL; item = list_next(item)) {
+			page = ((void *) item - pool->data) / page_size;
+			if (page != *last)
+				touches++;
+			*last = page;
+		}
+	}
+
+	return touches;
+}
+
+/**
+ * razor_set_count_page_touches:
+ * @set: a %razor_set
+ * @properties: returns the page touches of the property lists
+ * @files: returns the page touches of the file lists
+ * @packages: returns the page touches of the package lists
+ *
+ * Measure how well the lists of @set are laid out.  For each kind of
+ * list, all the lists are walked in the order of the packages,
+ * properties or files they belong to, and every move to another page
+ * of the pool the lists are in is counted; staying on a page is free.
+ * The property lists and the file lists are those of the packages, the
+ * package lists those of the properties followed by those of the
+ * files.  A set with its lists in the order they are walked touches
+ * each page of a pool once.  See razor_set_repack().
+ **/
+RAZOR_EXPORT void
+razor_set_count_page_touches(struct razor_set *set, uint32_t *properties,
+			     uint32_t *files, uint32_t *packages)
+{
+	uint32_t last;
+
+	assert (set != NULL);
+	assert (properties != NULL);
+	assert (files != NULL);
+	assert (packages != NULL);
+
+	if (set->view)
+		set = set->view->base;
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+
+	last = ~0;
+	*properties =
+		count_page_touches(&set->packages,
+				   sizeof (struct razor_package),
+				   offsetof(struct razor_package, properties),
+				   &set->property_pool, &last);
+
+	last = ~0;
+	*files = count_page_touches(&set->packages,
+				    sizeof (struct razor_package),
+				    offsetof(struct razor_package, files),
+				    &set->file_pool, &last);
+
+	last = ~0;
+	*packages =
+		count_page_touches(&set->properties,
+				   sizeof (struct razor_property),
+				   offsetof(struct razor_property, packages),
+				   &set->package_pool, &last);
+	*packages +=
+		count_page_touches(&set->files,
+				   sizeof (struct razor_entry),
+				   offsetof(struct razor_entry, packages),
+				   &set->package_pool, &last);
+}
@@ -32,6 +32,7 @@
 
 static const char system_repo_filename[] = "system.rzdb";
 static const char next_repo_filename[] = "system-next.rzdb";
+static const char effective_repo_filename[] = "effective.rzdb";
 static const char razor_root_path[] = "/var/lib/razor";
 
 struct razor_root {
@@ -149,6 +150,52 @@ razor_root_open_read_only(const char *root)
 	return razor_set_open(path);
 }
 
+/**
+ * razor_root_open_read_only_with_base:
+ * @root: the install root with the local package set
+ * @base: the install root with the read-only package set it is on
+ *
+ * Open the system set of @root overlaid on the system set of @base,
+ * for example a read-only /usr mounted from another machine.  The
+ * effective set is cached in the razor directory of @root and only
+ * merged again when either set has changed.
+ *
+ * Returns: the effective set, or %NULL if either system set can't be
+ * opened or they can't be merged.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_root_open_read_only_with_base(const char *root, const char *base)
+{
+	struct razor_overlay *overlay;
+	struct razor_set *lower, *upper, *set;
+	char path[PATH_MAX];
+
+	assert (root != NULL);
+	assert (base != NULL);
+
+	lower = razor_root_open_read_only(base);
+	if (lower == NULL)
+		return NULL;
+	upper = razor_root_open_read_only(root);
+	if (upper == NULL) {
+		razor_set_destroy(lower);
+		return NULL;
+	}
+
+	overlay = razor_overlay_create();
+	razor_overlay_push(overlay, lower);
+	razor_overlay_push(overlay, upper);
+	snprintf(path, sizeof path, "%s%s/%s",
+		 root, razor_root_path, effective_repo_filename);
+	set = razor_overlay_get_effective_set(overlay, path);
+	razor_overlay_destroy(overlay);
+
+	razor_set_destroy(lower);
+	razor_set_destroy(upper);
+
+	return set;
+}
+
 RAZOR_EXPORT struct razor_set *
 razor_root_get_system_set(struct razor_root *root)
 {
@@ -48,6 +48,14 @@ enum {
     SOCK	= 12	/*!< socket */
 };
 
+enum {
+    RPMFILE_CONFIG		= 1 << 0,
+    RPMFILE_DOC			= 1 << 1,
+    RPMFILE_MISSINGOK		= 1 << 3,
+    RPMFILE_NOREPLACE		= 1 << 4,
+    RPMFILE_GHOST		= 1 << 6,
+};
+
 enum {
     RPMSENSE_LESS		= 1 << 1,
     RPMSENSE_GREATER		= 1 << 2,
@@ -325,12 +333,34 @@ import_properties(struct razor_importer *importer, uint32_t type,
 	}
 }
 
+static uint32_t
+rpm_to_razor_file_flags(uint32_t flags)
+{
+	uint32_t razor_flags;
+
+	razor_flags = 0;
+	if (flags & RPMFILE_CONFIG)
+		razor_flags |= RAZOR_FILE_CONFIG;
+	if (flags & RPMFILE_NOREPLACE)
+		razor_flags |= RAZOR_FILE_NOREPLACE;
+	if (flags & RPMFILE_GHOST)
+		razor_flags |= RAZOR_FILE_GHOST;
+	if (flags & RPMFILE_DOC)
+		razor_flags |= RAZOR_FILE_DOC;
+	if (flags & RPMFILE_MISSINGOK)
+		razor_flags |= RAZOR_FILE_MISSINGOK;
+
+	return razor_flags;
+}
+
 static void
 import_files(struct razor_importer *importer, struct razor_rpm *rpm)
 {
-	const char *name;
-	const uint32_t *index;
+	const char *name, *md5;
+	const uint32_t *index, *sizes, *mtimes, *flags;
+	const uint16_t *modes;
 	unsigned int i, count;
+	uint32_t file_flags;
 	char buffer[256];
 
 	if (rpm->dirs == NULL)
@@ -339,11 +369,26 @@ import_files(struct razor_importer *importer, struct razor_rpm *rpm)
 	/* assert: count is the same for all arrays */
 	index = razor_rpm_get_indirect(rpm, RPMTAG_DIRINDEXES, &count);
 	name = razor_rpm_get_indirect(rpm, RPMTAG_BASENAMES, &count);
+	sizes = razor_rpm_get_indirect(rpm, RPMTAG_FILESIZES, NULL);
+	modes = razor_rpm_get_indirect(rpm, RPMTAG_FILEMODES, NULL);
+	mtimes = razor_rpm_get_indirect(rpm, RPMTAG_FILEMTIMES, NULL);
+	md5 = razor_rpm_get_indirect(rpm, RPMTAG_FILEMD5S, NULL);
+	flags = razor_rpm_get_indirect(rpm, RPMTAG_FILEFLAGS, NULL);
 	for (i = 0; i < count; i++) {
 		snprintf(buffer, sizeof buffer,
 			 "%s%s", rpm->dirs[ntohl(*index)], name);
-		razor_importer_add_file(importer, buffer);
+		if (flags)
+			file_flags = rpm_to_razor_file_flags(ntohl(flags[i]));
+		else
+			file_flags = 0;
+		razor_importer_add_file_full(importer, buffer,
+					     sizes ? ntohl(sizes[i]) : 0,
+					     modes ? ntohs(modes[i]) : 0,
+					     mtimes ? ntohl(mtimes[i]) : 0,
+					     md5, file_flags);
 		name += strlen(name) + 1;
+		if (md5)
+			md5 += strlen(md5) + 1;
 		index++;
 	}
 }
@@ -0,0 +1,419 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <fnmatch.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* The search index maps every lower-cased trigram that occurs in the
+ * name, summary, description or url of a package to the sorted list
+ * of packages it occurs in.  The trigram table is sorted by trigram
+ * and points into the postings section, where each list is stored as
+ * varint encoded deltas between package indices.  A list ends where
+ * the next one starts. */
+
+/* Only ASCII is folded here, while fnmatch() with FNM_CASEFOLD folds
+ * whatever the locale does.  So the trigrams of a pattern that have a
+ * byte outside of ASCII in them aren't looked up, see
+ * lookup_pattern_trigrams(); the index only ever narrows down the
+ * packages to match and never decides a match. */
+static inline uint32_t
+fold(char c)
+{
+	if ('A' <= c && c <= 'Z')
+		return c - 'A' + 'a';
+
+	return (unsigned char) c;
+}
+
+static void
+add_trigrams(struct array *trigrams, const char *s)
+{
+	uint32_t t, *p;
+	int i;
+
+	t = 0;
+	for (i = 0; s[i]; i++) {
+		t = ((t << 8) | fold(s[i])) & 0xffffff;
+		if (i < 2)
+			continue;
+		p = array_add(trigrams, sizeof *p);
+		*p = t;
+	}
+}
+
+static int
+compare_uint32(const void *p1, const void *p2)
+{
+	const uint32_t *u1 = p1, *u2 = p2;
+
+	return *u1 < *u2 ? -1 : *u1 > *u2;
+}
+
+static int
+compare_uint64(const void *p1, const void *p2)
+{
+	const uint64_t *u1 = p1, *u2 = p2;
+
+	return *u1 < *u2 ? -1 : *u1 > *u2;
+}
+
+static void
+write_varint(struct array *pool, uint32_t value)
+{
+	unsigned char *p;
+
+	while (value >= 0x80) {
+		p = array_add(pool, 1);
+		*p = (value & 0x7f) | 0x80;
+		value >>= 7;
+	}
+	p = array_add(pool, 1);
+	*p = value;
+}
+
+static const unsigned char *
+read_varint(const unsigned char *p, uint32_t *value)
+{
+	uint32_t v;
+	int shift;
+
+	v = 0;
+	shift = 0;
+	while (*p & 0x80) {
+		v |= (uint32_t) (*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*value = v | ((uint32_t) *p++ << shift);
+
+	return p;
+}
+
+void
+razor_set_build_search_index(struct razor_set *set)
+{
+	struct razor_package *packages;
+	struct razor_trigram *trigram;
+	struct array trigrams, keys;
+	const char *details;
+	uint32_t *t, *tend, last, previous;
+	uint64_t *k, *kend;
+	int i, count;
+
+	array_release(&set->search_trigrams);
+	array_release(&set->search_postings);
+
+	packages = set->packages.data;
+	count = set->packages.size / sizeof *packages;
+	details = set->details_string_pool.data;
+
+	/* Collect the unique trigrams of each package as (trigram,
+	 * package) keys, so sorting the keys groups them by trigram
+	 * with the packages in index order. */
+	array_init(&keys);
+	for (i = 0; i < count; i++) {
+		array_init(&trigrams);
+		add_trigrams(&trigrams, (char *) set->string_pool.data +
+			     packages[i].name);
+		if (details) {
+			add_trigrams(&trigrams, &details[packages[i].summary]);
+			add_trigrams(&trigrams,
+				     &details[packages[i].description]);
+			add_trigrams(&trigrams, &details[packages[i].url]);
+		}
+
+		qsort(trigrams.data, trigrams.size / sizeof *t,
+		      sizeof *t, compare_uint32);
+		tend = trigrams.data + trigrams.size;
+		for (t = trigrams.data; t < tend; t++) {
+			if (t > (uint32_t *) trigrams.data && t[0] == t[-1])
+				continue;
+			k = array_add(&keys, sizeof *k);
+			*k = (uint64_t) *t << 32 | i;
+		}
+		array_release(&trigrams);
+	}
+
+	qsort(keys.data, keys.size / sizeof *k, sizeof *k, compare_uint64);
+
+	trigram = NULL;
+	last = 0;
+	previous = 0;
+	kend = keys.data + keys.size;
+	for (k = keys.data; k < kend; k++) {
+		if (trigram == NULL || trigram->trigram != (*k >> 32)) {
+			trigram = array_add(&set->search_trigrams,
+					    sizeof *trigram);
+			trigram->trigram = *k >> 32;
+			trigram->postings = set->search_postings.size;
+			previous = 0;
+		}
+		last = *k & 0xffffffff;
+		write_varint(&set->search_postings, last - previous);
+		previous = last;
+	}
+
+	array_release(&keys);
+}
+
+static struct razor_trigram *
+find_trigram(struct razor_set *set, uint32_t t)
+{
+	struct razor_trigram *trigrams;
+	int lo, hi, mid;
+
+	trigrams = set->search_trigrams.data;
+	lo = 0;
+	hi = set->search_trigrams.size / sizeof *trigrams;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (trigrams[mid].trigram < t)
+			lo = mid + 1;
+		else if (trigrams[mid].trigram > t)
+			hi = mid;
+		else
+			return &trigrams[mid];
+	}
+
+	return NULL;
+}
+
+static uint32_t
+postings_size(struct razor_set *set, struct razor_trigram *trigram)
+{
+	struct razor_trigram *end;
+
+	end = set->search_trigrams.data + set->search_trigrams.size;
+	if (trigram + 1 < end)
+		return trigram[1].postings - trigram->postings;
+	else
+		return set->search_postings.size - trigram->postings;
+}
+
+/* Intersect the sorted candidate list with the postings for
+ * trigram, in place. */
+static void
+intersect_postings(struct razor_set *set, struct razor_trigram *trigram,
+		   struct array *candidates)
+{
+	const unsigned char *p, *end;
+	uint32_t *c, *cend, *out, delta, package;
+
+	p = (const unsigned char *) set->search_postings.data +
+		trigram->postings;
+	end = p + postings_size(set, trigram);
+
+	out = candidates->data;
+	cend = candidates->data + candidates->size;
+	package = 0;
+	for (c = candidates->data; c < cend && p < end; ) {
+		p = read_varint(p, &delta);
+		package += delta;
+		while (c < cend && *c < package)
+			c++;
+		if (c < cend && *c == package)
+			*out++ = *c++;
+	}
+
+	candidates->size = (void *) out - candidates->data;
+}
+
+/* Add the trigrams of the literal runs in a glob pattern.  Returns
+ * the number of trigrams found, or -1 if one of them doesn't occur
+ * anywhere in the set. */
+static int
+lookup_pattern_trigrams(struct razor_set *set,
+			const char *pattern, struct array *lookups)
+{
+	struct razor_trigram **l, *trigram;
+	uint32_t t;
+	int length, count;
+
+	count = 0;
+	length = 0;
+	t = 0;
+	while (*pattern) {
+		if (*pattern & 0x80) {
+			length = 0;
+			pattern++;
+			continue;
+		}
+
+		switch (*pattern) {
+		case '*':
+		case '?':
+			length = 0;
+			pattern++;
+			continue;
+		case '[':
+			length = 0;
+			pattern = strchr(pattern, ']');
+			if (pattern == NULL)
+				return count;
+			pattern++;
+			continue;
+		case '\\':
+			pattern++;
+			if (*pattern == '\0')
+				return count;
+			if (*pattern & 0x80)
+				continue;
+			break;
+		}
+
+		t = ((t << 8) | fold(*pattern++)) & 0xffffff;
+		if (++length < 3)
+			continue;
+
+		trigram = find_trigram(set, t);
+		if (trigram == NULL)
+			return -1;
+		l = array_add(lookups, sizeof *l);
+		*l = trigram;
+		count++;
+	}
+
+	return count;
+}
+
+static int
+compare_lookups(const void *p1, const void *p2, void *data)
+{
+	struct razor_trigram * const *l1 = p1, * const *l2 = p2;
+	struct razor_set *set = data;
+
+	return postings_size(set, *l1) - postings_size(set, *l2);
+}
+
+static void
+get_candidates(struct razor_set *set, struct razor_trigram **lookups,
+	       int count, struct array *candidates)
+{
+	const unsigned char *p, *end;
+	uint32_t *map, *c, package, delta;
+	int i;
+
+	/* Start from the shortest postings list and intersect the
+	 * others with it, so the candidate set shrinks quickly. */
+	map = razor_qsort_with_data(lookups, count, sizeof *lookups,
+				    compare_lookups, set);
+	free(map);
+
+	p = (const unsigned char *) set->search_postings.data +
+		lookups[0]->postings;
+	end = p + postings_size(set, lookups[0]);
+	package = 0;
+	while (p < end) {
+		p = read_varint(p, &delta);
+		package += delta;
+		c = array_add(candidates, sizeof *c);
+		*c = package;
+	}
+
+	for (i = 1; i < count && candidates->size > 0; i++)
+		intersect_postings(set, lookups[i], candidates);
+}
+
+static int
+match_package(struct razor_set *set,
+	      struct razor_package *package, const char *pattern)
+{
+	const char *pool, *details;
+
+	pool = set->string_pool.data;
+	if (fnmatch(pattern, &pool[package->name], FNM_CASEFOLD) == 0)
+		return 1;
+
+	details = set->details_string_pool.data;
+	if (details == NULL)
+		return 0;
+
+	return fnmatch(pattern, &details[package->summary], FNM_CASEFOLD) == 0 ||
+		fnmatch(pattern, &details[package->description], FNM_CASEFOLD) == 0 ||
+		fnmatch(pattern, &details[package->url], FNM_CASEFOLD) == 0;
+}
+
+/**
+ * razor_package_iterator_create_for_search:
+ * @set: a %razor_set
+ * @term: the search term, which may contain glob wildcards
+ *
+ * Create a new #razor_package_iterator for the packages whose name,
+ * summary, description or url contain @term, ignoring case.  If the
+ * set has a search index, only the packages that contain all the
+ * trigrams of @term are examined.
+ *
+ * Returns: the new #razor_package_iterator object.
+ **/
+RAZOR_EXPORT struct razor_package_iterator *
+razor_package_iterator_create_for_search(struct razor_set *set,
+					 const char *term)
+{
+	struct razor_package_query *query;
+	struct razor_package *packages;
+	struct array lookups, candidates;
+	uint32_t *c, *end;
+	char *pattern;
+	int i, count;
+
+	assert (set != NULL);
+	assert (term != NULL);
+
+	if (asprintf(&pattern, "*%s*", term) < 0)
+		return NULL;
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_DETAILS);
+
+	query = razor_package_query_create(set);
+	packages = set->packages.data;
+	count = set->packages.size / sizeof *packages;
+
+	array_init(&lookups);
+	array_init(&candidates);
+	if (set->search_trigrams.size > 0)
+		i = lookup_pattern_trigrams(set, term, &lookups);
+	else
+		i = 0;
+
+	if (i > 0) {
+		get_candidates(set, lookups.data, i, &candidates);
+		end = candidates.data + candidates.size;
+		for (c = candidates.data; c < end; c++)
+			if (match_package(set, &packages[*c], pattern))
+				razor_package_query_add_package(query,
+								&packages[*c]);
+	} else if (i == 0) {
+		for (i = 0; i < count; i++)
+			if (match_package(set, &packages[i], pattern))
+				razor_package_query_add_package(query,
+								&packages[i]);
+	}
+
+	array_release(&lookups);
+	array_release(&candidates);
+	free(pattern);
+
+	return razor_package_query_finish(query);
+}
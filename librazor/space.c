@@ -0,0 +1,396 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* Disk usage is counted in KiB, with every file rounded up to a whole
+ * block.  The package sizes section holds the total for each package,
+ * so when the install root is a single file system the space a
+ * transaction needs is just the sum over the packages it changes.
+ * Otherwise the files of the changed packages are walked and charged
+ * to the mount their directory is on. */
+
+#define SPACE_BLOCK_SIZE 4096
+
+struct space_mount {
+	char *path;
+	size_t length;
+	uint64_t dev;
+	int64_t delta;
+};
+
+struct space_check {
+	struct razor_set *set, *next;
+	struct array mounts;
+	struct space_mount *root;
+	struct array path, chain;
+	int split;
+};
+
+static uint32_t
+file_usage(struct razor_set *set, uint32_t entry)
+{
+	uint32_t size, flags;
+	uint16_t mode;
+
+	mode = ((uint16_t *) set->file_modes.data)[entry];
+	flags = ((uint8_t *) set->file_flags.data)[entry];
+	if (S_ISDIR(mode) || (flags & RAZOR_FILE_GHOST))
+		return 0;
+
+	size = ((uint32_t *) set->file_sizes.data)[entry];
+
+	return (size / SPACE_BLOCK_SIZE +
+		(size % SPACE_BLOCK_SIZE != 0)) * (SPACE_BLOCK_SIZE / 1024);
+}
+
+void
+razor_set_build_package_sizes(struct razor_set *set)
+{
+	struct razor_package *p, *end;
+	struct list *r;
+	uint32_t *size;
+
+	array_release(&set->package_sizes);
+	array_init(&set->package_sizes);
+	if (!razor_set_has_file_details(set))
+		return;
+
+	end = set->packages.data + set->packages.size;
+	for (p = set->packages.data; p < end; p++) {
+		size = array_add(&set->package_sizes, sizeof *size);
+		*size = 0;
+		r = razor_set_first_package_file(set, p);
+		for (; r != NULL; r = list_next(r))
+			*size += file_usage(set, r->data);
+	}
+}
+
+static int
+has_package_sizes(struct razor_set *set)
+{
+	return set->package_sizes.size / sizeof (uint32_t) ==
+		set->packages.size / sizeof (struct razor_package) &&
+		razor_set_has_file_details(set);
+}
+
+/* The yum importer knows the files but not their sizes, which leaves
+ * a size column of zeros that would make every check pass. */
+static int
+has_file_sizes(struct razor_set *set)
+{
+	uint32_t *size, *end;
+
+	end = set->file_sizes.data + set->file_sizes.size;
+	for (size = set->file_sizes.data; size < end; size++)
+		if (*size != 0)
+			return 1;
+
+	return 0;
+}
+
+/* Mount points in mountinfo escape blanks and backslashes as octal. */
+static void
+unescape_mount_point(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && '0' <= s[1] && s[1] <= '3' &&
+		    '0' <= s[2] && s[2] <= '7' && '0' <= s[3] && s[3] <= '7') {
+			*d++ = (s[1] - '0') << 6 |
+				(s[2] - '0') << 3 | (s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = '\0';
+}
+
+static void
+add_mount(struct space_check *check, const char *path, uint64_t dev)
+{
+	struct space_mount *m, *end;
+
+	/* A later mount on the same path hides the earlier one. */
+	end = check->mounts.data + check->mounts.size;
+	for (m = check->mounts.data; m < end; m++)
+		if (strcmp(m->path, path) == 0)
+			break;
+
+	if (m == end) {
+		m = array_add(&check->mounts, sizeof *m);
+		m->path = strdup(path);
+		m->length = strlen(path);
+	}
+	m->dev = dev;
+	m->delta = 0;
+}
+
+/* Collect the mounts at or below root, with paths relative to root,
+ * and the mount root itself is on, with the empty path. */
+static int
+read_mounts(struct space_check *check, const char *root)
+{
+	char *line, *point, *rel;
+	unsigned int major, minor;
+	size_t size, length;
+	FILE *fp;
+
+	fp = fopen("/proc/self/mountinfo", "r");
+	if (fp == NULL)
+		return -1;
+
+	length = strcmp(root, "/") == 0 ? 0 : strlen(root);
+	line = NULL;
+	size = 0;
+	while (getline(&line, &size, fp) > 0) {
+		point = malloc(strlen(line) + 1);
+		if (sscanf(line, "%*u %*u %u:%u %*s %s",
+			   &major, &minor, point) != 3) {
+			free(point);
+			continue;
+		}
+		unescape_mount_point(point);
+
+		if (strncmp(point, root, length) == 0 &&
+		    (point[length] == '/' || point[length] == '\0'))
+			rel = point + length;
+		else if (strncmp(root, point, strlen(point)) == 0 &&
+			 (strcmp(point, "/") == 0 ||
+			  root[strlen(point)] == '/'))
+			rel = "";
+		else
+			rel = NULL;
+
+		if (rel != NULL && strcmp(rel, "/") == 0)
+			rel = "";
+		if (rel != NULL)
+			add_mount(check, rel, (uint64_t) major << 32 | minor);
+		free(point);
+	}
+	free(line);
+	fclose(fp);
+
+	return 0;
+}
+
+static struct space_mount *
+find_root_mount(struct space_check *check)
+{
+	struct space_mount *m, *end;
+
+	end = check->mounts.data + check->mounts.size;
+	for (m = check->mounts.data; m < end; m++)
+		if (m->length == 0)
+			return m;
+
+	return NULL;
+}
+
+static struct space_mount *
+find_mount(struct space_check *check, const char *path)
+{
+	struct space_mount *m, *end, *best;
+
+	best = check->root;
+	end = check->mounts.data + check->mounts.size;
+	for (m = check->mounts.data; m < end; m++)
+		if (m->length > best->length &&
+		    strncmp(path, m->path, m->length) == 0 &&
+		    (path[m->length] == '/' || path[m->length] == '\0'))
+			best = m;
+
+	return best;
+}
+
+static void
+charge_package(struct space_check *check, struct razor_set *set,
+	       struct razor_package *package, int sign)
+{
+	struct space_mount *mount;
+	struct list *r;
+	uint32_t index, *parents, dir;
+
+	if (!has_package_sizes(set))
+		return;
+
+	index = package - (struct razor_package *) set->packages.data;
+	if (!check->split ||
+	    set->file_parents.size / sizeof *parents !=
+	    set->files.size / sizeof (struct razor_entry)) {
+		check->root->delta +=
+			sign * (int64_t)
+			((uint32_t *) set->package_sizes.data)[index];
+		return;
+	}
+
+	/* Files are sorted by entry index, so the files of a directory
+	 * are adjacent and the mount is only looked up when the
+	 * directory changes. */
+	parents = set->file_parents.data;
+	mount = check->root;
+	dir = 0;
+	r = razor_set_first_package_file(set, package);
+	for (; r != NULL; r = list_next(r)) {
+		if (parents[r->data] != dir) {
+			dir = parents[r->data];
+			razor_set_get_dir_path(set, dir,
+					       &check->path, &check->chain);
+			mount = find_mount(check, check->path.data);
+		}
+		mount->delta += sign * (int64_t) file_usage(set, r->data);
+	}
+}
+
+static void
+charge_action(enum razor_diff_action action,
+	      struct razor_package *package,
+	      const char *name,
+	      const char *version,
+	      const char *arch,
+	      void *data)
+{
+	struct space_check *check = data;
+
+	if (action == RAZOR_DIFF_ACTION_ADD)
+		charge_package(check, check->next, package, 1);
+	else
+		charge_package(check, check->set, package, -1);
+}
+
+/**
+ * razor_set_check_space:
+ * @set: the %razor_set installed under @root
+ * @next: the %razor_set @set is about to be updated to
+ * @root: the install root
+ *
+ * Check that the file systems under @root have room for the packages
+ * that are in @next but not in @set, after the packages that are in
+ * @set but not in @next are removed.  The mount points come from
+ * /proc/self/mountinfo and the net change for each file system is
+ * compared to what statvfs() says is available.  Packages from a set
+ * without file details are taken to need no space.  If @next has no
+ * file details, or all its file sizes are zero as in sets imported
+ * from yum metadata, nothing is checked and a note is printed.
+ *
+ * Returns: 0 if there is enough space, or -1 after printing the file
+ * systems that are short.
+ **/
+RAZOR_EXPORT int
+razor_set_check_space(struct razor_set *set, struct razor_set *next,
+		      const char *root)
+{
+	struct space_check check;
+	struct space_mount *m, *n, *end;
+	struct statvfs buf;
+	char path[PATH_MAX], mount_path[PATH_MAX];
+	int64_t delta, avail;
+	int status;
+	char *p;
+
+	assert (set != NULL);
+	assert (next != NULL);
+	assert (root != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	razor_set_bind_lazy_sections(next, RAZOR_SECTION_FILES);
+	if (!has_package_sizes(next) || !has_file_sizes(next)) {
+		fprintf(stderr, "not checking disk space, "
+			"no file sizes are known\n");
+		return 0;
+	}
+
+	if (realpath(*root ? root : "/", path) == NULL) {
+		fprintf(stderr, "not checking disk space, "
+			"failed to resolve %s: %m\n", root);
+		return 0;
+	}
+
+	memset(&check, 0, sizeof check);
+	check.set = set;
+	check.next = next;
+	array_init(&check.mounts);
+	read_mounts(&check, path);
+	if (find_root_mount(&check) == NULL)
+		add_mount(&check, "", 0);
+	check.root = find_root_mount(&check);
+	end = check.mounts.data + check.mounts.size;
+
+	/* Only walk the files if some mount under the root is a
+	 * different file system than the root; bind mounts don't count. */
+	for (m = check.mounts.data; m < end; m++)
+		if (m->dev != check.root->dev)
+			check.split = 1;
+
+	array_init(&check.path);
+	array_init(&check.chain);
+	p = array_add(&check.path, 1);
+	*p = '\0';
+
+	razor_set_diff(set, next, charge_action, &check);
+
+	status = 0;
+	for (m = check.mounts.data; m < end; m++) {
+		/* Sum up the mounts of each file system in its first
+		 * mount. */
+		delta = m->delta;
+		for (n = m + 1; n < end; n++) {
+			if (n->dev != m->dev)
+				continue;
+			delta += n->delta;
+			n->delta = 0;
+		}
+		if (delta <= 0)
+			continue;
+
+		snprintf(mount_path, sizeof mount_path, "%s%s",
+			 strcmp(path, "/") == 0 ? "" : path, m->path);
+		if (statvfs(*mount_path ? mount_path : "/", &buf) < 0)
+			continue;
+		avail = (int64_t) buf.f_bavail * buf.f_frsize / 1024;
+		if (delta > avail) {
+			fprintf(stderr, "installing needs %lldKB more space "
+				"on the %s filesystem\n",
+				(long long) (delta - avail),
+				*mount_path ? mount_path : "/");
+			status = -1;
+		}
+	}
+
+	for (m = check.mounts.data; m < end; m++)
+		free(m->path);
+	array_release(&check.mounts);
+	array_release(&check.path);
+	array_release(&check.chain);
+
+	return status;
+}
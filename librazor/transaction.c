@@ -37,7 +37,7 @@
 #include "razor-internal.h"
 #include "razor.h"
 
-static int
+int
 provider_satisfies_requirement(struct razor_property *provider,
 			       const char *provider_strings,
 			       uint32_t flags,
@@ -172,6 +172,9 @@ razor_transaction_create(struct razor_set *system, struct razor_set *upstream)
 	struct razor_transaction *trans;
 	struct razor_package *p, *spkgs, *pend;
 
+	razor_set_enter_phase(system, RAZOR_PHASE_SOLVE);
+	razor_set_enter_phase(upstream, RAZOR_PHASE_SOLVE);
+
 	trans = zalloc(sizeof *trans);
 	transaction_set_init(&trans->system, system);
 	transaction_set_init(&trans->upstream, upstream);
@@ -180,7 +183,8 @@ razor_transaction_create(struct razor_set *system, struct razor_set *upstream)
 	pend = trans->system.set->packages.data +
 		trans->system.set->packages.size;
 	for (p = spkgs; p < pend; p++)
-		transaction_set_install_package(&trans->system, p);
+		if (razor_set_package_visible(system, p))
+			transaction_set_install_package(&trans->system, p);
 
 	return trans;
 }
@@ -408,8 +412,9 @@ pick_matching_provider(struct razor_set *set,
 			continue;
 
 		i = list_first(&p->packages, &set->package_pool);
-
-		return &pkgs[i->data];
+		for (; i; i = list_next(i))
+			if (razor_set_package_visible(set, &pkgs[i->data]))
+				return &pkgs[i->data];
 	}
 
 	return NULL;
@@ -674,6 +679,11 @@ flush_scheduled_system_updates(struct razor_transaction *trans)
 					   RAZOR_DETAIL_NAME, &name,
 					   RAZOR_DETAIL_VERSION, &version,
 					   RAZOR_DETAIL_LAST)) {
+		/* The packages added to a layer aren't part of the
+		 * transaction. */
+		if (razor_set_package_owner(trans->system.set, p) !=
+		    trans->system.set)
+			continue;
 		if (!(trans->system.packages[p - spkgs] & TRANS_PACKAGE_UPDATE))
 			continue;
 
@@ -712,6 +722,9 @@ flush_scheduled_upstream_updates(struct razor_transaction *trans)
 					   RAZOR_DETAIL_NAME, &name,
 					   RAZOR_DETAIL_VERSION, &version,
 					   RAZOR_DETAIL_LAST)) {
+		if (razor_set_package_owner(trans->upstream.set, p) !=
+		    trans->upstream.set)
+			continue;
 		if (!(trans->upstream.packages[p - upkgs] & TRANS_PACKAGE_UPDATE))
 			continue;
 
@@ -843,6 +856,16 @@ razor_transaction_unsatisfied_property(struct razor_transaction *trans,
 	return 0;
 }
 
+/**
+ * razor_transaction_finish:
+ * @trans: a %razor_transaction
+ *
+ * Merge the packages the transaction leaves installed, from both the
+ * system and the upstream set, into a new set.  @trans is destroyed.
+ *
+ * Returns: the new set, or %NULL if it has more packages, properties
+ * or files than the library can index.
+ **/
 RAZOR_EXPORT struct razor_set *
 razor_transaction_finish(struct razor_transaction *trans)
 {
@@ -86,21 +86,39 @@ list_set_array(struct list_head *head, struct array *pool,
 	       struct array *items, int force_indirect)
 {
 	struct list *p;
+	uint32_t *item;
+	int i, count;
+
+	/* An empty list has nothing to point to, even when forced to
+	 * be indirect. */
+	if (items->size == 0) {
+		list_set_empty(head);
+		return;
+	}
 
 	if (!force_indirect) {
-		if (items->size == 0) {
-			list_set_empty(head);
-			return;
-		} else if (items->size == sizeof (uint32_t)) {
+		if (items->size == sizeof (uint32_t)) {
 			head->list_ptr = *(uint32_t *) items->data;
 			head->flags = RAZOR_IMMEDIATE;
 			return;
 		}
 	}
 
-	p = array_add(pool, items->size);
-	memcpy(p, items->data, items->size);
-	p[items->size / sizeof *p - 1].flags = RAZOR_ENTRY_LAST;
+	/* The items are plain indices, which are narrower than list
+	 * items in a library built with wide indices. */
+	count = items->size / sizeof *item;
+	if (sizeof *p == sizeof *item) {
+		p = array_add(pool, items->size);
+		memcpy(p, items->data, items->size);
+	} else {
+		p = array_add(pool, count * sizeof *p);
+		item = items->data;
+		for (i = 0; i < count; i++) {
+			p[i].data = item[i];
+			p[i].flags = 0;
+		}
+	}
+	p[count - 1].flags = RAZOR_ENTRY_LAST;
 	list_set_ptr(head, p - (struct list *) pool->data);
 }
 
@@ -92,6 +92,35 @@ razor_write(int fd, const void *data, size_t size)
 	return 0;
 }
 
+/* Compare two paths so that the contents of a directory sort
+ * immediately after it: "foo/bar" has to sort before "foo.conf".
+ * Names are compared as unsigned chars, like strcmp(), so the entries
+ * of a directory end up in strcmp() order and can be binary searched.
+ *
+ * FIXME: this is about 60% slower than strcmp
+ */
+int
+razor_compare_filenames(const char *p1, const char *p2)
+{
+	const unsigned char *n1 = (const unsigned char *) p1;
+	const unsigned char *n2 = (const unsigned char *) p2;
+
+	while (*n1 && *n2) {
+		if (*n1 < *n2)
+			return *n2 == '/' ? 1 : -1;
+		else if (*n1 > *n2)
+			return *n1 == '/' ? -1 : 1;
+		n1++;
+		n2++;
+	}
+	if (*n1)
+		return 1;
+	else if (*n2)
+		return -1;
+	else
+		return 0;
+}
+
 struct qsort_context {
 	size_t size;
 	razor_compare_with_data_func_t compare;
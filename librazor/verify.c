@@ -0,0 +1,330 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+/* Packages are verified in parallel, each by one thread.  A package's
+ * files are sorted by entry index, so the files of a directory come
+ * together and each directory is opened once and its files looked up
+ * relative to it.  Results are kept per package and handed to the
+ * callback in package order as soon as all earlier packages are done,
+ * so output streams while later packages are still being checked. */
+
+#define VERIFY_BUFFER_SIZE (64 * 1024)
+
+struct verify_failure {
+	char *path;
+	uint32_t entry;
+	uint32_t result;
+};
+
+struct verify_package {
+	struct razor_package *package;
+	struct array failures;
+	int done;
+};
+
+struct verify_work {
+	struct razor_set *set;
+	int root;
+	uint32_t flags;
+	struct verify_package *packages;
+	uint32_t count, next;
+	int failed;
+	pthread_mutex_t mutex;
+	razor_verify_callback_t callback;
+	void *data;
+};
+
+static int
+digest_file(int dir, const char *name, unsigned char *digest)
+{
+	struct razor_md5 md5;
+	unsigned char *buffer;
+	ssize_t len;
+	int fd;
+
+	fd = openat(dir, name, O_RDONLY | O_NOFOLLOW);
+	if (fd < 0)
+		return -1;
+
+	buffer = malloc(VERIFY_BUFFER_SIZE);
+	razor_md5_init(&md5);
+	while (len = read(fd, buffer, VERIFY_BUFFER_SIZE), len > 0)
+		razor_md5_update(&md5, buffer, len);
+	razor_md5_final(&md5, digest);
+	free(buffer);
+	close(fd);
+
+	return len < 0 ? -1 : 0;
+}
+
+static uint32_t
+verify_file(struct verify_work *work, int dir, const char *name,
+	    struct razor_file_details *details)
+{
+	static const unsigned char zero[RAZOR_DIGEST_SIZE];
+	unsigned char digest[RAZOR_DIGEST_SIZE];
+	struct stat st;
+	uint32_t result, mode_mask;
+
+	if (details->flags & RAZOR_FILE_GHOST)
+		return 0;
+
+	if (dir < 0 || fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+		if (details->flags & RAZOR_FILE_MISSINGOK)
+			return 0;
+		return RAZOR_VERIFY_MISSING;
+	}
+
+	/* Nothing more is known about directories implied by a path
+	 * or files imported without details. */
+	if (details->mode == 0)
+		return 0;
+
+	/* Some importers know only the file type, as for directories
+	 * in yum filelists; then the permissions aren't compared. */
+	if ((details->mode & ~S_IFMT) == 0)
+		mode_mask = S_IFMT;
+	else
+		mode_mask = ~0;
+
+	result = 0;
+	if ((st.st_mode & mode_mask) != details->mode)
+		result |= RAZOR_VERIFY_MODE;
+	if (!S_ISREG(st.st_mode) || !S_ISREG(details->mode))
+		return result;
+
+	if (st.st_size != details->size)
+		result |= RAZOR_VERIFY_SIZE;
+	if (st.st_mtime != details->mtime)
+		result |= RAZOR_VERIFY_MTIME;
+
+	if ((work->flags & RAZOR_VERIFY_NO_DIGEST) ||
+	    memcmp(details->digest, zero, RAZOR_DIGEST_SIZE) == 0)
+		return result;
+
+	/* A file of the wrong size can't have the right contents, and
+	 * one with the recorded size and mtime is assumed unchanged
+	 * unless a full check was asked for. */
+	if (result & RAZOR_VERIFY_SIZE)
+		result |= RAZOR_VERIFY_DIGEST;
+	else if ((result & RAZOR_VERIFY_MTIME) ||
+		 (work->flags & RAZOR_VERIFY_FULL)) {
+		if (digest_file(dir, name, digest) < 0)
+			result |= RAZOR_VERIFY_UNREADABLE;
+		else if (memcmp(digest, details->digest,
+				RAZOR_DIGEST_SIZE) != 0)
+			result |= RAZOR_VERIFY_DIGEST;
+	}
+
+	return result;
+}
+
+static void
+verify_package(struct verify_work *work, struct verify_package *vp)
+{
+	struct razor_set *set = work->set;
+	struct razor_file_details details;
+	struct verify_failure *failure;
+	struct razor_entry *entries;
+	struct array path, chain;
+	struct list *r;
+	uint32_t *parents, dir, result;
+	const char *pool, *name;
+	char *p;
+	int fd;
+
+	entries = set->files.data;
+	parents = set->file_parents.data;
+	pool = set->file_string_pool.data;
+
+	array_init(&path);
+	array_init(&chain);
+	p = array_add(&path, 1);
+	*p = '\0';
+
+	dir = 0;
+	fd = work->root;
+	r = razor_set_first_package_file(set, vp->package);
+	for (; r != NULL; r = list_next(r)) {
+		if (parents[r->data] != dir) {
+			if (fd >= 0 && fd != work->root)
+				close(fd);
+			dir = parents[r->data];
+			razor_set_get_dir_path(set, dir, &path, &chain);
+			if (dir == 0)
+				fd = work->root;
+			else
+				fd = openat(work->root, (char *) path.data + 1,
+					    O_RDONLY | O_DIRECTORY);
+		}
+
+		name = &pool[entries[r->data].name];
+		razor_set_get_file_details(set, r->data, &details);
+		result = verify_file(work, fd, name, &details);
+		if (result == 0)
+			continue;
+
+		failure = array_add(&vp->failures, sizeof *failure);
+		if (asprintf(&failure->path, "%s/%s",
+			     (char *) path.data, name) < 0)
+			failure->path = NULL;
+		failure->entry = r->data;
+		failure->result = result;
+	}
+
+	if (fd >= 0 && fd != work->root)
+		close(fd);
+	array_release(&path);
+	array_release(&chain);
+}
+
+/* Called with the mutex held.  Report all packages that are done and
+ * have no unfinished packages before them. */
+static void
+report_packages(struct verify_work *work)
+{
+	struct verify_failure *f, *end;
+	struct verify_package *vp;
+	struct razor_entry *entries;
+
+	entries = work->set->files.data;
+	while (work->next < work->count && work->packages[work->next].done) {
+		vp = &work->packages[work->next++];
+		end = vp->failures.data + vp->failures.size;
+		for (f = vp->failures.data; f < end; f++) {
+			if (f->path)
+				work->callback(vp->package, f->path,
+					       &entries[f->entry],
+					       f->result, work->data);
+			free(f->path);
+			work->failed++;
+		}
+		array_release(&vp->failures);
+	}
+}
+
+static void
+verify_range(uint32_t start, uint32_t end, void *data)
+{
+	struct verify_work *work = data;
+	uint32_t i;
+
+	for (i = start; i < end; i++) {
+		verify_package(work, &work->packages[i]);
+
+		pthread_mutex_lock(&work->mutex);
+		work->packages[i].done = 1;
+		report_packages(work);
+		pthread_mutex_unlock(&work->mutex);
+	}
+}
+
+/**
+ * razor_set_verify:
+ * @set: a %razor_set with file details
+ * @pi: an iterator for the packages to verify
+ * @root: the directory the packages are installed under
+ * @flags: a mask of %razor_verify_flags values
+ * @nthreads: the number of threads to use, or 0 for one per cpu
+ * @callback: called for each file that doesn't match
+ * @data: user data passed to @callback
+ *
+ * Check the files of the packages from @pi against the sizes, modes,
+ * modification times and digests recorded in @set.  The packages are
+ * checked in parallel, but @callback is called from one thread at a
+ * time and in the order @pi returns the packages, with a mask of
+ * %razor_verify_result values for each file that doesn't match.  File
+ * contents are only read when the size is right but the modification
+ * time differs, unless %RAZOR_VERIFY_FULL is given.
+ *
+ * Returns: the number of files that don't match, or -1 if @root can't
+ * be opened or @set has no file details.
+ **/
+RAZOR_EXPORT int
+razor_set_verify(struct razor_set *set, struct razor_package_iterator *pi,
+		 const char *root, uint32_t flags, int nthreads,
+		 razor_verify_callback_t callback, void *data)
+{
+	struct verify_work work;
+	struct verify_package *vp;
+	struct razor_package *package;
+	struct array packages;
+	const char *dir;
+
+	assert (set != NULL);
+	assert (pi != NULL);
+	assert (root != NULL);
+	assert (callback != NULL);
+
+	razor_set_bind_lazy_sections(set, RAZOR_SECTION_FILES);
+	if (!razor_set_has_file_details(set) ||
+	    set->file_parents.size != set->files.size /
+	    sizeof (struct razor_entry) * sizeof (uint32_t)) {
+		fprintf(stderr, "no file details in set, re-import it "
+			"to verify files\n");
+		return -1;
+	}
+
+	dir = *root ? root : "/";
+	work.root = open(dir, O_RDONLY | O_DIRECTORY);
+	if (work.root < 0) {
+		fprintf(stderr, "failed to open %s: %m\n", dir);
+		return -1;
+	}
+
+	array_init(&packages);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST)) {
+		vp = array_add(&packages, sizeof *vp);
+		vp->package = package;
+		array_init(&vp->failures);
+		vp->done = 0;
+	}
+
+	work.set = set;
+	work.flags = flags;
+	work.packages = packages.data;
+	work.count = packages.size / sizeof *vp;
+	work.next = 0;
+	work.failed = 0;
+	work.callback = callback;
+	work.data = data;
+	pthread_mutex_init(&work.mutex, NULL);
+
+	razor_parallel_for(work.count, nthreads, verify_range, &work);
+
+	pthread_mutex_destroy(&work.mutex);
+	array_release(&packages);
+	close(work.root);
+
+	return work.failed;
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2008  Kristian Høgsberg <krh@redhat.com>
+ * Copyright (C) 2008  Red Hat, Inc
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include "razor-internal.h"
+#include "razor.h"
+
+static int
+match_arch(const char *arch, const char * const *arches)
+{
+	if (arches == NULL)
+		return 1;
+
+	for (; *arches; arches++)
+		if (strcmp(arch, *arches) == 0)
+			return 1;
+
+	return 0;
+}
+
+/* Packages are sorted by name and then version, so within a run of
+ * packages with the same name, the newest one for an arch is the last
+ * one shown with that arch. */
+static void
+keep_latest(struct razor_set *set, uint64_t *bits)
+{
+	struct razor_package *packages, *start, *run, *end, *p, *q;
+	const char *pool;
+
+	packages = set->packages.data;
+	end = set->packages.data + set->packages.size;
+	pool = set->string_pool.data;
+
+	for (start = packages; start < end; start = run) {
+		for (run = start; run < end && run->name == start->name; run++)
+			;
+
+		for (p = start; p < run; p++) {
+			if (!bitset_test(bits, p - packages))
+				continue;
+			for (q = p + 1; q < run; q++)
+				if (bitset_test(bits, q - packages) &&
+				    strcmp(&pool[q->arch], &pool[p->arch]) == 0)
+					break;
+			if (q < run)
+				bitset_clear(bits, p - packages);
+		}
+	}
+}
+
+/**
+ * razor_set_create_view:
+ * @set: a %razor_set
+ * @arches: a %NULL terminated list of architectures to show, or %NULL
+ * for all
+ * @flags: %RAZOR_VIEW_LATEST to only show the newest version of each
+ * package name and architecture
+ *
+ * Create a view of @set that only shows some of its packages.  The
+ * view is a %razor_set that shares all its data with @set and can be
+ * used with iterators, queries, razor_set_diff() and transactions in
+ * place of @set; packages outside the view are skipped.  The view
+ * must be destroyed with razor_set_destroy() before @set is.  Views
+ * can't be written out.
+ *
+ * A view doesn't remap the arrays of @set, so a walk over all the
+ * packages or properties of a view, such as the transaction solver's,
+ * still steps over the hidden ones and skips them with a bitmap test;
+ * the walk costs as much as on @set itself.  To get a walk that only
+ * costs what the view shows, razor_set_compact() the view into a set
+ * of its own.
+ *
+ * Returns: the new view.
+ **/
+RAZOR_EXPORT struct razor_set *
+razor_set_create_view(struct razor_set *set,
+		      const char * const *arches, uint32_t flags)
+{
+	struct razor_set *view;
+	struct razor_package *packages;
+	struct list *r;
+	const char *pool;
+	uint32_t i, count;
+
+	assert (set != NULL);
+
+	view = zalloc(sizeof *view);
+	memcpy(view, set, sizeof *view);
+	view->mapped_files = NULL;
+	view->view = zalloc(sizeof *view->view);
+	view->view->base = set->view ? set->view->base : set;
+
+	packages = set->packages.data;
+	pool = set->string_pool.data;
+	count = set->packages.size / sizeof *packages;
+	view->view->packages = zalloc(BITSET_WORDS(count) * sizeof (uint64_t));
+
+	for (i = 0; i < count; i++)
+		if (razor_set_package_visible(set, &packages[i]) &&
+		    match_arch(&pool[packages[i].arch], arches))
+			bitset_set(view->view->packages, i);
+
+	if (flags & RAZOR_VIEW_LATEST)
+		keep_latest(set, view->view->packages);
+
+	/* A property is in the view if one of its packages is. */
+	view->view->properties =
+		zalloc(BITSET_WORDS(set->properties.size /
+				    sizeof (struct razor_property)) *
+		       sizeof (uint64_t));
+	for (i = bitset_next(view->view->packages, 0, count); i < count;
+	     i = bitset_next(view->view->packages, i + 1, count)) {
+		r = list_first(&packages[i].properties, &set->property_pool);
+		for (; r; r = list_next(r))
+			bitset_set(view->view->properties, r->data);
+	}
+
+	return view;
+}
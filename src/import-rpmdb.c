@@ -34,6 +34,7 @@ union rpm_entry {
 	char *string;
 	char **list;
 	uint_32 *flags;
+	uint_16 *modes;
 	uint_32 integer;
 };
 
@@ -62,6 +63,26 @@ rpm_to_razor_flags(uint32_t flags)
 	return razor_flags;
 }
 
+static uint32_t
+rpm_to_razor_file_flags(uint32_t flags)
+{
+	uint32_t razor_flags;
+
+	razor_flags = 0;
+	if (flags & RPMFILE_CONFIG)
+		razor_flags |= RAZOR_FILE_CONFIG;
+	if (flags & RPMFILE_NOREPLACE)
+		razor_flags |= RAZOR_FILE_NOREPLACE;
+	if (flags & RPMFILE_GHOST)
+		razor_flags |= RAZOR_FILE_GHOST;
+	if (flags & RPMFILE_DOC)
+		razor_flags |= RAZOR_FILE_DOC;
+	if (flags & RPMFILE_MISSINGOK)
+		razor_flags |= RAZOR_FILE_MISSINGOK;
+
+	return razor_flags;
+}
+
 static void
 add_properties(struct razor_importer *importer,
 	       uint32_t type_flags,
@@ -91,7 +112,10 @@ razor_set_create_from_rpmdb(void)
 	union rpm_entry name, epoch, version, release, arch;
 	union rpm_entry summary, description, url, license;
 	union rpm_entry basenames, dirnames, dirindexes;
+	union rpm_entry sizes, modes, mtimes, md5s, fileflags;
 	char filename[PATH_MAX], evr[128], buf[16];
+	uint32_t size, mode, mtime, file_flags;
+	const char *md5;
 	rpmdb db;
 	int imported_count = 0;
 
@@ -103,6 +127,10 @@ razor_set_create_from_rpmdb(void)
 	}
 
 	importer = razor_importer_create();
+	razor_importer_set_indexes(importer,
+				   RAZOR_INDEX_DEPENDENCIES |
+				   RAZOR_INDEX_FILE_HASH |
+				   RAZOR_INDEX_BASENAME);
 
 	iter = rpmdbInitIterator(db, 0, NULL, 0);
 	while (h = rpmdbNextIterator(iter), h != NULL) {
@@ -156,13 +184,28 @@ razor_set_create_from_rpmdb(void)
 			       &basenames.p, &count);
 		headerGetEntry(h, RPMTAG_DIRNAMES, &type,
 			       &dirnames.p, &count);
+		sizes.p = modes.p = mtimes.p = md5s.p = fileflags.p = NULL;
+		headerGetEntry(h, RPMTAG_FILESIZES, &type, &sizes.p, NULL);
+		headerGetEntry(h, RPMTAG_FILEMODES, &type, &modes.p, NULL);
+		headerGetEntry(h, RPMTAG_FILEMTIMES, &type, &mtimes.p, NULL);
+		headerGetEntry(h, RPMTAG_FILEMD5S, &type, &md5s.p, NULL);
+		headerGetEntry(h, RPMTAG_FILEFLAGS, &type,
+			       &fileflags.p, NULL);
 		headerGetEntry(h, RPMTAG_DIRINDEXES, &type,
 			       &dirindexes.p, &count);
 		for (i = 0; i < count; i++) {
 			snprintf(filename, sizeof filename, "%s%s",
 				 dirnames.list[dirindexes.flags[i]],
 				 basenames.list[i]);
-			razor_importer_add_file(importer, filename);
+			size = sizes.flags ? sizes.flags[i] : 0;
+			mode = modes.modes ? modes.modes[i] : 0;
+			mtime = mtimes.flags ? mtimes.flags[i] : 0;
+			md5 = md5s.list ? md5s.list[i] : NULL;
+			file_flags = fileflags.flags ?
+				rpm_to_razor_file_flags(fileflags.flags[i]) : 0;
+			razor_importer_add_file_full(importer, filename,
+						     size, mode, mtime, md5,
+						     file_flags);
 		}
 
 		razor_importer_finish_package(importer);
@@ -61,6 +61,7 @@ struct yum_context {
 	char url[256], license[64], buffer[512], *p;
 	char pkgid[128];
 	uint32_t property_type;
+	uint32_t file_mode, file_flags;
 	int state;
 
 	int total, current;
@@ -265,6 +266,16 @@ yum_filelists_start_element(void *data, const char *name, const char **atts)
 	} else if (strcmp(name, "file") == 0) {
 		ctx->state = YUM_STATE_FILE;
 		ctx->p = ctx->buffer;
+		ctx->file_mode = 0;
+		ctx->file_flags = 0;
+		for (i = 0; atts[i]; i += 2) {
+			if (strcmp(atts[i], "type") != 0)
+				continue;
+			if (strcmp(atts[i + 1], "dir") == 0)
+				ctx->file_mode = S_IFDIR;
+			else if (strcmp(atts[i + 1], "ghost") == 0)
+				ctx->file_flags = RAZOR_FILE_GHOST;
+		}
 	}
 }
 
@@ -280,7 +291,9 @@ yum_filelists_end_element (void *data, const char *name)
 		ctx->current_parser = ctx->primary_parser;
 		razor_importer_finish_package(ctx->importer);
 	} else if (strcmp(name, "file") == 0)
-		razor_importer_add_file(ctx->importer, ctx->buffer);
+		razor_importer_add_file_full(ctx->importer, ctx->buffer,
+					     0, ctx->file_mode, 0, NULL,
+					     ctx->file_flags);
 
 }
 
@@ -296,6 +309,11 @@ razor_set_create_from_yum(void)
 	XML_ParsingStatus status;
 
 	ctx.importer = razor_importer_create();
+	razor_importer_set_indexes(ctx.importer,
+				   RAZOR_INDEX_SEARCH |
+				   RAZOR_INDEX_DEPENDENCIES |
+				   RAZOR_INDEX_FILE_HASH |
+				   RAZOR_INDEX_BASENAME);
 	ctx.state = YUM_STATE_BEGIN;
 
 	ctx.primary_parser = XML_ParserCreate(NULL);
@@ -29,7 +29,6 @@
 #include <fcntl.h>
 #include <dirent.h>
 #include <curl/curl.h>
-#include <fnmatch.h>
 #include <errno.h>
 #include "razor.h"
 
@@ -42,14 +41,13 @@ static const char *repo_filename = system_repo_filename;
 static const char *yum_url;
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#define LIST_BUFFER_SIZE (1024 * 1024)
 
 static struct razor_package_iterator *
 create_iterator_from_argv(struct razor_set *set, int argc, const char *argv[])
 {
 	struct razor_package_query *query;
-	struct razor_package_iterator *iter;
-	struct razor_package *package;
-	const char *name, *pattern;
+	struct razor_package_filter *filter;
 	int i, count;
 
 	if (argc == 0)
@@ -58,28 +56,33 @@ create_iterator_from_argv(struct razor_set *set, int argc, const char *argv[])
 	query = razor_package_query_create(set);
 
 	for (i = 0; i < argc; i++) {
-		iter = razor_package_iterator_create(set);
-		pattern = argv[i];
-		count = 0;
-		while (razor_package_iterator_next(iter, &package,
-						   RAZOR_DETAIL_NAME, &name,
-						   RAZOR_DETAIL_LAST)) {
-			if (fnmatch(pattern, name, 0) != 0)
-				continue;
-
-			razor_package_query_add_package(query, package);
-			count++;
-		}
-		razor_package_iterator_destroy(iter);
+		filter = razor_package_filter_create(argv[i]);
+		count = razor_package_query_add_filter(query, filter);
+		razor_package_filter_destroy(filter);
 
 		if (count == 0)
 			fprintf(stderr,
-				"no package matches \"%s\"\n", pattern);
+				"no package matches \"%s\"\n", argv[i]);
 	}
 
 	return razor_package_query_finish(query);
 }
 
+static struct razor_package_iterator *
+create_iterator_from_pattern(struct razor_set *set,
+			     const char *pattern, int *matches)
+{
+	struct razor_package_query *query;
+	struct razor_package_filter *filter;
+
+	query = razor_package_query_create(set);
+	filter = razor_package_filter_create(pattern);
+	*matches = razor_package_query_add_filter(query, filter);
+	razor_package_filter_destroy(filter);
+
+	return razor_package_query_finish(query);
+}
+
 #define LIST_PACKAGES_ONLY_NAMES 0x01
 
 static void
@@ -220,25 +223,85 @@ command_list_files(int argc, const char *argv[])
 	if (set == NULL)
 		return 1;
 
+	/* File lists can run to millions of lines; write them out in
+	 * big blocks rather than a line at a time. */
+	setvbuf(stdout, NULL, _IOFBF, LIST_BUFFER_SIZE);
 	razor_set_list_files(set, argv[0]);
 	razor_set_destroy(set);
 
 	return 0;
 }
 
+static void
+print_file_owners(const char *path, int index,
+		  struct razor_package_iterator *owners, void *data)
+{
+	struct razor_package *package;
+	const char *name, *version, *arch;
+	int count = 0;
+
+	while (razor_package_iterator_next(owners, &package,
+					   RAZOR_DETAIL_NAME, &name,
+					   RAZOR_DETAIL_VERSION, &version,
+					   RAZOR_DETAIL_ARCH, &arch,
+					   RAZOR_DETAIL_LAST)) {
+		printf("%s: %s-%s.%s\n", path, name, version, arch);
+		count++;
+	}
+
+	if (count == 0)
+		printf("%s: not owned by any package\n", path);
+}
+
 static int
 command_list_file_packages(int argc, const char *argv[])
 {
 	struct razor_set *set;
 	struct razor_package_iterator *pi;
 
+	if (argc < 1) {
+		fprintf(stderr, "no file specified\n");
+		return 1;
+	}
+
 	set = razor_root_open_read_only(install_root);
 	if (set == NULL)
 		return 1;
 
-	pi = razor_package_iterator_create_for_file(set, argv[0]);
-	list_packages(pi, 0);
-	razor_package_iterator_destroy(pi);
+	/* Look up several files in one pass over the file tree. */
+	if (argc > 1) {
+		razor_set_lookup_files(set, argv, argc,
+				       print_file_owners, NULL);
+	} else {
+		pi = razor_package_iterator_create_for_file(set, argv[0]);
+		list_packages(pi, 0);
+		razor_package_iterator_destroy(pi);
+	}
+
+	razor_set_destroy(set);
+
+	return 0;
+}
+
+static int
+command_what_owns_name(int argc, const char *argv[])
+{
+	struct razor_set *set;
+	int i;
+
+	if (argc < 1) {
+		fprintf(stderr, "no file name specified\n");
+		return 1;
+	}
+
+	set = razor_root_open_read_only(install_root);
+	if (set == NULL)
+		return 1;
+
+	for (i = 0; i < argc; i++)
+		if (razor_set_find_basename(set, argv[i],
+					    print_file_owners, NULL) == 0)
+			printf("%s: no such file\n", argv[i]);
 
 	razor_set_destroy(set);
 
@@ -257,6 +320,7 @@ command_list_package_files(int argc, const char *argv[])
 	if (set == NULL)
 		return 1;
 
+	setvbuf(stdout, NULL, _IOFBF, LIST_BUFFER_SIZE);
 	pi = create_iterator_from_argv(set, argc, argv);
 	while (razor_package_iterator_next(pi, &package,
 					   RAZOR_DETAIL_NAME, &name,
@@ -315,9 +379,74 @@ list_property_packages(const char *ref_name,
 	return 0;
 }
 
+static void
+print_package(struct razor_package *package, void *data)
+{
+	struct razor_set *set = data;
+	const char *name, *version, *arch;
+
+	razor_package_get_details(set, package,
+				  RAZOR_DETAIL_NAME, &name,
+				  RAZOR_DETAIL_VERSION, &version,
+				  RAZOR_DETAIL_ARCH, &arch,
+				  RAZOR_DETAIL_LAST);
+	printf("%s-%s.%s\n", name, version, arch);
+}
+
+static int
+list_reverse_closure(const char *ref_name, const char *ref_version)
+{
+	struct razor_set *set;
+	struct razor_property *property;
+	struct razor_property_iterator *prop_iter;
+	struct razor_package_iterator *pkg_iter;
+	struct razor_package_query *query;
+	const char *name, *version;
+	uint32_t flags;
+
+	if (ref_name == NULL)
+		return 0;
+
+	set = razor_root_open_read_only(install_root);
+	if (set == NULL)
+		return 1;
+
+	/* Start from the packages providing the property and list
+	 * everything that transitively requires them. */
+	query = razor_package_query_create(set);
+	prop_iter = razor_property_iterator_create(set, NULL);
+	while (razor_property_iterator_next(prop_iter, &property,
+					    &name, &flags, &version)) {
+		if (strcmp(ref_name, name) != 0)
+			continue;
+		if (ref_version && strcmp(ref_version, version) != 0)
+			continue;
+		if ((flags & RAZOR_PROPERTY_TYPE_MASK) != RAZOR_PROPERTY_PROVIDES)
+			continue;
+
+		pkg_iter =
+			razor_package_iterator_create_for_property(set,
+								   property);
+		razor_package_query_add_iterator(query, pkg_iter);
+		razor_package_iterator_destroy(pkg_iter);
+	}
+	razor_property_iterator_destroy(prop_iter);
+
+	pkg_iter = razor_package_query_finish(query);
+	razor_set_reverse_closure(set, pkg_iter, print_package, set);
+	razor_package_iterator_destroy(pkg_iter);
+
+	razor_set_destroy(set);
+
+	return 0;
+}
+
 static int
 command_what_requires(int argc, const char *argv[])
 {
+	if (argc > 0 && strcmp(argv[0], "--recursive") == 0)
+		return list_reverse_closure(argv[1], argv[2]);
+
 	return list_property_packages(argv[0], argv[1],
 				      RAZOR_PROPERTY_REQUIRES);
 }
@@ -329,6 +458,97 @@ command_what_provides(int argc, const char *argv[])
 				      RAZOR_PROPERTY_PROVIDES);
 }
 
+static void
+print_verify_result(struct razor_package *package, const char *path,
+		    struct razor_entry *entry, uint32_t result, void *data)
+{
+	struct razor_set *set = data;
+	const char *name, *version, *arch;
+
+	razor_package_get_details(set, package,
+				  RAZOR_DETAIL_NAME, &name,
+				  RAZOR_DETAIL_VERSION, &version,
+				  RAZOR_DETAIL_ARCH, &arch,
+				  RAZOR_DETAIL_LAST);
+
+	printf("%s-%s.%s: %s:", name, version, arch, path);
+	if (result & RAZOR_VERIFY_MISSING)
+		printf(" missing");
+	if (result & RAZOR_VERIFY_SIZE)
+		printf(" size");
+	if (result & RAZOR_VERIFY_MODE)
+		printf(" mode");
+	if (result & RAZOR_VERIFY_MTIME)
+		printf(" mtime");
+	if (result & RAZOR_VERIFY_DIGEST)
+		printf(" digest");
+	if (result & RAZOR_VERIFY_UNREADABLE)
+		printf(" unreadable");
+	printf("\n");
+}
+
+static int
+command_verify(int argc, const char *argv[])
+{
+	struct razor_set *set;
+	struct razor_package_iterator *pi;
+	uint32_t flags;
+	int failed;
+
+	flags = 0;
+	if (argc > 0 && strcmp(argv[0], "--full") == 0) {
+		flags |= RAZOR_VERIFY_FULL;
+		argc--;
+		argv++;
+	}
+
+	set = razor_root_open_read_only(install_root);
+	if (set == NULL)
+		return 1;
+
+	pi = create_iterator_from_argv(set, argc, argv);
+	failed = razor_set_verify(set, pi, install_root, flags, 0,
+				  print_verify_result, set);
+	razor_package_iterator_destroy(pi);
+	razor_set_destroy(set);
+
+	return failed != 0;
+}
+
+static void
+print_orphan(const char *path, void *data)
+{
+	printf("%s\n", path);
+}
+
+static int
+command_orphans(int argc, const char *argv[])
+{
+	static const char *default_prefixes[] = { "/usr", "/etc", "/opt" };
+	struct razor_set *set;
+	int i, status;
+
+	set = razor_root_open_read_only(install_root);
+	if (set == NULL)
+		return 1;
+
+	if (argc == 0) {
+		argc = ARRAY_SIZE(default_prefixes);
+		argv = default_prefixes;
+	}
+
+	/* Exit with 1 if anything was found or a directory couldn't be
+	 * read, like verify. */
+	status = 0;
+	for (i = 0; i < argc; i++)
+		if (razor_set_find_orphans(set, install_root, argv[i], 0,
+					   print_orphan, NULL) != 0)
+			status = 1;
+	razor_set_destroy(set);
+
+	return status;
+}
+
 static int
 show_progress(void *clientp,
 	      double dltotal, double dlnow, double ultotal, double ulnow)
@@ -419,7 +639,8 @@ command_import_yum(int argc, const char *argv[])
 	set = razor_set_create_from_yum();
 	if (set == NULL)
 		return 1;
-	razor_set_write(set, rawhide_repo_filename, RAZOR_SECTION_ALL);
+	razor_set_write_split(set, rawhide_repo_filename,
+			      RAZOR_SECTION_COMPRESSED);
 	razor_set_destroy(set);
 	printf("wrote %s\n", rawhide_repo_filename);
 
@@ -451,18 +672,14 @@ mark_packages_for_update(struct razor_transaction *trans,
 {
 	struct razor_package_iterator *pi;
 	struct razor_package *package;
-	const char *name;
-	int matches = 0;
+	int matches;
 
-	pi = razor_package_iterator_create(set);
-	while (razor_package_iterator_next(pi, &package,
-					   RAZOR_DETAIL_NAME, &name,
-					   RAZOR_DETAIL_LAST)) {
-		if (pattern && fnmatch(pattern, name, 0) == 0) {
-			razor_transaction_update_package(trans, package);
-			matches++;
-		}
-	}
+	if (pattern == NULL)
+		return 0;
+
+	pi = create_iterator_from_pattern(set, pattern, &matches);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST))
+		razor_transaction_update_package(trans, package);
 	razor_package_iterator_destroy(pi);
 
 	return matches;
@@ -474,18 +691,14 @@ mark_packages_for_removal(struct razor_transaction *trans,
 {
 	struct razor_package_iterator *pi;
 	struct razor_package *package;
-	const char *name;
-	int matches = 0;
+	int matches;
 
-	pi = razor_package_iterator_create(set);
-	while (razor_package_iterator_next(pi, &package,
-					   RAZOR_DETAIL_NAME, &name,
-					   RAZOR_DETAIL_LAST)) {
-		if (pattern && fnmatch(pattern, name, 0) == 0) {
-			razor_transaction_remove_package(trans, package);
-			matches++;
-		}
-	}
+	if (pattern == NULL)
+		return 0;
+
+	pi = create_iterator_from_pattern(set, pattern, &matches);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST))
+		razor_transaction_remove_package(trans, package);
 	razor_package_iterator_destroy(pi);
 
 	return matches;
@@ -524,7 +737,9 @@ command_update(int argc, const char *argv[])
 	}
 
 	set = razor_transaction_finish(trans);
-	razor_set_write(set, updated_repo_filename, RAZOR_SECTION_ALL);
+	if (set == NULL)
+		return 1;
+	razor_set_write_split(set, updated_repo_filename, 0);
 	razor_set_destroy(set);
 	razor_set_destroy(upstream);
 	printf("wrote system-updated.rzdb\n");
@@ -557,7 +772,9 @@ command_remove(int argc, const char *argv[])
 		return 1;
 
 	set = razor_transaction_finish(trans);
-	razor_set_write(set, updated_repo_filename, RAZOR_SECTION_ALL);
+	if (set == NULL)
+		return 1;
+	razor_set_write_split(set, updated_repo_filename, 0);
 	razor_set_destroy(set);
 	razor_set_destroy(upstream);
 	printf("wrote system-updated.rzdb\n");
@@ -597,6 +814,70 @@ command_diff(int argc, const char *argv[])
 	return 0;
 }
 
+static int
+command_fingerprint(int argc, const char *argv[])
+{
+	struct razor_set *set;
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+	int i;
+
+	if (argc > 0)
+		set = razor_set_open_with_flags(argv[0], RAZOR_OPEN_VERIFY);
+	else
+		set = razor_root_open_read_only(install_root);
+	if (set == NULL)
+		return 1;
+
+	razor_set_get_fingerprint(set, fingerprint);
+	for (i = 0; i < RAZOR_FINGERPRINT_SIZE; i++)
+		printf("%02x", fingerprint[i]);
+	printf("\n");
+
+	razor_set_destroy(set);
+
+	return 0;
+}
+
+static void
+print_page_touches(const char *label, struct razor_set *set)
+{
+	uint32_t properties, files, packages;
+
+	razor_set_count_page_touches(set, &properties, &files, &packages);
+	printf("%s: %u property list, %u file list, %u package list "
+	       "page touches\n", label, properties, files, packages);
+}
+
+static int
+command_repack(int argc, const char *argv[])
+{
+	struct razor_set *set, *repacked;
+	int status;
+
+	if (argc < 2) {
+		fprintf(stderr, "usage: razor repack SET-FILE NEW-SET-FILE\n");
+		return 1;
+	}
+
+	set = razor_set_open(argv[0]);
+	if (set == NULL)
+		return 1;
+
+	repacked = razor_set_repack(set);
+	print_page_touches("before", set);
+	print_page_touches("after", repacked);
+
+	status = razor_set_write(repacked, argv[1],
+				 RAZOR_SECTION_ALL | RAZOR_SECTION_PAGE_ALIGNED);
+	if (status < 0)
+		fprintf(stderr, "failed to write %s\n", argv[1]);
+
+	razor_set_destroy(repacked);
+	razor_set_destroy(set);
+
+	return status < 0 ? 1 : 0;
+}
+
 static int
 command_import_rpms(int argc, const char *argv[])
 {
@@ -621,6 +902,11 @@ command_import_rpms(int argc, const char *argv[])
 	}
 
 	importer = razor_importer_create();
+	razor_importer_set_indexes(importer,
+				   RAZOR_INDEX_SEARCH |
+				   RAZOR_INDEX_DEPENDENCIES |
+				   RAZOR_INDEX_FILE_HASH |
+				   RAZOR_INDEX_BASENAME);
 
 	while (de = readdir(dir), de != NULL) {
 		len = strlen(de->d_name);
@@ -651,8 +937,10 @@ command_import_rpms(int argc, const char *argv[])
 
 	printf("\nsaving\n");
 	set = razor_importer_finish(importer);
+	if (set == NULL)
+		return -1;
 
-	razor_set_write(set, repo_filename, RAZOR_SECTION_ALL);
+	razor_set_write_split(set, repo_filename, RAZOR_SECTION_COMPRESSED);
 	razor_set_destroy(set);
 	printf("wrote %s\n", repo_filename);
 
@@ -660,9 +948,9 @@ command_import_rpms(int argc, const char *argv[])
 }
 
 static const char *
-rpm_filename(const char *name, const char *version, const char *arch)
+rpm_filename(char *file, size_t size,
+	     const char *name, const char *version, const char *arch)
 {
-	static char file[PATH_MAX];
  	const char *v;
  
  	/* Skip epoch */
@@ -672,7 +960,7 @@ rpm_filename(const char *name, const char *version, const char *arch)
  	else
 		v = version;
 
-	snprintf(file, sizeof file, "%s-%s.%s.rpm", name, v, arch);
+	snprintf(file, size, "%s-%s.%s.rpm", name, v, arch);
 
 	return file;
 }
@@ -685,7 +973,7 @@ download_packages(struct razor_set *system, struct razor_set *next)
 	struct razor_set *set;
 	enum razor_install_action action;
 	const char *name, *version, *arch;
-	char file[PATH_MAX], url[256];
+	char file[PATH_MAX], rpm[PATH_MAX], url[256];
 	int errors = 0, count;
 
 	ii = razor_set_create_install_iterator(system, next);
@@ -700,11 +988,9 @@ download_packages(struct razor_set *system, struct razor_set *next)
 					  RAZOR_DETAIL_ARCH, &arch,
 					  RAZOR_DETAIL_LAST);
 		
-		snprintf(url, sizeof url,
-			 "%s/Packages/%s",
-			 yum_url, rpm_filename(name, version, arch));
-		snprintf(file, sizeof file,
-			 "rpms/%s", rpm_filename(name, version, arch));
+		rpm_filename(rpm, sizeof rpm, name, version, arch);
+		snprintf(url, sizeof url, "%s/Packages/%s", yum_url, rpm);
+		snprintf(file, sizeof file, "rpms/%s", rpm);
 		if (download_if_missing(url, file) < 0)
 			errors++;
 	}
@@ -727,7 +1013,7 @@ install_packages(struct razor_set *system, struct razor_set *next)
 	enum razor_install_action action;
 	struct razor_rpm *rpm;
 	const char *name, *version, *arch;
-	char file[PATH_MAX];
+	char file[PATH_MAX], filename[PATH_MAX];
 	int count;
 
 	ii = razor_set_create_install_iterator(system, next);
@@ -744,8 +1030,9 @@ install_packages(struct razor_set *system, struct razor_set *next)
 
 		printf("install %s-%s\n", name, version);
 
-		snprintf(file, sizeof file,
-			 "rpms/%s", rpm_filename(name, version, arch));
+		snprintf(file, sizeof file, "rpms/%s",
+			 rpm_filename(filename, sizeof filename,
+				      name, version, arch));
 		rpm = razor_rpm_open(file);
 		if (rpm == NULL) {
 			fprintf(stderr, "failed to open rpm %s\n", file);
@@ -807,6 +1094,16 @@ command_install(int argc, const char *argv[])
 	}
 
 	next = razor_transaction_finish(trans);
+	if (next == NULL) {
+		razor_root_close(root);
+		return 1;
+	}
+
+	if (razor_set_check_space(system, next, install_root) < 0) {
+		razor_set_destroy(next);
+		razor_root_close(root);
+		return 1;
+	}
 
 	razor_root_update(root, next);
 
@@ -843,7 +1140,7 @@ command_download(int argc, const char *argv[])
 	struct razor_package *package;
 	const char *pattern = argv[0], *name, *version, *arch;
 	char url[256], file[256];
-	int matches = 0;
+	int matches;
 
 	if (mkdir("rpms", 0777) && errno != EEXIST) {
 		fprintf(stderr, "failed to create rpms directory.\n");
@@ -851,16 +1148,12 @@ command_download(int argc, const char *argv[])
 	}
 
 	set = razor_set_open(rawhide_repo_filename);
-	pi = razor_package_iterator_create(set);
+	pi = create_iterator_from_pattern(set, pattern, &matches);
 	while (razor_package_iterator_next(pi, &package,
 					   RAZOR_DETAIL_NAME, &name,
 					   RAZOR_DETAIL_VERSION, &version,
 					   RAZOR_DETAIL_ARCH, &arch,
 					   RAZOR_DETAIL_LAST)) {
-		if (pattern && fnmatch(pattern, name, 0) != 0)
-			continue;
-
-		matches++;
 		snprintf(url, sizeof url,
 			 "%s/Packages/%s-%s.%s.rpm",
 			 yum_url, name, version, arch);
@@ -889,20 +1182,18 @@ command_info(int argc, const char *argv[])
 	struct razor_package *package;
 	const char *pattern = argv[0], *name, *version, *arch;
 	const char *summary, *description, *url, *license;
+	int matches;
 
 	set = razor_root_open_read_only(install_root);
 	if (set == NULL)
 		return 1;
 
-	pi = razor_package_iterator_create(set);
+	pi = create_iterator_from_pattern(set, pattern, &matches);
 	while (razor_package_iterator_next(pi, &package,
 					   RAZOR_DETAIL_NAME, &name,
 					   RAZOR_DETAIL_VERSION, &version,
 					   RAZOR_DETAIL_ARCH, &arch,
 					   RAZOR_DETAIL_LAST)) {
-		if (pattern && fnmatch(pattern, name, 0) != 0)
-			continue;
-
 		razor_package_get_details (set, package,
 					   RAZOR_DETAIL_SUMMARY, &summary,
 					   RAZOR_DETAIL_DESCRIPTION, &description,
@@ -926,45 +1217,31 @@ command_info(int argc, const char *argv[])
 	return 0;
 }
 
-#define SEARCH_MAX 256
-
 static int
 command_search(int argc, const char *argv[])
 {
 	struct razor_set *set;
 	struct razor_package_iterator *pi;
 	struct razor_package *package;
-	char pattern[SEARCH_MAX];
-	const char *name, *version, *arch;
-	const char *summary, *description, *url, *license;
+	const char *name, *version, *arch, *summary;
 
 	if (!argv[0]) {
 		fprintf(stderr, "must specify a search term\n");
 		return 1;
 	}
 
-	snprintf(pattern, sizeof pattern, "*%s*", argv[0]);
-
 	set = razor_set_open(rawhide_repo_filename);
 	if (set == NULL)
 		return 1;
 
-	pi = razor_package_iterator_create(set);
+	pi = razor_package_iterator_create_for_search(set, argv[0]);
 	while (razor_package_iterator_next(pi, &package,
 					   RAZOR_DETAIL_NAME, &name,
 					   RAZOR_DETAIL_VERSION, &version,
 					   RAZOR_DETAIL_ARCH, &arch,
 					   RAZOR_DETAIL_SUMMARY, &summary,
-					   RAZOR_DETAIL_DESCRIPTION, &description,
-					   RAZOR_DETAIL_URL, &url,
-					   RAZOR_DETAIL_LICENSE, &license,
-					   RAZOR_DETAIL_LAST)) {
-		if (!fnmatch(pattern, name, FNM_CASEFOLD) ||
-		    !fnmatch(pattern, url, FNM_CASEFOLD) ||
-		    !fnmatch(pattern, summary, FNM_CASEFOLD) ||
-		    !fnmatch(pattern, description, FNM_CASEFOLD))
-			printf("%s-%s.%s: %s\n", name, version, arch, summary);
-	}
+					   RAZOR_DETAIL_LAST))
+		printf("%s-%s.%s: %s\n", name, version, arch, summary);
 	razor_package_iterator_destroy(pi);
 	razor_set_destroy(set);
 
@@ -982,16 +1259,21 @@ static struct {
 	{ "list-obsoletes", "list all obsoletes for the given package", command_list_obsoletes },
 	{ "list-conflicts", "list all conflicts for the given package", command_list_conflicts },
 	{ "list-files", "list files for package set", command_list_files },
-	{ "list-file-packages", "list packages owning file", command_list_file_packages },
+	{ "list-file-packages", "list packages owning the given files", command_list_file_packages },
 	{ "list-package-files", "list files in package", command_list_package_files },
-	{ "what-requires", "list the packages that have the given requires", command_what_requires },
+	{ "what-owns-name", "list files with the given name and the packages owning them", command_what_owns_name },
+	{ "what-requires", "list packages with the given requires, --recursive for all that need it", command_what_requires },
 	{ "what-provides", "list the packages that have the given provides", command_what_provides },
+	{ "verify", "check installed files against the package set, --full to check all digests", command_verify },
+	{ "orphans", "list files under /usr, /etc and /opt or the given directories that no package owns", command_orphans },
 	{ "import-yum", "import yum metadata files", command_import_yum },
 	{ "import-rpmdb", "import the system rpm database", command_import_rpmdb },
 	{ "import-rpms", "import rpms from the given directory", command_import_rpms },
 	{ "update", "update all or specified packages", command_update },
 	{ "remove", "remove specified packages", command_remove },
 	{ "diff", "show diff between two package sets", command_diff },
+	{ "fingerprint", "print the content fingerprint of the system set or the given set file", command_fingerprint },
+	{ "repack", "write the given set file with its lists laid out for lookups, and print page touches before and after", command_repack },
 	{ "install", "install rpm", command_install },
 	{ "init", "init razor root", command_init },
 	{ "download", "download packages", command_download },
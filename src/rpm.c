@@ -76,11 +76,12 @@ static const struct option query_options[] = {
 	{ }
 };
 
-static int option_nodeps;
+static int option_nodeps, option_nomd5, option_nofiles, option_full;
 
 static const struct option verify_options[] = {
-	{ OPTION_BOOL, "nomd5", 0, NULL, "don't verify MD5 digest of files", NULL },
-	{ OPTION_BOOL, "nofiles", 0, NULL, "don't verify files in package", NULL },
+	{ OPTION_BOOL, "nomd5", 0, NULL, "don't verify MD5 digest of files", &option_nomd5 },
+	{ OPTION_BOOL, "full", 0, NULL, "verify MD5 digest of files even if size and mtime match", &option_full },
+	{ OPTION_BOOL, "nofiles", 0, NULL, "don't verify files in package", &option_nofiles },
 	{ OPTION_BOOL, "nodeps", 0, NULL, "don't verify package dependencies", &option_nodeps },
 	{ OPTION_BOOL, "noscript", 0, NULL, "don't execute verify script(s)", NULL, },
 	{ OPTION_BOOL, "all", 'a', NULL, "query/verify all packages", &option_all },
@@ -131,7 +132,7 @@ static const struct option database_options[] = {
 };
 
 static int option_erase, option_install, option_upgrade, option_justdb;
-static int option_test;
+static int option_test, option_ignoresize;
 
 static const struct option install_options[] = {
 	{ OPTION_BOOL, "aid", 0, NULL, "add suggested packages to transaction", NULL, },
@@ -147,7 +148,7 @@ static const struct option install_options[] = {
 	{ OPTION_BOOL, "hash", 'h', NULL, "print hash marks as package installs (good with -v)", NULL },
 	{ OPTION_BOOL, "ignorearch", 0, NULL, "don't verify package architecture", NULL, },
 	{ OPTION_BOOL, "ignoreos", 0, NULL, "don't verify package operating system", NULL, },
-	{ OPTION_BOOL, "ignoresize", 0, NULL, "don't check disk space before installing", NULL },
+	{ OPTION_BOOL, "ignoresize", 0, NULL, "don't check disk space before installing", &option_ignoresize },
 	{ OPTION_BOOL, "install", 'i', NULL, "install package(s)", &option_install },
 	{ OPTION_BOOL, "justdb", 0, NULL, "update the database, but do not modify the filesystem", &option_justdb, },
 	{ OPTION_BOOL, "nodeps", 0, NULL, "do not verify package dependencies", &option_nodeps, },
@@ -441,6 +442,7 @@ static struct razor_set *
 create_set_from_command_line(int argc, const char *argv[])
 {
 	struct razor_importer *importer;
+	struct razor_set *set;
 	struct razor_rpm *rpm;
 	int i;
 
@@ -456,7 +458,11 @@ create_set_from_command_line(int argc, const char *argv[])
 		razor_rpm_close(rpm);
 	}
 
-	return razor_importer_finish(importer);
+	set = razor_importer_finish(importer);
+	if (set == NULL)
+		exit(1);
+
+	return set;
 }
 
 static void
@@ -514,13 +520,44 @@ command_query(int argc, const char *argv[])
 	return;
 }
 
+static void
+print_verify_result(struct razor_package *package, const char *path,
+		    struct razor_entry *entry, uint32_t result, void *data)
+{
+	struct razor_set *set = data;
+	uint32_t flags;
+	char type;
+
+	razor_entry_get_details(set, entry,
+				RAZOR_FILE_DETAIL_FLAGS, &flags,
+				RAZOR_FILE_DETAIL_LAST);
+	if (flags & RAZOR_FILE_CONFIG)
+		type = 'c';
+	else if (flags & RAZOR_FILE_DOC)
+		type = 'd';
+	else
+		type = ' ';
+
+	if (result & RAZOR_VERIFY_MISSING) {
+		printf("missing   %c %s\n", type, path);
+		return;
+	}
+
+	printf("%c%c%c....%c  %c %s\n",
+	       result & RAZOR_VERIFY_SIZE ? 'S' : '.',
+	       result & RAZOR_VERIFY_MODE ? 'M' : '.',
+	       result & RAZOR_VERIFY_DIGEST ? '5' :
+	       result & RAZOR_VERIFY_UNREADABLE ? '?' : '.',
+	       result & RAZOR_VERIFY_MTIME ? 'T' : '.',
+	       type, path);
+}
+
 static void
 command_verify(int argc, const char *argv[])
 {
 	struct razor_set *set;
 	struct razor_package_iterator *pi;
-	struct razor_package *package;
-	const char *name, *version, *arch;
+	uint32_t flags;
 
 	if (option_package) {
 		set = create_set_from_command_line(argc, argv);
@@ -532,14 +569,14 @@ command_verify(int argc, const char *argv[])
 
 	pi = get_query_packages(set, argc, argv);
 
-	while (razor_package_iterator_next(pi, &package,
-					   RAZOR_DETAIL_NAME, &name,
-					   RAZOR_DETAIL_VERSION, &version,
-					   RAZOR_DETAIL_ARCH, &arch,
-					   RAZOR_DETAIL_LAST)) {
-		printf("verify %s-%s.%s - not implemented\n",
-		       name, version, arch);
-	}
+	flags = 0;
+	if (option_full)
+		flags |= RAZOR_VERIFY_FULL;
+	if (option_nomd5)
+		flags |= RAZOR_VERIFY_NO_DIGEST;
+	if (!option_nofiles)
+		razor_set_verify(set, pi, option_root, flags, 0,
+				 print_verify_result, set);
 
 	razor_package_iterator_destroy(pi);
 }
@@ -594,6 +631,12 @@ command_erase(int argc, const char *argv[])
 		exit(0);
 
 	next = razor_transaction_finish(trans);
+	if (next == NULL)
+		exit(1);
+
+	if (!option_justdb && !option_ignoresize &&
+	    razor_set_check_space(set, next, option_root) < 0)
+		exit(1);
 
 	if (!option_justdb)
 		razor_set_diff(set, next, update_package, NULL);
@@ -636,6 +679,12 @@ command_install(int argc, const char *argv[])
 		exit(0);
 
 	next = razor_transaction_finish(trans);
+	if (next == NULL)
+		exit(1);
+
+	if (!option_justdb && !option_ignoresize &&
+	    razor_set_check_space(set, next, option_root) < 0)
+		exit(1);
 
 	if (!option_justdb)
 		razor_set_diff(set, next, update_package, NULL);
@@ -678,6 +727,12 @@ command_update(int argc, const char *argv[])
 		exit(0);
 
 	next = razor_transaction_finish(trans);
+	if (next == NULL)
+		exit(1);
+
+	if (!option_justdb && !option_ignoresize &&
+	    razor_set_check_space(set, next, option_root) < 0)
+		exit(1);
 
 	if (!option_justdb)
 		razor_set_diff(set, next, update_package, NULL);
@@ -17,13 +17,20 @@
  * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
  */
 
+#define _GNU_SOURCE
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
 #include <dirent.h>
+#include <ftw.h>
+#include <libgen.h>
+#include <limits.h>
+#include <sys/stat.h>
 #include <expat.h>
 
 #include "razor.h"
@@ -86,6 +93,9 @@ struct test_context {
 	int unsat;
 	int in_result;
 
+	char *srcdir, tmpdir[PATH_MAX];
+	int tmp_files;
+
 	int debug, errors;
 };
 
@@ -136,6 +146,64 @@ start_test(struct test_context *ctx, const char **atts)
 	printf("%s\n", name);
 }
 
+static const char *
+get_tmp_path(struct test_context *ctx, const char *name)
+{
+	static char path[PATH_MAX];
+	const char *tmp;
+
+	if (ctx->tmpdir[0] == '\0') {
+		tmp = getenv("TMPDIR");
+		snprintf(ctx->tmpdir, sizeof ctx->tmpdir,
+			 "%s/razor-test-XXXXXX", tmp ? tmp : "/tmp");
+		if (mkdtemp(ctx->tmpdir) == NULL) {
+			fprintf(stderr, "failed to create %s: %m\n",
+				ctx->tmpdir);
+			exit(1);
+		}
+	}
+
+	if (snprintf(path, sizeof path, "%s/%s",
+		     ctx->tmpdir, name) >= sizeof path) {
+		fprintf(stderr, "path in %s too long\n", ctx->tmpdir);
+		exit(1);
+	}
+
+	return path;
+}
+
+/* A scratch directory of its own for each call, so nothing is
+ * overwritten that an earlier one still uses. */
+static char *
+create_tmp_dir(struct test_context *ctx)
+{
+	char name[32], *path;
+
+	snprintf(name, sizeof name, "dir-%d", ctx->tmp_files++);
+	path = strdup(get_tmp_path(ctx, name));
+	mkdir(path, 0755);
+
+	return path;
+}
+
+static int
+remove_file(const char *path, const struct stat *st, int type,
+	    struct FTW *ftw)
+{
+	return remove(path);
+}
+
+static void
+remove_tmpdir(struct test_context *ctx)
+{
+	if (ctx->tmpdir[0] == '\0')
+		return;
+
+	nftw(ctx->tmpdir, remove_file, 16, FTW_DEPTH | FTW_PHYS);
+	ctx->tmpdir[0] = '\0';
+	ctx->tmp_files = 0;
+}
+
 static void
 end_test(struct test_context *ctx)
 {
@@ -155,15 +223,41 @@ end_test(struct test_context *ctx)
 		razor_transaction_destroy(ctx->trans);
 		ctx->trans = NULL;
 	}
+	remove_tmpdir(ctx);
+}
+
+static const struct {
+	const char *name;
+	uint32_t index;
+} index_names[] = {
+	{ "search", RAZOR_INDEX_SEARCH },
+	{ "dependencies", RAZOR_INDEX_DEPENDENCIES },
+	{ "file-hash", RAZOR_INDEX_FILE_HASH },
+	{ "basename", RAZOR_INDEX_BASENAME },
+};
+
+static uint32_t
+parse_indexes(const char *indexes)
+{
+	uint32_t mask;
+	int i;
+
+	mask = 0;
+	for (i = 0; i < sizeof index_names / sizeof index_names[0]; i++)
+		if (indexes && strstr(indexes, index_names[i].name))
+			mask |= index_names[i].index;
+
+	return mask;
 }
 
 static void
 start_set(struct test_context *ctx, const char **atts)
 {
-	const char *name = NULL;
+	const char *name = NULL, *indexes = NULL;
 
 	ctx->importer = razor_importer_create();
-	get_atts(atts, "name", &name, NULL);
+	get_atts(atts, "name", &name, "indexes", &indexes, NULL);
+	razor_importer_set_indexes(ctx->importer, parse_indexes(indexes));
 	if (!name)
 		ctx->importer_set = &ctx->result_set;
 	else if (!strcmp(name, "system"))
@@ -176,21 +270,109 @@ start_set(struct test_context *ctx, const char **atts)
 	}
 }
 
+struct visit_count {
+	unsigned long count, sum;
+};
+
+static void
+count_package(struct razor_package *package, void *data)
+{
+	struct visit_count *visits = data;
+
+	__sync_fetch_and_add(&visits->count, 1);
+	__sync_fetch_and_add(&visits->sum, (unsigned long) package);
+}
+
+static void
+check_parallel_for(struct test_context *ctx, struct razor_set *set)
+{
+	struct razor_package_iterator *pi;
+	struct razor_package *package;
+	struct visit_count expected = { 0, 0 }, visits = { 0, 0 };
+
+	pi = razor_package_iterator_create(set);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST)) {
+		expected.count++;
+		expected.sum += (unsigned long) package;
+	}
+	razor_package_iterator_destroy(pi);
+
+	razor_set_parallel_for_packages(set, count_package, &visits, 4);
+	if (visits.count == expected.count && visits.sum == expected.sum)
+		return;
+
+	fprintf(stderr, "  parallel for visited %lu packages, expected %lu\n",
+		visits.count, expected.count);
+	ctx->errors++;
+}
+
+struct fingerprint_check {
+	struct razor_set *set;
+	unsigned char fingerprints[4][RAZOR_FINGERPRINT_SIZE];
+	unsigned long count;
+};
+
+static void
+get_package_fingerprint(struct razor_package *package, void *data)
+{
+	struct fingerprint_check *check = data;
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+	unsigned long i;
+
+	razor_set_get_fingerprint(check->set, fingerprint);
+	i = __sync_fetch_and_add(&check->count, 1);
+	if (i < 4)
+		memcpy(check->fingerprints[i], fingerprint,
+		       sizeof fingerprint);
+}
+
+/* A freshly imported set has its fingerprint computed the first time
+ * it is asked for, which may happen from several threads at once. */
+static void
+check_shared_fingerprint(struct test_context *ctx, struct razor_set *set)
+{
+	struct fingerprint_check check;
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+	unsigned long i;
+
+	check.set = set;
+	check.count = 0;
+	razor_set_parallel_for_packages(set, get_package_fingerprint,
+					&check, 4);
+	razor_set_get_fingerprint(set, fingerprint);
+	for (i = 0; i < check.count && i < 4; i++)
+		if (memcmp(check.fingerprints[i], fingerprint,
+			   sizeof fingerprint) != 0) {
+			fprintf(stderr, "  fingerprints from threads differ\n");
+			ctx->errors++;
+			break;
+		}
+}
+
 static void
 end_set(struct test_context *ctx)
 {
 	*ctx->importer_set = razor_importer_finish(ctx->importer);
 	ctx->importer = NULL;
+	if (*ctx->importer_set == NULL) {
+		fprintf(stderr, "  failed to import set\n");
+		exit(1);
+	}
+	check_parallel_for(ctx, *ctx->importer_set);
+	check_shared_fingerprint(ctx, *ctx->importer_set);
 }
 
 static void
 start_package(struct test_context *ctx, const char **atts)
 {
 	const char *name = NULL, *version = NULL, *arch = NULL;
+	const char *summary = NULL, *description = NULL;
 
 	get_atts(atts, "name", &name,
 		 "version", &version,
 		 "arch", &arch,
+		 "summary", &summary,
+		 "description", &description,
 		 NULL);
 
 	if (!name) {
@@ -199,6 +381,11 @@ start_package(struct test_context *ctx, const char **atts)
 	}
 
 	razor_importer_begin_package(ctx->importer, name, version, arch);
+	if (summary || description)
+		razor_importer_add_details(ctx->importer,
+					   summary ? summary : "",
+					   description ? description : "",
+					   "", "");
 	razor_importer_add_property(ctx->importer, name,
 				    RAZOR_PROPERTY_EQUAL | RAZOR_PROPERTY_PROVIDES,
 				    version);
@@ -338,6 +525,10 @@ end_transaction(struct test_context *ctx)
 		struct razor_set *new;
 		new = razor_transaction_finish(ctx->trans);
 		ctx->trans = NULL;
+		if (new == NULL) {
+			fprintf(stderr, "  failed to finish transaction\n");
+			exit(1);
+		}
 		ctx->system_set = new;
 	}
 }
@@ -426,6 +617,1271 @@ end_unsatisfiable(struct test_context *ctx)
 	ctx->unsat = 0;
 }
 
+/* A set with one package whose name takes up length bytes of the
+ * string pool. */
+static struct razor_set *
+create_padded_set(char c, size_t length)
+{
+	struct razor_importer *importer;
+	char *name;
+
+	name = malloc(length + 1);
+	memset(name, c, length);
+	name[length] = '\0';
+
+	importer = razor_importer_create();
+	razor_importer_begin_package(importer, name, "1", "noarch");
+	razor_importer_finish_package(importer);
+	free(name);
+
+	return razor_importer_finish(importer);
+}
+
+static struct razor_package *
+first_package(struct razor_set *set)
+{
+	struct razor_package_iterator *pi;
+	struct razor_package *package;
+
+	pi = razor_package_iterator_create(set);
+	if (!razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST))
+		package = NULL;
+	razor_package_iterator_destroy(pi);
+
+	return package;
+}
+
+static void
+check_limit(struct test_context *ctx, const char *what, int fits)
+{
+#ifdef RAZOR_WIDE_INDEX
+	const int wide = 1;
+#else
+	const int wide = 0;
+#endif
+
+	if (fits == wide)
+		return;
+
+	fprintf(stderr, "  %s should %s\n", what, wide ? "fit" : "not fit");
+	ctx->errors++;
+}
+
+/* Sets whose string pool outgrows 24-bit indices must be refused
+ * unless razor is built with wide indices.  Each padded set takes
+ * up more than half of that. */
+static void
+start_index_limit(struct test_context *ctx, const char **atts)
+{
+	const size_t half = 9 << 20;
+	struct razor_set *big, *a, *b, *c, *layer, *set;
+	struct razor_transaction *trans;
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+
+	big = create_padded_set('x', 2 * half);
+	check_limit(ctx, "importer set", big != NULL);
+	if (big)
+		razor_set_destroy(big);
+
+	a = create_padded_set('a', half);
+	b = create_padded_set('b', half);
+	c = create_padded_set('c', half);
+
+	trans = razor_transaction_create(a, b);
+	razor_transaction_install_package(trans, first_package(b));
+	set = razor_transaction_finish(trans);
+	check_limit(ctx, "transaction result", set != NULL);
+	if (set)
+		razor_set_destroy(set);
+
+	layer = razor_set_create_layer(a);
+	if (razor_set_add_package(layer, b, first_package(b)) < 0) {
+		fprintf(stderr, "  failed to add package to layer\n");
+		ctx->errors++;
+	}
+	check_limit(ctx, "layer with two added packages",
+		    razor_set_add_package(layer, c, first_package(c)) == 0);
+
+	set = razor_set_compact(layer);
+	check_limit(ctx, "compacted layer", set != NULL);
+	if (set)
+		razor_set_destroy(set);
+	check_limit(ctx, "layer fingerprint",
+		    razor_set_get_fingerprint(layer, fingerprint) == 0);
+
+	razor_set_destroy(layer);
+	razor_set_destroy(a);
+	razor_set_destroy(b);
+	razor_set_destroy(c);
+}
+
+static struct razor_set *
+get_system_set(struct test_context *ctx)
+{
+	if (!ctx->system_set) {
+		fprintf(stderr, "  no system set\n");
+		exit(1);
+	}
+
+	return ctx->system_set;
+}
+
+static void
+check_count(struct test_context *ctx, const char *what,
+	    int count, int expected)
+{
+	if (count == expected)
+		return;
+
+	fprintf(stderr, "  %s has %d packages, expected %d\n",
+		what, count, expected);
+	ctx->errors++;
+}
+
+/* Run a package filter over the system set as a query and by
+ * matching each package, and combine the results. */
+static void
+start_query(struct test_context *ctx, const char **atts)
+{
+	const char *pattern = NULL, *arch = NULL, *rel_str = NULL;
+	const char *version = NULL, *count_str = NULL;
+	struct razor_package_filter *filter;
+	struct razor_package_query *pq, *matched, *all;
+	struct razor_package_iterator *pi;
+	struct razor_package *package;
+	struct razor_set *set;
+	uint32_t position;
+	int count, expected;
+
+	get_atts(atts, "pattern", &pattern,
+		 "arch", &arch,
+		 "relation", &rel_str,
+		 "version", &version,
+		 "count", &count_str,
+		 NULL);
+	if (!count_str) {
+		fprintf(stderr, "  query with no count\n");
+		exit(1);
+	}
+	expected = atoi(count_str);
+
+	set = get_system_set(ctx);
+	filter = razor_package_filter_create(pattern);
+	if (arch)
+		razor_package_filter_set_arch(filter, arch);
+	if (version)
+		razor_package_filter_add_version(filter,
+						 parse_relation(rel_str),
+						 version);
+
+	pq = razor_package_query_create(set);
+	check_count(ctx, "filter", razor_package_query_add_filter(pq, filter),
+		    expected);
+	check_count(ctx, "query", razor_package_query_count(pq), expected);
+
+	count = 0;
+	position = 0;
+	while (razor_package_query_next(pq, &position))
+		count++;
+	check_count(ctx, "query walk", count, expected);
+
+	matched = razor_package_query_create(set);
+	all = razor_package_query_create(set);
+	pi = razor_package_iterator_create(set);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST)) {
+		if (razor_package_filter_match(filter, set, package))
+			razor_package_query_add_package(matched, package);
+		razor_package_query_add_package(all, package);
+	}
+	razor_package_iterator_destroy(pi);
+	razor_package_filter_destroy(filter);
+	check_count(ctx, "matching packages",
+		    razor_package_query_count(matched), expected);
+
+	razor_package_query_and(matched, pq);
+	check_count(ctx, "matched and query",
+		    razor_package_query_count(matched), expected);
+	razor_package_query_andnot(matched, pq);
+	check_count(ctx, "matched and not query",
+		    razor_package_query_count(matched), 0);
+	razor_package_query_or(pq, all);
+	check_count(ctx, "query or all", razor_package_query_count(pq),
+		    razor_package_query_count(all));
+
+	pi = razor_package_query_finish(pq);
+	count = 0;
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST))
+		count++;
+	razor_package_iterator_destroy(pi);
+	check_count(ctx, "query iterator", count,
+		    razor_package_query_count(all));
+
+	razor_package_query_destroy(matched);
+	razor_package_query_destroy(all);
+}
+
+static void
+start_search(struct test_context *ctx, const char **atts)
+{
+	const char *term = NULL, *count_str = NULL;
+	struct razor_package_iterator *pi;
+	struct razor_package *package;
+	int count;
+
+	get_atts(atts, "term", &term, "count", &count_str, NULL);
+	if (!term || !count_str) {
+		fprintf(stderr, "  search with no term or count\n");
+		exit(1);
+	}
+
+	count = 0;
+	pi = razor_package_iterator_create_for_search(get_system_set(ctx),
+						      term);
+	while (razor_package_iterator_next(pi, &package, RAZOR_DETAIL_LAST))
+		count++;
+	razor_package_iterator_destroy(pi);
+
+	if (count != atoi(count_str)) {
+		fprintf(stderr, "  search for '%s' found %d packages, "
+			"expected %s\n", term, count, count_str);
+		ctx->errors++;
+	}
+}
+
+static int
+compare_strings(const void *p1, const void *p2)
+{
+	return strcmp(*(char * const *) p1, *(char * const *) p2);
+}
+
+/* Collects package names and prints them sorted, so results that
+ * come in no particular order can be compared. */
+struct name_list {
+	struct razor_set *set;
+	char **names;
+	int count;
+};
+
+static void
+add_name(struct name_list *list, const char *name)
+{
+	list->names = realloc(list->names,
+			      (list->count + 1) * sizeof *list->names);
+	list->names[list->count++] = strdup(name);
+}
+
+static void
+add_package_name(struct razor_package *package, void *data)
+{
+	struct name_list *list = data;
+	const char *name;
+
+	razor_package_get_details(list->set, package,
+				  RAZOR_DETAIL_NAME, &name,
+				  RAZOR_DETAIL_LAST);
+	add_name(list, name);
+}
+
+static char *
+join_names(struct name_list *list)
+{
+	char *buffer;
+	size_t length;
+	FILE *f;
+	int i;
+
+	if (list->count > 0)
+		qsort(list->names, list->count, sizeof *list->names,
+		      compare_strings);
+	f = open_memstream(&buffer, &length);
+	for (i = 0; i < list->count; i++) {
+		fprintf(f, "%s%s", i > 0 ? " " : "", list->names[i]);
+		free(list->names[i]);
+	}
+	fclose(f);
+	free(list->names);
+	list->names = NULL;
+	list->count = 0;
+
+	return buffer;
+}
+
+static void
+check_names(struct test_context *ctx, const char *what,
+	    struct name_list *list, const char *expected)
+{
+	char *names;
+
+	names = join_names(list);
+	if (strcmp(names, expected ? expected : "") != 0) {
+		fprintf(stderr, "  %s gave '%s', expected '%s'\n",
+			what, names, expected ? expected : "");
+		ctx->errors++;
+	}
+	free(names);
+}
+
+/* Check the packages that require the named package, directly or
+ * indirectly. */
+static void
+start_closure(struct test_context *ctx, const char **atts)
+{
+	const char *name = NULL, *expected = NULL;
+	struct razor_package_filter *filter;
+	struct razor_package_query *pq;
+	struct razor_package_iterator *pi;
+	struct name_list list = { NULL, NULL, 0 };
+	int count;
+
+	get_atts(atts, "name", &name, "packages", &expected, NULL);
+	if (!name) {
+		fprintf(stderr, "  closure with no name\n");
+		exit(1);
+	}
+
+	list.set = get_system_set(ctx);
+	filter = razor_package_filter_create(name);
+	pq = razor_package_query_create(list.set);
+	razor_package_query_add_filter(pq, filter);
+	razor_package_filter_destroy(filter);
+	pi = razor_package_query_finish(pq);
+
+	count = razor_set_reverse_closure(list.set, pi,
+					  add_package_name, &list);
+	razor_package_iterator_destroy(pi);
+
+	check_count(ctx, "closure", count, list.count);
+	check_names(ctx, "closure", &list, expected);
+}
+
+static void
+replace_system_set(struct test_context *ctx, struct razor_set *set)
+{
+	razor_set_destroy(ctx->system_set);
+	ctx->system_set = set;
+}
+
+static void
+dump_packages(FILE *f, struct razor_package_iterator *pi)
+{
+	struct name_list list = { NULL, NULL, 0 };
+	struct razor_package *package;
+	const char *name, *version;
+	char *names, *p;
+
+	while (razor_package_iterator_next(pi, &package,
+					   RAZOR_DETAIL_NAME, &name,
+					   RAZOR_DETAIL_VERSION, &version,
+					   RAZOR_DETAIL_LAST)) {
+		if (asprintf(&p, "%s-%s", name, version) < 0)
+			exit(1);
+		add_name(&list, p);
+		free(p);
+	}
+	razor_package_iterator_destroy(pi);
+
+	names = join_names(&list);
+	fprintf(f, " %s\n", names);
+	free(names);
+}
+
+/* Dump the packages of set with their details and properties, the
+ * owners of each property and the owners and details of each entry
+ * of the file tree of tree.  The owners are sorted, since a layer
+ * returns its added packages after those of the base. */
+static char *
+dump_set(struct razor_set *set, struct razor_set *tree)
+{
+	struct razor_package_iterator *pi;
+	struct razor_property_iterator *ri;
+	struct razor_file_iterator *fi;
+	struct razor_package *package;
+	struct razor_property *property;
+	struct razor_entry *entry;
+	const char *name, *version, *arch, *summary, *path;
+	uint32_t flags, size, mode, mtime;
+	char *buffer;
+	size_t length;
+	FILE *f;
+
+	f = open_memstream(&buffer, &length);
+
+	pi = razor_package_iterator_create(set);
+	while (razor_package_iterator_next(pi, &package,
+					   RAZOR_DETAIL_NAME, &name,
+					   RAZOR_DETAIL_VERSION, &version,
+					   RAZOR_DETAIL_ARCH, &arch,
+					   RAZOR_DETAIL_SUMMARY, &summary,
+					   RAZOR_DETAIL_LAST)) {
+		fprintf(f, "%s-%s.%s %s\n", name, version, arch, summary);
+		ri = razor_property_iterator_create(set, package);
+		while (razor_property_iterator_next(ri, &property,
+						    &name, &flags, &version))
+			fprintf(f, "  %s %u %s\n", name, flags, version);
+		razor_property_iterator_destroy(ri);
+	}
+	razor_package_iterator_destroy(pi);
+
+	ri = razor_property_iterator_create(set, NULL);
+	while (razor_property_iterator_next(ri, &property,
+					    &name, &flags, &version)) {
+		fprintf(f, "%s %u %s:", name, flags, version);
+		pi = razor_package_iterator_create_for_property(set, property);
+		dump_packages(f, pi);
+	}
+	razor_property_iterator_destroy(ri);
+
+	fi = razor_file_iterator_create(tree, NULL, NULL);
+	while (razor_file_iterator_next(fi, &path, &entry, NULL)) {
+		razor_entry_get_details(tree, entry,
+					RAZOR_FILE_DETAIL_SIZE, &size,
+					RAZOR_FILE_DETAIL_MODE, &mode,
+					RAZOR_FILE_DETAIL_MTIME, &mtime,
+					RAZOR_FILE_DETAIL_LAST);
+		fprintf(f, "%s %u %o %u:", path, size, mode, mtime);
+		pi = razor_package_iterator_create_for_file(set, path);
+		dump_packages(f, pi);
+	}
+	razor_file_iterator_destroy(fi);
+
+	fclose(f);
+
+	return buffer;
+}
+
+/* Check that set, with the file tree of tree, holds the same as
+ * expected. */
+static void
+check_same_set(struct test_context *ctx, const char *what,
+	       struct razor_set *set, struct razor_set *tree,
+	       struct razor_set *expected)
+{
+	char *dump, *expected_dump;
+
+	dump = dump_set(set, tree);
+	expected_dump = dump_set(expected, expected);
+	if (strcmp(dump, expected_dump) != 0) {
+		fprintf(stderr, "  %s differs from the set it was made from\n",
+			what);
+		if (ctx->debug)
+			fprintf(stderr, "%s--- expected:\n%s",
+				dump, expected_dump);
+		ctx->errors++;
+	}
+
+	free(dump);
+	free(expected_dump);
+}
+
+/* Make the compacted view of the system set with the given arch
+ * and latest flag the system set. */
+static void
+start_view(struct test_context *ctx, const char **atts)
+{
+	const char *arches[2] = { NULL, NULL }, *latest = NULL;
+	struct razor_set *view, *set;
+
+	get_atts(atts, "arch", &arches[0], "latest", &latest, NULL);
+	view = razor_set_create_view(get_system_set(ctx),
+				     arches[0] ? arches : NULL,
+				     latest ? RAZOR_VIEW_LATEST : 0);
+	set = razor_set_compact(view);
+	check_same_set(ctx, "view", view, set, set);
+	razor_set_destroy(view);
+	replace_system_set(ctx, set);
+}
+
+static void
+start_file(struct test_context *ctx, const char **atts)
+{
+	const char *name = NULL, *size = NULL, *mode = NULL, *mtime = NULL;
+
+	get_atts(atts, "name", &name,
+		 "size", &size,
+		 "mode", &mode,
+		 "mtime", &mtime,
+		 NULL);
+	if (!name) {
+		fprintf(stderr, "  file with no name\n");
+		exit(1);
+	}
+
+	if (mode)
+		razor_importer_add_file_full(ctx->importer, name,
+					     size ? strtoul(size, NULL, 0) : 0,
+					     strtoul(mode, NULL, 0),
+					     mtime ? strtoul(mtime, NULL, 0) : 0,
+					     NULL, 0);
+	else
+		razor_importer_add_file(ctx->importer, name);
+}
+
+static void
+add_owner_names(struct name_list *list, struct razor_package_iterator *pi)
+{
+	struct razor_package *package;
+	const char *name;
+
+	while (razor_package_iterator_next(pi, &package,
+					   RAZOR_DETAIL_NAME, &name,
+					   RAZOR_DETAIL_LAST))
+		add_name(list, name);
+}
+
+/* Check the packages owning a file of the system set. */
+static void
+start_owners(struct test_context *ctx, const char **atts)
+{
+	const char *file = NULL, *expected = NULL;
+	struct razor_package_iterator *pi;
+	struct name_list list = { NULL, NULL, 0 };
+
+	get_atts(atts, "file", &file, "packages", &expected, NULL);
+	if (!file) {
+		fprintf(stderr, "  owners with no file\n");
+		exit(1);
+	}
+
+	pi = razor_package_iterator_create_for_file(get_system_set(ctx), file);
+	add_owner_names(&list, pi);
+	razor_package_iterator_destroy(pi);
+	check_names(ctx, file, &list, expected);
+}
+
+struct lookup_check {
+	struct test_context *ctx;
+	struct razor_set *set;
+	int *seen;
+};
+
+static void
+check_lookup(const char *path, int index,
+	     struct razor_package_iterator *owners, void *data)
+{
+	struct lookup_check *check = data;
+	struct razor_package_iterator *pi;
+	struct name_list list = { NULL, NULL, 0 };
+	char *names;
+
+	check->seen[index]++;
+	add_owner_names(&list, owners);
+	names = join_names(&list);
+
+	pi = razor_package_iterator_create_for_file(check->set, path);
+	add_owner_names(&list, pi);
+	razor_package_iterator_destroy(pi);
+	check_names(check->ctx, path, &list, names);
+	free(names);
+}
+
+/* Look up all the paths in the file tree of the system set, and
+ * some extra ones, in one batch, and check that each gets the owners
+ * a single lookup gets. */
+static void
+start_lookup(struct test_context *ctx, const char **atts)
+{
+	const char *extra = NULL, *path;
+	struct razor_file_iterator *fi;
+	struct lookup_check check;
+	struct name_list paths = { NULL, NULL, 0 };
+	char *copy, *p, *tmp;
+	int i;
+
+	get_atts(atts, "extra", &extra, NULL);
+
+	check.ctx = ctx;
+	check.set = get_system_set(ctx);
+	fi = razor_file_iterator_create(check.set, NULL, NULL);
+	while (razor_file_iterator_next(fi, &path, NULL, NULL))
+		add_name(&paths, path);
+	razor_file_iterator_destroy(fi);
+
+	copy = strdup(extra ? extra : "");
+	for (p = strtok(copy, " "); p; p = strtok(NULL, " "))
+		add_name(&paths, p);
+	free(copy);
+
+	/* Reverse them, the lookup has to sort them itself. */
+	for (i = 0; i < paths.count / 2; i++) {
+		tmp = paths.names[i];
+		paths.names[i] = paths.names[paths.count - i - 1];
+		paths.names[paths.count - i - 1] = tmp;
+	}
+
+	check.seen = calloc(paths.count, sizeof *check.seen);
+	razor_set_lookup_files(check.set, (const char * const *) paths.names,
+			       paths.count, check_lookup, &check);
+	for (i = 0; i < paths.count; i++) {
+		if (check.seen[i] != 1) {
+			fprintf(stderr, "  %s looked up %d times\n",
+				paths.names[i], check.seen[i]);
+			ctx->errors++;
+		}
+		free(paths.names[i]);
+	}
+	free(paths.names);
+	free(check.seen);
+}
+
+/* Count the entries of the file tree of the system set below prefix
+ * that match pattern. */
+static void
+start_files(struct test_context *ctx, const char **atts)
+{
+	const char *prefix = NULL, *pattern = NULL, *count_str = NULL;
+	const char *path;
+	struct razor_file_iterator *fi;
+	int count;
+
+	get_atts(atts, "prefix", &prefix,
+		 "pattern", &pattern,
+		 "count", &count_str,
+		 NULL);
+	if (!count_str) {
+		fprintf(stderr, "  files with no count\n");
+		exit(1);
+	}
+
+	count = 0;
+	fi = razor_file_iterator_create(get_system_set(ctx), prefix, pattern);
+	while (razor_file_iterator_next(fi, &path, NULL, NULL))
+		count++;
+	razor_file_iterator_destroy(fi);
+
+	if (count != atoi(count_str)) {
+		fprintf(stderr, "  found %d files below %s, expected %s\n",
+			count, prefix ? prefix : "/", count_str);
+		ctx->errors++;
+	}
+}
+
+static void
+add_path(const char *path, int index,
+	 struct razor_package_iterator *owners, void *data)
+{
+	add_name(data, path);
+}
+
+/* Check the paths of the files of the system set with a name. */
+static void
+start_basename(struct test_context *ctx, const char **atts)
+{
+	const char *name = NULL, *expected = NULL;
+	struct name_list list = { NULL, NULL, 0 };
+	int count;
+
+	get_atts(atts, "name", &name, "files", &expected, NULL);
+	if (!name) {
+		fprintf(stderr, "  basename with no name\n");
+		exit(1);
+	}
+
+	count = razor_set_find_basename(get_system_set(ctx), name,
+					add_path, &list);
+	check_count(ctx, name, count, list.count);
+	check_names(ctx, name, &list, expected);
+}
+
+static void
+create_parents(char *buffer, const char *root)
+{
+	char *p;
+
+	for (p = strchr(buffer + strlen(root) + 1, '/'); p;
+	     p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(buffer, 0755);
+		*p = '/';
+	}
+}
+
+static void
+create_file(const char *root, const char *path, uint32_t size,
+	    uint32_t mode, uint32_t mtime)
+{
+	struct timespec times[2];
+	char buffer[PATH_MAX];
+	int fd;
+
+	snprintf(buffer, sizeof buffer, "%s%s", root, path);
+	create_parents(buffer, root);
+
+	fd = open(buffer, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0 || ftruncate(fd, size) < 0 ||
+	    fchmod(fd, mode & 07777) < 0) {
+		fprintf(stderr, "failed to create %s: %m\n", buffer);
+		exit(1);
+	}
+
+	times[0].tv_sec = mtime;
+	times[0].tv_nsec = 0;
+	times[1] = times[0];
+	futimens(fd, times);
+	close(fd);
+}
+
+/* Lay out the directories and regular files of set under root with their recorded
+ * size, mode and mtime, leaving out skip and making grow a byte
+ * bigger. */
+static void
+create_files(struct razor_set *set, const char *root,
+	     const char *skip, const char *grow)
+{
+	struct razor_file_iterator *fi;
+	struct razor_entry *entry;
+	const char *path;
+	uint32_t size, mode, mtime;
+	char buffer[PATH_MAX];
+
+	fi = razor_file_iterator_create(set, NULL, NULL);
+	while (razor_file_iterator_next(fi, &path, &entry, NULL)) {
+		razor_entry_get_details(set, entry,
+					RAZOR_FILE_DETAIL_SIZE, &size,
+					RAZOR_FILE_DETAIL_MODE, &mode,
+					RAZOR_FILE_DETAIL_MTIME, &mtime,
+					RAZOR_FILE_DETAIL_LAST);
+		if (skip && strcmp(path, skip) == 0)
+			continue;
+		if (S_ISDIR(mode)) {
+			snprintf(buffer, sizeof buffer, "%s%s", root, path);
+			create_parents(buffer, root);
+			mkdir(buffer, mode & 07777);
+			continue;
+		}
+		if (!S_ISREG(mode))
+			continue;
+		if (grow && strcmp(path, grow) == 0)
+			size++;
+		create_file(root, path, size, mode, mtime);
+	}
+	razor_file_iterator_destroy(fi);
+}
+
+struct verify_check {
+	struct test_context *ctx;
+	const char *missing, *resized;
+};
+
+static void
+check_verify_result(struct razor_package *package, const char *path,
+		    struct razor_entry *entry, uint32_t result, void *data)
+{
+	struct verify_check *check = data;
+	uint32_t expected = 0;
+
+	if (check->missing && strcmp(path, check->missing) == 0)
+		expected = RAZOR_VERIFY_MISSING;
+	else if (check->resized && strcmp(path, check->resized) == 0)
+		expected = RAZOR_VERIFY_SIZE;
+
+	if (result == expected)
+		return;
+
+	fprintf(stderr, "  verify found 0x%x for %s, expected 0x%x\n",
+		result, path, expected);
+	check->ctx->errors++;
+}
+
+/* Lay out the files of the system set in a scratch root, with one
+ * missing and one resized, and verify the set against it. */
+static void
+start_verify(struct test_context *ctx, const char **atts)
+{
+	struct verify_check check;
+	struct razor_package_iterator *pi;
+	struct razor_set *set;
+	int failed, expected;
+	char *root;
+
+	check.ctx = ctx;
+	get_atts(atts, "missing", &check.missing,
+		 "resized", &check.resized,
+		 NULL);
+
+	set = get_system_set(ctx);
+	root = create_tmp_dir(ctx);
+	create_files(set, root, check.missing, check.resized);
+
+	pi = razor_package_iterator_create(set);
+	failed = razor_set_verify(set, pi, root, 0, 2,
+				  check_verify_result, &check);
+	razor_package_iterator_destroy(pi);
+	free(root);
+
+	expected = (check.missing != NULL) + (check.resized != NULL);
+	if (failed != expected) {
+		fprintf(stderr, "  verify found %d bad files, expected %d\n",
+			failed, expected);
+		ctx->errors++;
+	}
+}
+
+/* Check whether updating the system set to the repo set fits on the
+ * file system of a scratch root. */
+static void
+start_space(struct test_context *ctx, const char **atts)
+{
+	const char *result = NULL;
+	char *root;
+	int status;
+
+	get_atts(atts, "result", &result, NULL);
+	root = create_tmp_dir(ctx);
+	status = razor_set_check_space(get_system_set(ctx),
+				       ctx->repo_set, root);
+	free(root);
+
+	if (status != (result ? atoi(result) : 0)) {
+		fprintf(stderr, "  space check returned %d, expected %s\n",
+			status, result ? result : "0");
+		ctx->errors++;
+	}
+}
+
+static void
+add_orphan(const char *path, void *data)
+{
+	add_name(data, path);
+}
+
+/* Lay out the files of the system set in a scratch root along with
+ * the space separated extra paths, where a trailing slash makes a
+ * directory, and check the orphans found under prefix. */
+static void
+start_orphans(struct test_context *ctx, const char **atts)
+{
+	const char *prefix = NULL, *extra = NULL, *expected = NULL;
+	struct name_list list = { NULL, NULL, 0 };
+	char buffer[PATH_MAX], *paths, *path, *root;
+	int count;
+
+	get_atts(atts, "prefix", &prefix,
+		 "extra", &extra,
+		 "expected", &expected,
+		 NULL);
+
+	root = create_tmp_dir(ctx);
+	create_files(get_system_set(ctx), root, NULL, NULL);
+	paths = strdup(extra ? extra : "");
+	for (path = strtok(paths, " "); path; path = strtok(NULL, " ")) {
+		if (path[strlen(path) - 1] != '/') {
+			create_file(root, path, 0, 0644, 0);
+			continue;
+		}
+		snprintf(buffer, sizeof buffer, "%s%s", root, path);
+		create_parents(buffer, root);
+	}
+	free(paths);
+
+	count = razor_set_find_orphans(ctx->system_set, root,
+				       prefix ? prefix : "/", 2,
+				       add_orphan, &list);
+	free(root);
+
+	if (count != list.count) {
+		fprintf(stderr, "  find orphans returned %d, reported %d\n",
+			count, list.count);
+		ctx->errors++;
+	}
+	check_names(ctx, "find orphans", &list, expected);
+}
+
+static void
+check_fingerprint(struct test_context *ctx, const char *what,
+		  struct razor_set *set, const unsigned char *expected)
+{
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+
+	if (razor_set_get_fingerprint(set, fingerprint) == 0 &&
+	    memcmp(fingerprint, expected, sizeof fingerprint) == 0)
+		return;
+
+	fprintf(stderr, "  %s has another fingerprint\n", what);
+	ctx->errors++;
+}
+
+/* Each set gets a file of its own, since rewriting the file of a set
+ * that is still mapped pulls the data from under it. */
+static const char *
+get_set_path(struct test_context *ctx)
+{
+	char name[32];
+
+	snprintf(name, sizeof name, "set-%d.rzdb", ctx->tmp_files++);
+
+	return get_tmp_path(ctx, name);
+}
+
+static struct razor_set *
+write_and_open(struct test_context *ctx, struct razor_set *set,
+	       int split, uint32_t flags)
+{
+	const char *path;
+	struct razor_set *opened;
+	int status;
+
+	path = get_set_path(ctx);
+	if (split)
+		status = razor_set_write_split(set, path, flags);
+	else
+		status = razor_set_write(set, path,
+					 RAZOR_SECTION_ALL | flags);
+	if (status < 0) {
+		fprintf(stderr, "  failed to write %s\n", path);
+		exit(1);
+	}
+
+	opened = razor_set_open(path);
+	if (opened == NULL) {
+		fprintf(stderr, "  failed to open %s\n", path);
+		exit(1);
+	}
+
+	return opened;
+}
+
+/* Write the system set out and read it back, twice, to check that
+ * the file format keeps all of it and that the fingerprint doesn't
+ * depend on how the set was written. */
+static void
+start_roundtrip(struct test_context *ctx, const char **atts)
+{
+	unsigned char fingerprint[RAZOR_FINGERPRINT_SIZE];
+	struct razor_set *system, *set, *rewritten;
+	const char *format = NULL;
+	uint32_t flags;
+	int split;
+
+	get_atts(atts, "format", &format, NULL);
+	flags = 0;
+	split = 0;
+	if (format && strstr(format, "compressed"))
+		flags |= RAZOR_SECTION_COMPRESSED;
+	if (format && strstr(format, "page-aligned"))
+		flags |= RAZOR_SECTION_PAGE_ALIGNED;
+	if (format && strstr(format, "split"))
+		split = 1;
+
+	system = get_system_set(ctx);
+	if (razor_set_get_fingerprint(system, fingerprint) < 0) {
+		fprintf(stderr, "  failed to get fingerprint\n");
+		exit(1);
+	}
+
+	set = write_and_open(ctx, system, split, flags);
+	check_same_set(ctx, "reopened set", set, set, system);
+	check_fingerprint(ctx, "reopened set", set, fingerprint);
+
+	rewritten = write_and_open(ctx, set, split, flags);
+	check_same_set(ctx, "rewritten set", rewritten, rewritten, system);
+	check_fingerprint(ctx, "rewritten set", rewritten, fingerprint);
+	razor_set_destroy(rewritten);
+
+	replace_system_set(ctx, set);
+}
+
+static void
+start_layer(struct test_context *ctx, const char **atts)
+{
+	ctx->n_install_pkgs = 0;
+	ctx->n_remove_pkgs = 0;
+}
+
+/* Copy the range of a delta file that the delta index has for set to
+ * a file of its own and apply it to set. */
+static struct razor_set *
+apply_indexed_delta(struct test_context *ctx, struct razor_set *set,
+		    const char *deltas, const char *index)
+{
+	uint32_t offset, size;
+	const char *path;
+	char *buffer;
+	int fd, status;
+
+	if (razor_delta_index_lookup(index, set, &offset, &size) < 0)
+		return NULL;
+
+	buffer = malloc(size);
+	fd = open(deltas, O_RDONLY);
+	status = fd >= 0 && pread(fd, buffer, size, offset) == size;
+	if (fd >= 0)
+		close(fd);
+
+	path = get_set_path(ctx);
+	if (status) {
+		fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, 0666);
+		status = fd >= 0 && write(fd, buffer, size) == size;
+		if (fd >= 0)
+			close(fd);
+	}
+	free(buffer);
+	if (!status) {
+		fprintf(stderr, "  failed to copy delta: %m\n");
+		exit(1);
+	}
+
+	return razor_set_apply_delta(set, path);
+}
+
+/* Write deltas to set from an empty set and from base, and check
+ * that each can be found in the index and gives set, while set itself
+ * has no delta. */
+static void
+check_delta_file(struct test_context *ctx, struct razor_set *base,
+		 struct razor_set *set)
+{
+	struct razor_set *old[2], *applied;
+	uint32_t offset, size;
+	char *deltas, *index;
+	int i;
+
+	old[0] = razor_set_create();
+	old[1] = base;
+	deltas = strdup(get_set_path(ctx));
+	index = strdup(get_set_path(ctx));
+	if (razor_set_write_deltas(set, old, 2, deltas, index) < 0) {
+		fprintf(stderr, "  failed to write deltas\n");
+		ctx->errors++;
+	} else {
+		for (i = 0; i < 2; i++) {
+			applied = apply_indexed_delta(ctx, old[i],
+						      deltas, index);
+			if (applied == NULL) {
+				fprintf(stderr, "  no delta from set %d\n", i);
+				ctx->errors++;
+				continue;
+			}
+			check_same_set(ctx, "indexed delta",
+				       applied, applied, set);
+			razor_set_destroy(applied);
+		}
+		if (razor_delta_index_lookup(index, set, &offset, &size) == 0) {
+			fprintf(stderr, "  delta index has the new set\n");
+			ctx->errors++;
+		}
+	}
+
+	free(deltas);
+	free(index);
+	razor_set_destroy(old[0]);
+}
+
+/* Check that the delta of a layer, written out and read back, and a
+ * delta between the base and the compacted layer both give the
+ * compacted layer. */
+static void
+check_deltas(struct test_context *ctx, struct razor_set *layer,
+	     struct razor_set *compact)
+{
+	struct razor_set *base, *reopened, *delta, *set;
+	const char *path;
+
+	base = ctx->system_set;
+	path = get_set_path(ctx);
+	if (razor_set_write(layer, path,
+			    RAZOR_SECTION_ALL | RAZOR_SECTION_DELTA) < 0 ||
+	    (reopened = razor_set_open_layer(base, path)) == NULL) {
+		fprintf(stderr, "  failed to write and open layer\n");
+		ctx->errors++;
+	} else {
+		set = razor_set_compact(reopened);
+		check_same_set(ctx, "reopened layer", set, set, compact);
+		razor_set_destroy(set);
+		razor_set_destroy(reopened);
+	}
+
+	delta = razor_set_create_delta(base, compact);
+	path = get_set_path(ctx);
+	if (delta == NULL ||
+	    razor_set_write(delta, path,
+			    RAZOR_SECTION_ALL | RAZOR_SECTION_DELTA) < 0 ||
+	    (set = razor_set_apply_delta(base, path)) == NULL) {
+		fprintf(stderr, "  failed to create and apply delta\n");
+		ctx->errors++;
+	} else {
+		check_same_set(ctx, "applied delta", set, set, compact);
+		razor_set_destroy(set);
+	}
+	if (delta)
+		razor_set_destroy(delta);
+
+	check_delta_file(ctx, base, compact);
+}
+
+/* Remove and add the named packages in a layer on top of the system
+ * set, then make the compacted layer the system set. */
+static void
+end_layer(struct test_context *ctx)
+{
+	struct razor_set *layer, *compact;
+	struct razor_package *pkg;
+	int i;
+
+	layer = razor_set_create_layer(get_system_set(ctx));
+	for (i = 0; i < ctx->n_remove_pkgs; i++) {
+		pkg = get_package(layer, ctx->remove_pkgs[i]);
+		if (!pkg || razor_set_remove_package(layer, pkg) < 0) {
+			fprintf(stderr, "  failed to remove %s from layer\n",
+				ctx->remove_pkgs[i]);
+			ctx->errors++;
+		}
+	}
+	for (i = 0; i < ctx->n_install_pkgs; i++) {
+		pkg = get_package(ctx->repo_set, ctx->install_pkgs[i]);
+		if (!pkg ||
+		    razor_set_add_package(layer, ctx->repo_set, pkg) < 0) {
+			fprintf(stderr, "  failed to add %s to layer\n",
+				ctx->install_pkgs[i]);
+			ctx->errors++;
+		}
+	}
+
+	while (ctx->n_install_pkgs--)
+		free(ctx->install_pkgs[ctx->n_install_pkgs]);
+	while (ctx->n_remove_pkgs--)
+		free(ctx->remove_pkgs[ctx->n_remove_pkgs]);
+
+	compact = razor_set_compact(layer);
+	if (compact == NULL) {
+		fprintf(stderr, "  failed to compact layer\n");
+		exit(1);
+	}
+	check_same_set(ctx, "layer", layer, compact, compact);
+	check_parallel_for(ctx, layer);
+	check_deltas(ctx, layer, compact);
+
+	razor_set_destroy(layer);
+	replace_system_set(ctx, compact);
+}
+
+/* Stack the repo set on the system set and make the effective set
+ * the system set.  If provides is given, check the visible packages
+ * that provide it. */
+static void
+start_overlay(struct test_context *ctx, const char **atts)
+{
+	struct razor_overlay *overlay;
+	struct razor_overlay_iterator *oi;
+	struct razor_package_iterator *pi;
+	struct razor_set *set, *cached, *layer;
+	struct razor_package *package, *visible;
+	struct name_list list = { NULL, NULL, 0 };
+	const char *name, *version, *visible_version, *cache;
+	const char *provides = NULL, *expected = NULL;
+	int count;
+
+	get_atts(atts, "provides", &provides,
+		 "expected", &expected,
+		 NULL);
+
+	if (!ctx->repo_set) {
+		fprintf(stderr, "  overlay needs a repo set\n");
+		exit(1);
+	}
+
+	overlay = razor_overlay_create();
+	razor_overlay_push(overlay, get_system_set(ctx));
+	razor_overlay_push(overlay, ctx->repo_set);
+
+	cache = get_tmp_path(ctx, "overlay.rzdb");
+	set = razor_overlay_get_effective_set(overlay, cache);
+	cached = razor_overlay_get_effective_set(overlay, cache);
+	if (set == NULL || cached == NULL) {
+		fprintf(stderr, "  failed to get effective set\n");
+		exit(1);
+	}
+	check_same_set(ctx, "cached effective set", cached, cached, set);
+	razor_set_destroy(cached);
+
+	/* The overlay must show the packages of the effective set. */
+	count = 0;
+	pi = razor_package_iterator_create(set);
+	while (razor_package_iterator_next(pi, &package,
+					   RAZOR_DETAIL_NAME, &name,
+					   RAZOR_DETAIL_VERSION, &version,
+					   RAZOR_DETAIL_LAST)) {
+		count++;
+		layer = razor_overlay_get_package(overlay, name, &visible);
+		if (layer)
+			razor_package_get_details(layer, visible,
+						  RAZOR_DETAIL_VERSION,
+						  &visible_version,
+						  RAZOR_DETAIL_LAST);
+		if (!layer || strcmp(version, visible_version) != 0) {
+			fprintf(stderr, "  overlay doesn't show %s-%s\n",
+				name, version);
+			ctx->errors++;
+		}
+	}
+	razor_package_iterator_destroy(pi);
+
+	oi = razor_overlay_iterator_create(overlay);
+	while (razor_overlay_iterator_next(oi, &layer, &package))
+		count--;
+	razor_overlay_iterator_destroy(oi);
+	if (count != 0) {
+		fprintf(stderr, "  overlay and effective set differ in size\n");
+		ctx->errors++;
+	}
+
+	if (provides) {
+		oi = razor_overlay_iterator_create_for_property(overlay,
+			provides, RAZOR_PROPERTY_PROVIDES);
+		while (razor_overlay_iterator_next(oi, &layer, &package)) {
+			razor_package_get_details(layer, package,
+						  RAZOR_DETAIL_NAME, &name,
+						  RAZOR_DETAIL_LAST);
+			add_name(&list, name);
+		}
+		razor_overlay_iterator_destroy(oi);
+		check_names(ctx, "overlay providers", &list, expected);
+	}
+
+	razor_overlay_destroy(overlay);
+	replace_system_set(ctx, set);
+}
+
+/* Open a set file from next to the test file as the system set.  It
+ * must hold the same as the repo set of the test, which is how sets
+ * written by builds with another byte order or index width are
+ * checked. */
+static void
+start_open(struct test_context *ctx, const char **atts)
+{
+	const char *file = NULL;
+	char path[PATH_MAX];
+	struct razor_set *set;
+
+	get_atts(atts, "file", &file, NULL);
+	if (!file || !ctx->repo_set) {
+		fprintf(stderr, "  open needs a file and a repo set\n");
+		exit(1);
+	}
+
+	snprintf(path, sizeof path, "%s/%s", ctx->srcdir, file);
+	set = razor_set_open(path);
+	if (set == NULL) {
+		fprintf(stderr, "  failed to open %s\n", path);
+		ctx->errors++;
+		return;
+	}
+
+	check_same_set(ctx, file, set, set, ctx->repo_set);
+	if (ctx->system_set)
+		razor_set_destroy(ctx->system_set);
+	ctx->system_set = set;
+}
+
+static void
+start_repack(struct test_context *ctx, const char **atts)
+{
+	struct razor_set *set;
+
+	set = razor_set_repack(get_system_set(ctx));
+	check_same_set(ctx, "repacked set", set, set, ctx->system_set);
+	replace_system_set(ctx, set);
+}
+
 static void
 start_test_element(void *data, const char *element, const char **atts)
 {
@@ -459,6 +1915,42 @@ start_test_element(void *data, const char *element, const char **atts)
 		start_property(ctx, RAZOR_PROPERTY_CONFLICTS, atts);
 	} else if (strcmp(element, "obsoletes") == 0) {
 		start_property(ctx, RAZOR_PROPERTY_OBSOLETES, atts);
+	} else if (strcmp(element, "index-limit") == 0) {
+		start_index_limit(ctx, atts);
+	} else if (strcmp(element, "query") == 0) {
+		start_query(ctx, atts);
+	} else if (strcmp(element, "search") == 0) {
+		start_search(ctx, atts);
+	} else if (strcmp(element, "closure") == 0) {
+		start_closure(ctx, atts);
+	} else if (strcmp(element, "view") == 0) {
+		start_view(ctx, atts);
+	} else if (strcmp(element, "file") == 0) {
+		start_file(ctx, atts);
+	} else if (strcmp(element, "owners") == 0) {
+		start_owners(ctx, atts);
+	} else if (strcmp(element, "lookup") == 0) {
+		start_lookup(ctx, atts);
+	} else if (strcmp(element, "files") == 0) {
+		start_files(ctx, atts);
+	} else if (strcmp(element, "basename") == 0) {
+		start_basename(ctx, atts);
+	} else if (strcmp(element, "verify") == 0) {
+		start_verify(ctx, atts);
+	} else if (strcmp(element, "space") == 0) {
+		start_space(ctx, atts);
+	} else if (strcmp(element, "orphans") == 0) {
+		start_orphans(ctx, atts);
+	} else if (strcmp(element, "roundtrip") == 0) {
+		start_roundtrip(ctx, atts);
+	} else if (strcmp(element, "layer") == 0) {
+		start_layer(ctx, atts);
+	} else if (strcmp(element, "overlay") == 0) {
+		start_overlay(ctx, atts);
+	} else if (strcmp(element, "open") == 0) {
+		start_open(ctx, atts);
+	} else if (strcmp(element, "repack") == 0) {
+		start_repack(ctx, atts);
 	} else {
 		fprintf(stderr, "Unrecognized element '%s'\n", element);
 		exit(1);
@@ -482,6 +1974,8 @@ end_test_element (void *data, const char *element)
 		end_result(ctx);
 	} else if (strcmp(element, "unsatisfiable") == 0) {
 		end_unsatisfiable(ctx);
+	} else if (strcmp(element, "layer") == 0) {
+		end_layer(ctx);
 	}
 }
 
@@ -514,6 +2008,9 @@ int main(int argc, char *argv[])
 
 	fprintf(stderr, "test-driver: using %s\n", path);
 
+	ctx.srcdir = strdup(test_file);
+	ctx.srcdir = dirname(ctx.srcdir);
+
 	parse_xml_file(test_file, start_test_element, end_test_element, &ctx);
 
 	if (ctx.errors)